@@ -1,4 +1,7 @@
 // client.c — Exercise 3
+//
+// Build: gcc -Wall -Wextra -O2 client.c ../common/listen.c ../common/scan.c ../common/netio.c -o client
+// Run:   ./client [unix:PATH | seqpacket:PATH]   (default: TCP 127.0.0.1:8080)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,27 +9,32 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
-#define PORT 8080
-
-static void trim_newline(char *s) {
-    size_t n = strlen(s);
-    while (n && (s[n-1] == '\n' || s[n-1] == '\r')) s[--n] = '\0';
-}
+#include "../common/listen.h"
+#include "../common/netio.h"
 
-int main(void) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { perror("socket"); return 1; }
-
-    struct sockaddr_in server_addr = {0};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+#define PORT 8080
 
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("connect"); return 1;
+int main(int argc, char **argv) {
+    int sock;
+    if (argc > 1) {                       // unix:PATH or seqpacket:PATH on this host
+        sock = local_connect(argv[1]);
+        if (sock < 0) { perror(argv[1]); return 1; }
+    } else {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) { perror("socket"); return 1; }
+
+        struct sockaddr_in server_addr = {0};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+
+        if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+            perror("connect"); return 1;
+        }
     }
 
-    printf("Connected to 127.0.0.1:%d\n", PORT);
+    if (argc > 1) printf("Connected to %s\n", argv[1]);
+    else printf("Connected to 127.0.0.1:%d\n", PORT);
     char sendbuf[1024], recvbuf[1200];
 
     for (;;) {
@@ -34,7 +42,7 @@ int main(void) {
         fflush(stdout);
 
         if (!fgets(sendbuf, sizeof(sendbuf), stdin)) break; // EOF/ctrl-D
-        trim_newline(sendbuf);
+        trim_eol(sendbuf);
         if (sendbuf[0] == '\0') continue; // ignore empty line
 
         send(sock, sendbuf, strlen(sendbuf), 0);
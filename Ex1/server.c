@@ -1,4 +1,7 @@
 // server.c — Exercise 3
+//
+// Build: gcc -Wall -Wextra -O2 server.c ../common/listen.c ../common/scan.c ../common/netio.c -o server
+// Run:   ./server [-l unix:PATH | -l seqpacket:PATH ...]
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,12 +10,10 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
-#define PORT 8080
+#include "../common/listen.h"
+#include "../common/netio.h"
 
-static void trim_newline(char *s) {
-    size_t n = strlen(s);
-    while (n && (s[n-1] == '\n' || s[n-1] == '\r')) s[--n] = '\0';
-}
+#define PORT 8080
 
 void handle_client(int client_sock) {
     char buffer[1024];
@@ -20,7 +21,7 @@ void handle_client(int client_sock) {
         ssize_t n = recv(client_sock, buffer, sizeof(buffer) - 1, 0);
         if (n <= 0) break;                // client closed or error
         buffer[n] = '\0';
-        trim_newline(buffer);
+        trim_eol(buffer);
 
         if (strcmp(buffer, "exit") == 0)  // client wants to quit
             break;
@@ -32,35 +33,37 @@ void handle_client(int client_sock) {
     close(client_sock);
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    const char *local[LISTEN_MAX];        // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    for (int ch; (ch = getopt(argc, argv, "l:")) != -1; ) {
+        if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else { fprintf(stderr, "usage: %s [-l unix:PATH | -l seqpacket:PATH ...]\n", argv[0]); exit(2); }
+    }
+
     // Avoid zombie processes when children exit
     signal(SIGCHLD, SIG_IGN);
 
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) { perror("socket"); exit(1); }
-
-    int opt = 1;
-    setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    lo.backlog = 5;
+    int server_sock = listen_tcp(PORT, &lo);
+    if (server_sock < 0) { perror("listen"); exit(1); }
 
-    struct sockaddr_in server_addr = {0};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
-
-    if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("bind"); exit(1);
-    }
+    printf("Server listening on port %d...\n", PORT);
 
-    if (listen(server_sock, 5) < 0) {
-        perror("listen"); exit(1);
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, server_sock);
+    for (int k = 0; k < nlocal; k++) {
+        if (listen_set_add_spec(&ls, local[k], 16) < 0) { perror(local[k]); exit(1); }
+        printf("Also listening on %s\n", local[k]);
     }
 
-    printf("Server listening on port %d...\n", PORT);
-
     for (;;) {
         struct sockaddr_in client_addr;
         socklen_t addr_size = sizeof(client_addr);
-        int client_sock = accept(server_sock, (struct sockaddr *)&client_addr, &addr_size);
+        int client_sock = listen_set_accept(&ls, (struct sockaddr *)&client_addr, &addr_size);
         if (client_sock < 0) { perror("accept"); continue; }
 
         pid_t pid = fork();
@@ -71,7 +74,7 @@ int main(void) {
         }
         if (pid == 0) {
             // child
-            close(server_sock); // child doesn't accept new clients
+            listen_set_close(&ls); // child doesn't accept new clients
             handle_client(client_sock);
             _exit(0);
         } else {
@@ -1,4 +1,7 @@
 // client.cpp — Exercise 2 (C++ client)
+//
+// Build: g++ -Wall -Wextra -O2 client.cpp ../common/listen.c -o client
+// Run:   ./client [unix:PATH | seqpacket:PATH]   (default: TCP 127.0.0.1:8080)
 #include <iostream>
 #include <cstring>
 #include <unistd.h>
@@ -6,19 +9,27 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 
+#include "../common/listen.h"
+
 #define PORT 8080
 
-int main() {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { perror("socket"); return 1; }
+int main(int argc, char** argv) {
+    int sock;
+    if (argc > 1) {                       // unix:PATH or seqpacket:PATH on this host
+        sock = local_connect(argv[1]);
+        if (sock < 0) { perror(argv[1]); return 1; }
+    } else {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) { perror("socket"); return 1; }
 
-    sockaddr_in server_addr{};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+        sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
 
-    if (connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("connect"); return 1;
+        if (connect(sock, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            perror("connect"); return 1;
+        }
     }
 
     const char *hello = "Hello C++ Server";
@@ -1,5 +1,13 @@
 // server.cpp — Exercise 2 (C++ fork-based server)
+//
+// Build: g++ -Wall -Wextra -O2 server.cpp ../common/metrics.c ../common/listen.c ../common/keepalive.c -o server
+// Run:   ./server [-m metrics_port] [-l unix:PATH | -l seqpacket:PATH ...] [-k idle=MS,max=N | -k off]
+//
+// A client that opens with "KEEPALIVE\n" keeps its connection for many
+// ID-tagged, pipelined requests (common/keepalive.h); anything else is
+// answered once and closed, as before.
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -7,59 +15,104 @@
 #include <sys/socket.h>
 #include <signal.h>
 
+#include "../common/metrics.h"
+#include "../common/listen.h"
+#include "../common/keepalive.h"
+
 #define PORT 8080
 
+// Counted in the forked children too (shared memory); -m serves them.
+static metric_t *m_conns, *m_active, *m_msgs, *m_bytes_in, *m_bytes_out;
+static keepalive_t ka;                      // -k
+
 void handle_client(int client_sock) {
     char buffer[1024];
     ssize_t n = recv(client_sock, buffer, sizeof(buffer) - 1, 0);
+    const char *msg = "Hello from C++ server";
     if (n > 0) {
-        buffer[n] = '\0';
-        std::cout << "Received: " << buffer << std::endl;
-        const char *msg = "Hello from C++ server";
-        send(client_sock, msg, std::strlen(msg), 0);
+        metric_add(m_bytes_in, n);
+        size_t len = (size_t)n;
+        if (keepalive_detect(&ka, client_sock, buffer, &len, sizeof(buffer) - 1)) {
+            long served;
+            int why = keepalive_serve(&ka, client_sock, msg, buffer, len, &served);
+            std::cout << "Keep-alive connection: " << served << " requests, closed on " << keepalive_why(why) << std::endl;
+        } else {
+            metric_inc(m_msgs);
+            buffer[len] = '\0';
+            std::cout << "Received: " << buffer << std::endl;
+            ssize_t w = send(client_sock, msg, std::strlen(msg), 0);
+            if (w > 0) metric_add(m_bytes_out, w);
+        }
     }
+    metric_dec(m_active);
     close(client_sock);
 }
 
-int main() {
+int main(int argc, char** argv) {
+    int metrics_port = 0;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    keepalive_init(&ka);
+    for (int ch; (ch = getopt(argc, argv, "m:l:k:")) != -1; ) {
+        if (ch == 'm') metrics_port = std::atoi(optarg);
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else if (ch == 'k' && keepalive_parse(&ka, optarg) == 0) continue;
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [-m metrics_port] [-l unix:PATH | -l seqpacket:PATH ...] [-k idle=MS,max=N | -k off]\n";
+            return 2;
+        }
+    }
+    // Registered before any fork so the children update the same counters.
+    metrics_init();
+    m_conns     = metric_counter("server_connections_total", nullptr, "Accepted connections");
+    m_active    = metric_gauge("server_connections_active", nullptr, "Open connections");
+    m_msgs      = metric_counter("server_messages_total", nullptr, "Requests answered");
+    m_bytes_in  = metric_counter("server_bytes_in_total", nullptr, "Bytes received");
+    m_bytes_out = metric_counter("server_bytes_out_total", nullptr, "Bytes sent");
+    ka.requests  = m_msgs;
+    ka.bytes_in  = m_bytes_in;
+    ka.bytes_out = m_bytes_out;
+    ka.conns     = metric_counter("server_keepalive_connections_total", nullptr, "Connections that switched to keep-alive");
+    if (metrics_port && metrics_serve(metrics_port) < 0) { perror("metrics endpoint"); return 1; }
+
     // avoid zombies
     signal(SIGCHLD, SIG_IGN);
 
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) { perror("socket"); return 1; }
-
-    int opt = 1;
-    setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    lo.backlog = 5;
+    int server_sock = listen_tcp(PORT, &lo);
+    if (server_sock < 0) { perror("listen"); return 1; }
 
-    sockaddr_in server_addr{};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    std::cout << "C++ server listening on " << PORT << "...\n";
 
-    if (bind(server_sock, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("bind"); return 1;
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, server_sock);
+    for (int k = 0; k < nlocal; k++) {
+        if (listen_set_add_spec(&ls, local[k], 16) < 0) { perror(local[k]); return 1; }
+        std::cout << "Also listening on " << local[k] << "\n";
     }
-    if (listen(server_sock, 5) < 0) {
-        perror("listen"); return 1;
-    }
-
-    std::cout << "C++ server listening on " << PORT << "...\n";
 
     while (true) {
         sockaddr_in client_addr{};
         socklen_t addr_size = sizeof(client_addr);
-        int client_sock = accept(server_sock, (sockaddr*)&client_addr, &addr_size);
+        int client_sock = listen_set_accept(&ls, (sockaddr*)&client_addr, &addr_size);
         if (client_sock < 0) { perror("accept"); continue; }
+        metric_inc(m_conns);
+        metric_inc(m_active);
 
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork");
+            metric_dec(m_active);
             close(client_sock);
             continue;
         }
         if (pid == 0) {
             // child: handle this client
-            close(server_sock);
+            listen_set_close(&ls);
             handle_client(client_sock);
             _exit(0);
         } else {
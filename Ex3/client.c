@@ -1,3 +1,7 @@
+// client.c — Exercise 3 client
+//
+// Build: gcc -Wall -Wextra -O2 client.c ../common/listen.c ../common/scan.c ../common/netio.c -o client
+// Run:   ./client [unix:PATH | seqpacket:PATH]   (default: TCP 127.0.0.1:8080)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,26 +9,34 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
-#define PORT 8080
+#include "../common/listen.h"
+#include "../common/netio.h"
 
-static void trim(char *s){ size_t n=strlen(s); while(n && (s[n-1]=='\n'||s[n-1]=='\r')) s[--n]='\0'; }
+#define PORT 8080
 
-int main(void) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { perror("socket"); return 1; }
+int main(int argc, char **argv) {
+    int sock;
+    if (argc > 1) {                       // unix:PATH or seqpacket:PATH on this host
+        sock = local_connect(argv[1]);
+        if (sock < 0) { perror(argv[1]); return 1; }
+    } else {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) { perror("socket"); return 1; }
 
-    struct sockaddr_in sa = {0};
-    sa.sin_family = AF_INET; sa.sin_port = htons(PORT);
-    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+        struct sockaddr_in sa = {0};
+        sa.sin_family = AF_INET; sa.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
 
-    if (connect(sock, (struct sockaddr*)&sa, sizeof(sa)) < 0) { perror("connect"); return 1; }
-    printf("Connected to 127.0.0.1:%d\n", PORT);
+        if (connect(sock, (struct sockaddr*)&sa, sizeof(sa)) < 0) { perror("connect"); return 1; }
+    }
+    if (argc > 1) printf("Connected to %s\n", argv[1]);
+    else printf("Connected to 127.0.0.1:%d\n", PORT);
 
     char sendbuf[1024], recvbuf[1200];
     for (;;) {
         printf("> "); fflush(stdout);
         if (!fgets(sendbuf, sizeof(sendbuf), stdin)) break;
-        trim(sendbuf);
+        trim_eol(sendbuf);
         if (!sendbuf[0]) continue;
 
         send(sock, sendbuf, strlen(sendbuf), 0);
@@ -1,3 +1,10 @@
+// server.c — Exercise 3: fork-per-client echo server
+//
+// Build: gcc -Wall -Wextra -O2 server.c ../common/metrics.c ../common/listen.c
+//            ../common/scan.c ../common/netio.c -o server
+// Run:   ./server [-m metrics_port] [-A accept_opts] [-l unix:PATH | -l seqpacket:PATH ...]
+//        -A = TCP accept tuning, e.g. backlog=4096,defer=5,shards=4 (see ../common/listen.h)
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,54 +13,90 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
+#include "../common/metrics.h"
+#include "../common/listen.h"
+#include "../common/netio.h"
+
 #define PORT 8080
 
-static void trim(char *s){ size_t n=strlen(s); while(n && (s[n-1]=='\n'||s[n-1]=='\r')) s[--n]='\0'; }
+// Counted in the forked children too (shared memory); -m serves them.
+static metric_t *m_conns, *m_active, *m_msgs, *m_bytes_in, *m_bytes_out;
 
 static void handle_client(int cs) {
     char buf[1024], out[1200];
     for (;;) {
         ssize_t n = recv(cs, buf, sizeof(buf)-1, 0);
         if (n <= 0) break;         // disconnect/error
-        buf[n] = '\0'; trim(buf);
+        metric_inc(m_msgs); metric_add(m_bytes_in, n);
+        buf[n] = '\0'; trim_eol(buf);
         if (!strcmp(buf,"exit")) break;
-        snprintf(out, sizeof(out), "Echo: %s", buf);
-        send(cs, out, strlen(out), 0);
+        int len = snprintf(out, sizeof(out), "Echo: %s", buf);
+        ssize_t w = send(cs, out, (size_t)len, 0);
+        if (w > 0) metric_add(m_bytes_out, w);
     }
+    metric_dec(m_active);
     close(cs);
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    int metrics_port = 0;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    for (int ch; (ch = getopt(argc, argv, "m:l:A:")) != -1; ) {
+        if (ch == 'm') metrics_port = atoi(optarg);
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-m metrics_port] [-A backlog=N,defer=S,fastopen=Q,shards=N] "
+                            "[-l unix:PATH | -l seqpacket:PATH ...]\n", argv[0]);
+            exit(2);
+        }
+    }
+    metrics_init();
+    m_conns     = metric_counter("server_connections_total", NULL, "Accepted connections");
+    m_active    = metric_gauge("server_connections_active", NULL, "Open connections");
+    m_msgs      = metric_counter("server_messages_total", NULL, "Messages received");
+    m_bytes_in  = metric_counter("server_bytes_in_total", NULL, "Bytes received");
+    m_bytes_out = metric_counter("server_bytes_out_total", NULL, "Bytes sent");
+    if (metrics_port && metrics_serve(metrics_port) < 0) { perror("metrics endpoint"); exit(1); }
+
     signal(SIGCHLD, SIG_IGN);                // avoid zombies
 
-    int s = socket(AF_INET, SOCK_STREAM, 0);
-    if (s < 0) { perror("socket"); exit(1); }
+    int shard = listen_shard(&lo);           // -A shards=N: one acceptor per shard
+    int s = listen_tcp(PORT, &lo);
+    if (s < 0) { perror("listen"); exit(1); }
 
-    int opt=1; setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (shard == 0) printf("Server listening on %d (backlog %d) …\n", PORT, lo.backlog);
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, s);
+    for (int k = 0; k < nlocal && shard == 0; k++) {
+        if (listen_set_add_spec(&ls, local[k], lo.backlog) < 0) { perror(local[k]); exit(1); }
+        printf("Also listening on %s\n", local[k]);
+    }
 
-    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(1); }
-    if (listen(s, 5) < 0) { perror("listen"); exit(1); }
+    for (;;) {
+        int acc[ACCEPT_BATCH];
+        int n = listen_set_accept_batch(&ls, acc, ACCEPT_BATCH, SOCK_CLOEXEC);
+        if (n < 0) { perror("accept"); continue; }
 
-    printf("Server listening on %d …\n", PORT);
+        for (int a = 0; a < n; a++) {
+            int cs = acc[a];
+            metric_inc(m_conns); metric_inc(m_active);
 
-    for (;;) {
-        struct sockaddr_in ca; socklen_t alen = sizeof(ca);
-        int cs = accept(s, (struct sockaddr*)&ca, &alen);
-        if (cs < 0) { perror("accept"); continue; }
-
-        pid_t pid = fork();
-        if (pid < 0) { perror("fork"); close(cs); continue; }
-        if (pid == 0) {              // child
-            close(s);
-            handle_client(cs);
-            _exit(0);
-        } else {                     // parent
-            close(cs);
+            pid_t pid = fork();
+            if (pid < 0) { perror("fork"); close(cs); metric_dec(m_active); continue; }
+            if (pid == 0) {          // child
+                listen_set_close(&ls);
+                for (int b = a + 1; b < n; b++) close(acc[b]);
+                handle_client(cs);
+                _exit(0);
+            } else {                 // parent
+                close(cs);
+            }
         }
     }
 }
@@ -1,4 +1,23 @@
 // server.c — Exercise 5: fork per client + 10s idle timeout using select()
+//
+// Build: gcc -Wall -Wextra -O2 server.c ../common/scan.c ../common/metrics.c
+//            ../common/udpecho.c ../common/listen.c ../common/busypoll.c ../common/netio.c -o server
+// Run:   ./server [-m metrics_port] [-A accept_opts] [-B busy_opts] [-n]
+//                 [-l unix:PATH | -l seqpacket:PATH ...] [-u workers [-G]]
+//        -A = TCP accept tuning, e.g. backlog=4096,defer=5,fastopen=256,shards=4
+//             (shards = acceptor processes on SO_REUSEPORT listeners)
+//        -B = low-latency mode, e.g. spin=50,sock=50,prefer=1,cpu=3: each
+//             handler spins 50 us before sleeping in select(), connections
+//             get SO_BUSY_POLL, and the accept loop (not the handlers, which
+//             would spin on one core together) is pinned to CPU 3
+//        -l = also accept local clients on an AF_UNIX socket (repeatable)
+//        -n = end every reply with '\n' ("Echo: <line>\n"), so a client that
+//             pipelines lines can tell the replies apart; without it replies
+//             are "Echo: <line>" as before
+//        -u = UDP echo on the same port instead of TCP: one reply per
+//             datagram, batched with recvmmsg/sendmmsg, `workers` processes
+//             sharing the port via SO_REUSEPORT
+//        -G = with -u, use UDP GRO/GSO segmentation offload
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,27 +30,58 @@
 #include <sys/select.h>
 #include <netinet/in.h>
 
+#include "../common/scan.h"
+#include "../common/metrics.h"
+#include "../common/udpecho.h"
+#include "../common/listen.h"
+#include "../common/busypoll.h"
+#include "../common/netio.h"
+
 #define PORT 8080
 #define IDLE_TIMEOUT_SEC 10
+#define RECV_BUF   65536                    // room for many pipelined lines
+#define MAX_LINES  64                       // spans per scan_lines() call
+#define MAX_LINE   1024                     // longer lines are echoed truncated
+#define OUT_BUF    ((MAX_LINES + 1) * (MAX_LINE + 8))
+
+// Counted in the forked children too (shared memory); -m serves them.
+static metric_t *m_conns, *m_active, *m_msgs, *m_bytes_in, *m_bytes_out, *m_timeouts, *m_req;
+static busypoll_t g_busy;                   // -B; all zero = plain blocking select()
+static int g_nl;                            // -n: newline-terminated replies
+
+static ssize_t send_counted(int cs, const char *p, size_t n) {
+    ssize_t w = send(cs, p, n, 0);
+    if (w > 0) metric_add(m_bytes_out, w);
+    return w;
+}
 
-static void trim(char *s){
-    size_t n = strlen(s);
-    while (n && (s[n-1] == '\n' || s[n-1] == '\r')) s[--n] = '\0';
+// Append "Echo: <line>" to out, with the '\n' back under -n.  Every line gets
+// a reply, an empty one too.  Returns the new fill level.
+static size_t add_echo(char *out, size_t fill, const char *p, size_t len) {
+    if (len > MAX_LINE) len = MAX_LINE;
+    metric_inc(m_msgs);
+    int n = snprintf(out + fill, OUT_BUF - fill, "Echo: %.*s%s", (int)len, p, g_nl ? "\n" : "");
+    return fill + (size_t)n;
 }
 
 static void handle_client(int cs) {
-    char buf[1024], out[1200];
+    static char buf[RECV_BUF], out[OUT_BUF];
+    span_t lines[MAX_LINES], tail;
+    linebuf_t lb;
+    linebuf_init(&lb, buf, sizeof(buf));
+    busypoll_socket(cs, &g_busy);
 
     for (;;) {
         // Reinitialize fd_set and timeout every loop (select() mutates them)
         fd_set rfds; FD_ZERO(&rfds); FD_SET(cs, &rfds);
         struct timeval tv = { .tv_sec = IDLE_TIMEOUT_SEC, .tv_usec = 0 };
 
-        int ready = select(cs + 1, &rfds, NULL, NULL, &tv);
+        int ready = busypoll_select(cs + 1, &rfds, NULL, &tv, &g_busy);
         if (ready == 0) {
             // Timeout
             const char *msg = "Timeout: no message for 10 seconds. Goodbye.\n";
-            (void)send(cs, msg, strlen(msg), 0);
+            (void)send_counted(cs, msg, strlen(msg));
+            metric_inc(m_timeouts);
             break;
         } else if (ready < 0) {
             if (errno == EINTR) continue; // interrupted by signal; try again
@@ -39,60 +89,136 @@ static void handle_client(int cs) {
             break;
         }
 
-        ssize_t n = recv(cs, buf, sizeof(buf) - 1, 0);
+        ssize_t n = linebuf_fill(&lb, cs, 0);
         if (n <= 0) break; // client closed or error
-        buf[n] = '\0'; trim(buf);
+        uint64_t t_recv = mono_ns();
+        metric_add(m_bytes_in, n);
+
+        // Echo every complete line; replies are batched into as few send()s as possible.
+        size_t fill = 0, k;
+        int quit = 0;
+        while (!quit && (k = linebuf_lines(&lb, lines, MAX_LINES)) > 0) {
+            for (size_t j = 0; j < k && !quit; j++) {
+                if (lines[j].len == 4 && !memcmp(lines[j].p, "exit", 4)) { quit = 1; break; }
+                fill = add_echo(out, fill, lines[j].p, lines[j].len);
+            }
+            if (k == MAX_LINES && fill) {          // out holds one batch at most
+                if (send_counted(cs, out, fill) < 0) { quit = 1; break; }
+                fill = 0;
+            }
+        }
 
-        if (strcmp(buf, "exit") == 0) break;
+        // Unterminated tail: one message per recv() for clients that never
+        // send '\n' (./client strips it); otherwise wait for the rest.
+        if (!quit && linebuf_tail(&lb, &tail)) {
+            if (tail.len == 4 && !memcmp(tail.p, "exit", 4)) quit = 1;
+            else fill = add_echo(out, fill, tail.p, tail.len);
+        }
 
-        snprintf(out, sizeof(out), "Echo: %s", buf);
-        if (send(cs, out, strlen(out), 0) < 0) break;
+        if (fill && send_counted(cs, out, fill) < 0) break;
+        if (fill) metric_observe(m_req, mono_ns() - t_recv);
+        if (quit) break;
     }
+    metric_dec(m_active);
     close(cs);
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    int metrics_port = 0, udp_workers = 0, offload = 0;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    busypoll_init(&g_busy);
+    for (int ch; (ch = getopt(argc, argv, "m:u:Gl:A:B:n")) != -1; ) {
+        if (ch == 'm') metrics_port = atoi(optarg);
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0) continue;
+        else if (ch == 'B' && busypoll_parse(&g_busy, optarg) == 0) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else if (ch == 'u') udp_workers = atoi(optarg);
+        else if (ch == 'G') offload = 1;
+        else if (ch == 'n') g_nl = 1;
+        else {
+            fprintf(stderr, "usage: %s [-m metrics_port] [-A backlog=N,defer=S,fastopen=Q,shards=N] "
+                            "[-B spin=US,sock=US,prefer=0|1,cpu=N] [-n]\n"
+                            "       [-l unix:PATH | -l seqpacket:PATH ...] [-u workers [-G]]\n", argv[0]);
+            exit(2);
+        }
+    }
+    metrics_init();
+    m_conns     = metric_counter("server_connections_total", NULL, "Accepted connections");
+    m_active    = metric_gauge("server_connections_active", NULL, "Open connections");
+    m_msgs      = metric_counter("server_messages_total", NULL, "Lines echoed");
+    m_bytes_in  = metric_counter("server_bytes_in_total", NULL, "Bytes received");
+    m_bytes_out = metric_counter("server_bytes_out_total", NULL, "Bytes sent");
+    m_timeouts  = metric_counter("server_idle_timeouts_total", NULL, "Connections closed for idling");
+    m_req       = metric_histogram("server_request_seconds", NULL, "recv() to reply sent");
+    if (g_busy.spin_us > 0) {
+        g_busy.spin_wakeups  = metric_counter("server_wakeups_total", "how=\"spin\"", "select() returns with data");
+        g_busy.sleep_wakeups = metric_counter("server_wakeups_total", "how=\"sleep\"", "select() returns with data");
+    }
+    if (metrics_port && metrics_serve(metrics_port) < 0) { perror("metrics endpoint"); exit(1); }
+
+    if (udp_workers > 0) {
+        udp_echo_cfg_t cfg = { PORT, udp_workers, offload, m_msgs, m_bytes_in, m_bytes_out };
+        printf("UDP echo on %d (%d worker%s%s)…\n", PORT, udp_workers,
+               udp_workers > 1 ? "s, SO_REUSEPORT" : "", offload ? ", GRO/GSO" : "");
+        fflush(stdout);
+        udp_echo_run(&cfg);
+        perror("udp echo");
+        exit(1);
+    }
+
     // Reap children automatically (avoid zombies)
     signal(SIGCHLD, SIG_IGN);
 
-    int s = socket(AF_INET, SOCK_STREAM, 0);
-    if (s < 0) { perror("socket"); exit(1); }
-
-    int opt = 1;
-    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt");
-        // continue; it's safe but restarts may be slower without it
-    }
+    // Each shard is a full acceptor with its own SO_REUSEPORT listener.
+    int shard = listen_shard(&lo);
+    int s = listen_tcp(PORT, &lo);
+    if (s < 0) { perror("listen"); exit(1); }
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
+    if (shard == 0)
+        printf("Server (timeout=%ds) listening on %d (backlog %d, %d shard%s)…\n",
+               IDLE_TIMEOUT_SEC, PORT, lo.backlog, lo.shards, lo.shards > 1 ? "s" : "");
 
-    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(1); }
-    if (listen(s, 5) < 0) { perror("listen"); exit(1); }
+    if (busypoll_pin(&g_busy) < 0) { perror("pin to cpu"); exit(1); }   // not the metrics process
 
-    printf("Server (timeout=%ds) listening on %d…\n", IDLE_TIMEOUT_SEC, PORT);
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, s);
+    for (int k = 0; k < nlocal && shard == 0; k++) {     // one owner per socket path
+        if (listen_set_add_spec(&ls, local[k], lo.backlog) < 0) { perror(local[k]); exit(1); }
+        printf("Also listening on %s\n", local[k]);
+    }
 
     for (;;) {
-        struct sockaddr_in ca; socklen_t alen = sizeof(ca);
-        int cs = accept(s, (struct sockaddr*)&ca, &alen);
-        if (cs < 0) { perror("accept"); continue; }
-
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-            close(cs);
-            continue;
-        }
-        if (pid == 0) {
-            // child: handle this client
-            close(s);
-            handle_client(cs);
-            _exit(0);
-        } else {
-            // parent: keep accepting others
-            close(cs);
+        // Take everything queued on every ready listener, then fork for each.
+        int acc[ACCEPT_BATCH];
+        int n = listen_set_accept_batch(&ls, acc, ACCEPT_BATCH, SOCK_CLOEXEC);
+        if (n < 0) { perror("accept"); continue; }
+
+        for (int a = 0; a < n; a++) {
+            int cs = acc[a];
+            metric_inc(m_conns); metric_inc(m_active);
+
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                close(cs);
+                metric_dec(m_active);
+                continue;
+            }
+            if (pid == 0) {
+                // child: handle this client
+                busypoll_unpin();           // handlers spread out; only the accept loop stays
+                listen_set_close(&ls);
+                for (int b = a + 1; b < n; b++) close(acc[b]);   // later ones belong to siblings
+                handle_client(cs);
+                _exit(0);
+            } else {
+                // parent: keep accepting others
+                close(cs);
+            }
         }
     }
 }
@@ -1,9 +1,29 @@
 // server.cpp — Exercise 6
-
+//
+// Build: g++ -Wall -Wextra -O2 server.cpp ../common/pool.c ../common/metrics.c
+//            ../common/udpecho.c ../common/listen.c ../common/flightrec.c -o server
+//        (add ../common/alloc_count.c to log malloc/free counts per connection)
+// Run:   ./server [-H] [-m port] [-A accept_opts] [-l unix:PATH | -l seqpacket:PATH ...]
+//                 [-u workers [-G]] [-F flight_opts]
+//        -H = back the connection/buffer pools with huge pages
+//        -m = serve Prometheus metrics on 127.0.0.1:port/metrics
+//        -A = TCP accept tuning, e.g. backlog=4096,defer=5,shards=4 (see ../common/listen.h);
+//             steer=1 pins shard k to the k-th CPU, takes that CPU's connections
+//             (SO_INCOMING_CPU) and moves each child to its connection's CPU,
+//             with pool pages kept on the local NUMA node
+//        -l = also accept local clients on an AF_UNIX socket (repeatable)
+//        -u = batched UDP echo (recvmmsg/sendmmsg) instead of TCP, see ../Ex5
+//        -G = with -u, use UDP GRO/GSO segmentation offload
+//        -F = flight recorder tuning, e.g. slots=65536,slow=50,gap=10,dir=/tmp: the
+//             last `slots` events go to dir/flight-<pid>-<n>.bin on kill -USR2, or
+//             when a request takes over `slow` ms (../common/flightrec.h,
+//             ../bench/flightdump decodes)
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <csignal>
 #include <ctime>
@@ -13,7 +33,34 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 
+#include "../common/pool.h"
+#include "../common/alloc_count.h"
+#include "../common/metrics.h"
+#include "../common/udpecho.h"
+#include "../common/listen.h"
+#include "../common/flightrec.h"
+
 #define PORT 8080
+#define MAX_MSG 1024
+
+static const char ECHO_PREFIX[] = "Echo: ";
+static const size_t ECHO_PREFIX_LEN = sizeof(ECHO_PREFIX) - 1;
+
+// Per-connection state.  The parent takes one from the slab on accept() and
+// returns it after fork(); the child works on its copy-on-write image.
+struct conn_t {
+    int fd;
+    sockaddr_in peer;
+    char *buf;          // "Echo: " + payload; recv() writes right after the prefix
+    size_t buf_cap;
+    uint64_t msgs;
+};
+
+static slab_t g_conns;
+static bufpool_t g_bufs;
+
+// Counted in the forked children too (shared memory); -m serves them.
+static metric_t *m_conns, *m_active, *m_msgs, *m_bytes_in, *m_bytes_out, *m_send_err, *m_req, *m_cross_cpu;
 
 // --- Logging helpers ---------------------------------------------------------
 
@@ -42,130 +89,251 @@ static void log_errno(const std::string& where, const std::string& context) {
 
 // --- Client handling ---------------------------------------------------------
 
-static void handle_client(int client_sock) {
+static void handle_client(conn_t* c) {
     // Child process: interact with the client; robust to short reads/writes.
-    char buf[1024];
+    // The only buffer comes from the pool and holds the reply prefix, so each
+    // echo is recv() straight into place + send() — no per-message heap work.
+    c->buf = static_cast<char*>(bufpool_get(&g_bufs, ECHO_PREFIX_LEN + MAX_MSG, &c->buf_cap));
+    if (!c->buf) {
+        log_errno("handle_client/bufpool_get", "buffer pool exhausted");
+        close(c->fd);
+        return;
+    }
+    std::memcpy(c->buf, ECHO_PREFIX, ECHO_PREFIX_LEN);
+    char* payload = c->buf + ECHO_PREFIX_LEN;
+
+    alloc_counts_t warm{}, done{};
 
     for (;;) {
-        ssize_t n = recv(client_sock, buf, sizeof(buf) - 1, 0);
+        ssize_t n = recv(c->fd, payload, MAX_MSG, 0);
         if (n < 0) {
             if (errno == EINTR) continue;                // interrupted — retry
+            flight_rec(FR_CLOSE, FR_WHY_ERROR, c->fd, errno, 0);
             log_errno("handle_client/recv", "recv() failed");
             break;
         }
         if (n == 0) {
             // Client closed connection
+            flight_rec(FR_CLOSE, FR_WHY_EOF, c->fd, 0, 0);
             break;
         }
-        buf[n] = '\0';
-
-        // Build reply (simple echo)
-        std::string reply = std::string("Echo: ") + buf;
+        uint64_t t_recv = mono_ns();
+        flight_rec(FR_RECV, 0, c->fd, (uint32_t)n, 0);
+        metric_inc(m_msgs);
+        metric_add(m_bytes_in, n);
 
         // Try sending all bytes (loop in case of partial sends)
-        const char* p = reply.c_str();
-        size_t to_send = reply.size();
+        const char* p = c->buf;
+        size_t to_send = ECHO_PREFIX_LEN + static_cast<size_t>(n);
         while (to_send > 0) {
-            ssize_t s = send(client_sock, p, to_send, 0);
+            ssize_t s = send(c->fd, p, to_send, 0);
             if (s < 0) {
                 if (errno == EINTR) continue;
+                flight_rec(FR_CLOSE, FR_WHY_SEND, c->fd, errno, 0);
                 if (errno == EPIPE) {
                     // Client vanished; log and stop.
                     log_errno("handle_client/send", "EPIPE: client closed");
+                    metric_inc(m_send_err);
                     to_send = 0; // will break outer loop below
                     break;
                 }
                 log_errno("handle_client/send", "send() failed");
+                metric_inc(m_send_err);
                 to_send = 0;
                 break;
             }
+            if (static_cast<size_t>(s) < to_send) flight_rec(FR_SEND_PARTIAL, 0, c->fd, (uint32_t)s, (uint32_t)to_send);
             p += s;
             to_send -= static_cast<size_t>(s);
+            metric_add(m_bytes_out, s);
         }
+        uint64_t took = mono_ns() - t_recv;
+        metric_observe(m_req, took);
+        flight_slow(FR_OP_REQUEST, c->fd, took);
+
+        // First message warms up libc/stdio; count from here on.
+        if (++c->msgs == 1 && alloc_count_read) alloc_count_read(&warm);
+    }
+
+    if (alloc_count_read && c->msgs > 1) {
+        alloc_count_read(&done);
+        std::printf("[pid %d] %llu msgs, steady state: %llu mallocs, %llu frees\n",
+                    (int)getpid(), (unsigned long long)(c->msgs - 1),
+                    (unsigned long long)(done.mallocs - warm.mallocs),
+                    (unsigned long long)(done.frees - warm.frees));
+        std::fflush(stdout);
     }
 
-    close(client_sock);
+    bufpool_put(&g_bufs, c->buf, c->buf_cap);
+    metric_dec(m_active);
+    close(c->fd);
 }
 
-int main() {
-    // 1) Hardening signals:
-    //    - Ignore SIGPIPE so accidental writes to closed sockets don't kill us
-    //    - Ignore/reap children to prevent zombies
-    signal(SIGPIPE, SIG_IGN);
-    signal(SIGCHLD, SIG_IGN);
+int main(int argc, char** argv) {
+    int pool_flags = 0, metrics_port = 0, udp_workers = 0, offload = 0;
+    const char *flight_opts = nullptr;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    for (int ch; (ch = getopt(argc, argv, "Hm:u:Gl:A:F:")) != -1; ) {
+        if (ch == 'H') pool_flags |= POOL_HUGEPAGES;
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else if (ch == 'm') metrics_port = std::atoi(optarg);
+        else if (ch == 'u') udp_workers = std::atoi(optarg);
+        else if (ch == 'G') offload = 1;
+        else if (ch == 'F') flight_opts = optarg;
+        else {
+            std::cerr << "usage: " << argv[0] << " [-H] [-m metrics_port] [-A backlog=N,defer=S,fastopen=Q,shards=N,steer=0|1]"
+                      << " [-l unix:PATH | -l seqpacket:PATH ...] [-u workers [-G]]"
+                      << " [-F slots=N,slow=MS,gap=S,dir=PATH]\n";
+            return 2;
+        }
+    }
 
-    // 2) Create socket
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) {
-        log_errno("main/socket", "socket() failed");
-        std::perror("socket");
+    // Metrics are registered before any fork so children share them.
+    metrics_init();
+    m_conns     = metric_counter("server_connections_total", nullptr, "Accepted connections");
+    m_active    = metric_gauge("server_connections_active", nullptr, "Open connections");
+    m_msgs      = metric_counter("server_messages_total", nullptr, "Messages echoed");
+    m_bytes_in  = metric_counter("server_bytes_in_total", nullptr, "Bytes received");
+    m_bytes_out = metric_counter("server_bytes_out_total", nullptr, "Bytes sent");
+    m_send_err  = metric_counter("server_dropped_total", nullptr, "Replies lost to send() errors");
+    m_req       = metric_histogram("server_request_seconds", nullptr, "recv() to reply fully sent");
+    m_cross_cpu = metric_counter("server_cross_cpu_connections_total", nullptr,
+                                 "Connections handled on another CPU than the one processing their packets");
+    // Flight recorder: shared like the metrics, so every child writes into it.
+    if (flight_init(flight_opts) < 0) {
+        log_errno("main/flight_init", "flight recorder setup failed");
+        std::perror("flight recorder (-F)");
         return 1;
     }
-
-    // 3) Reuse address for quick restarts
-    int opt = 1;
-    if (setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        log_errno("main/setsockopt", "SO_REUSEADDR failed");
-        // Non-fatal; continue.
+    if (metrics_port && metrics_serve(metrics_port) < 0) {
+        log_errno("main/metrics_serve", "metrics endpoint failed");
+        std::perror("metrics endpoint");
+        return 1;
     }
 
-    // 4) Bind
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
-    if (bind(server_sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        log_errno("main/bind", "bind() failed (is another server running on this port?)");
-        std::perror("bind");
-        close(server_sock);
+    // UDP mode needs neither the pools nor a listener.
+    if (udp_workers > 0) {
+        udp_echo_cfg_t cfg = { PORT, udp_workers, offload, m_msgs, m_bytes_in, m_bytes_out };
+        std::cout << "C++ server: UDP echo on " << PORT << " (" << udp_workers << " workers) …" << std::endl;
+        udp_echo_run(&cfg);
+        log_errno("main/udp_echo", "UDP socket setup failed");
+        std::perror("udp echo");
         return 1;
     }
 
-    // 5) Listen
-    if (listen(server_sock, 16) < 0) {
-        log_errno("main/listen", "listen() failed");
+    // 0) Pools: map them up front so the accept path never reaches mmap()
+    if (lo.steer) pool_flags |= POOL_LOCAL;
+    slab_init(&g_conns, sizeof(conn_t), 0, pool_flags);
+    bufpool_init(&g_bufs, pool_flags);
+    if (slab_reserve(&g_conns, 64) < 0) log_errno("main/slab_reserve", "mmap() failed");
+
+    // 1) Hardening signals:
+    //    - Ignore SIGPIPE so accidental writes to closed sockets don't kill us
+    //    - Ignore/reap children to prevent zombies
+    //    - SIGUSR2 dumps the flight recorder
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGUSR2, flight_on_signal);
+
+    // 2) Acceptor shards (-A shards=N), each with its own SO_REUSEPORT socket;
+    //    with steer=1 each on its own CPU (children inherit it until they follow
+    //    their connection)
+    int shard = listen_shard(&lo);
+    int shard_cpu = lo.steer && lo.shards > 1 ? listen_cpu(shard) : -1;
+    if (shard_cpu >= 0 && listen_pin(shard_cpu) < 0) {
+        log_errno("main/listen_pin", "cannot pin shard " + std::to_string(shard));
+        shard_cpu = -1;
+    }
+
+    // 3) Socket, SO_REUSEADDR, bind, listen with the -A backlog/defer/fastopen
+    int server_sock = listen_tcp(PORT, &lo);
+    if (server_sock < 0) {
+        log_errno("main/listen", "listen_tcp() failed (is another server running on this port?)");
         std::perror("listen");
-        close(server_sock);
         return 1;
     }
+    if (shard_cpu >= 0 && listen_steer(server_sock, shard_cpu) < 0)
+        log_errno("main/listen_steer", "SO_INCOMING_CPU not supported");
 
-    std::cout << "C++ server (robust) listening on " << PORT << " …\n";
+    if (shard == 0)
+        std::cout << "C++ server (robust) listening on " << PORT << " (backlog " << lo.backlog
+                  << ", " << lo.shards << " shard(s)) …\n";
 
-    // 6) Accept loop: keep going on errors; never crash parent
-    for (;;) {
-        sockaddr_in client_addr{};
-        socklen_t alen = sizeof(client_addr);
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, server_sock);
+    for (int k = 0; k < nlocal && shard == 0; k++) {
+        if (listen_set_add_spec(&ls, local[k], lo.backlog) < 0) {
+            log_errno("main/listen_local", std::string("cannot listen on ") + local[k]);
+            std::perror(local[k]);
+            return 1;
+        }
+        std::cout << "Also listening on " << local[k] << "\n";
+    }
 
-        int client_sock = accept(server_sock, (sockaddr*)&client_addr, &alen);
-        if (client_sock < 0) {
+    // 4) Accept loop: drain every ready listener per wake-up; never crash parent
+    for (;;) {
+        int acc[ACCEPT_BATCH];
+        int n = listen_set_accept_batch(&ls, acc, ACCEPT_BATCH, SOCK_CLOEXEC);
+        if (n < 0) {
             if (errno == EINTR) continue;       // interrupted by signal; retry
             log_errno("main/accept", "accept() failed");
             // Continue accepting new connections even after errors
             continue;
         }
 
-        pid_t pid = fork();
-        if (pid < 0) {
-            log_errno("main/fork", "fork() failed");
-            std::perror("fork");
-            close(client_sock);
-            continue;
-        }
+        for (int a = 0; a < n; a++) {
+            int client_sock = acc[a];
+            conn_t* c = static_cast<conn_t*>(slab_alloc(&g_conns));
+            if (!c) {
+                log_errno("main/slab_alloc", "connection slab exhausted");
+                close(client_sock);
+                continue;
+            }
+            metric_inc(m_conns);
+            metric_inc(m_active);
+            socklen_t alen = sizeof(c->peer);
+            if (getpeername(client_sock, (sockaddr*)&c->peer, &alen) < 0) c->peer = sockaddr_in{};
+            c->fd = client_sock;
+            c->buf = nullptr;
+            c->buf_cap = 0;
+            c->msgs = 0;
+            flight_rec(FR_ACCEPT, 0, client_sock, client_sock, 0);
 
-        if (pid == 0) {
-            // Child process
-            close(server_sock);                 // child does not accept()
-            try {
-                handle_client(client_sock);
-            } catch (const std::exception& ex) {
-                log_error("child/exception", std::string("std::exception: ") + ex.what());
-            } catch (...) {
-                log_error("child/exception", "Unknown exception");
+            pid_t pid = fork();
+            if (pid < 0) {
+                log_errno("main/fork", "fork() failed");
+                std::perror("fork");
+                slab_free(&g_conns, c);
+                metric_dec(m_active);
+                close(client_sock);
+                continue;
+            }
+
+            if (pid == 0) {
+                // Child process
+                flight_forked();
+                listen_set_close(&ls);              // child does not accept()
+                if (lo.steer) listen_follow(client_sock);
+                if (listen_cross_cpu(client_sock)) metric_inc(m_cross_cpu);
+                for (int b = a + 1; b < n; b++) close(acc[b]);
+                try {
+                    handle_client(c);
+                } catch (const std::exception& ex) {
+                    log_error("child/exception", std::string("std::exception: ") + ex.what());
+                } catch (...) {
+                    log_error("child/exception", "Unknown exception");
+                }
+                _exit(0);
+            } else {
+                // Parent process: keep listening; child owns client_sock
+                slab_free(&g_conns, c);
+                close(client_sock);
             }
-            _exit(0);
-        } else {
-            // Parent process: keep listening; child owns client_sock
-            close(client_sock);
         }
     }
 
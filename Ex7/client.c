@@ -1,27 +1,100 @@
 // client.c — interactive chat client (Exercise 7 uses same client)
+//
+// Build: gcc -Wall -Wextra -O2 client.c ../common/listen.c ../common/zdict.c
+//            ../common/scan.c ../common/netio.c -lz -o client
+// Run:   ./client [-z [-Z dict]] [unix:PATH | seqpacket:PATH]   (default: TCP 127.0.0.1:8080)
+//        -z asks Ex8 to compress what it sends us (-Z: the dictionary file the
+//           server was started with; ../common/zdict.h)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+
+#include "../common/listen.h"
+#include "../common/zdict.h"
+#include "../common/netio.h"
 #include <sys/select.h>
 
 #define PORT 8080
 
-static void trim(char *s){ size_t n=strlen(s); while(n && (s[n-1]=='\n'||s[n-1]=='\r')) s[--n]='\0'; }
+// -z: lines until the server's ack, frames after it.
+static struct {
+    int         on, framed;
+    zdict_t     dict;
+    zdict_dec_t dec;
+    char        ack[64];
+    char        in[1 << 16];
+    size_t      have;
+} z;
+
+// Print what arrived in z.in; keep an incomplete line or frame for later.
+// Returns -1 if the stream is corrupt.
+static int z_show(void) {
+    static char out[ZDICT_FRAME_MAX];
+    size_t off = 0;
+    while (off < z.have) {
+        if (z.framed) {
+            size_t used;
+            ssize_t n = zdict_unframe(&z.dec, z.in + off, z.have - off, &used, out, sizeof(out));
+            if (n < 0) return -1;
+            if (n == 0) break;
+            fwrite(out, 1, (size_t)n, stdout);
+            off += used;
+            continue;
+        }
+        char *nl = memchr(z.in + off, '\n', z.have - off);
+        if (!nl) break;
+        size_t len = (size_t)(nl + 1 - (z.in + off));
+        if (len == strlen(z.ack) && !memcmp(z.in + off, z.ack, len)) z.framed = 1;
+        else fwrite(z.in + off, 1, len, stdout);
+        off += len;
+    }
+    memmove(z.in, z.in + off, z.have - off);
+    z.have -= off;
+    if (z.have == sizeof(z.in)) return -1;          // a frame bigger than we can hold
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dict_path = NULL;
+    for (int ch; (ch = getopt(argc, argv, "zZ:")) != -1; ) {
+        if (ch == 'z') z.on = 1;
+        else if (ch == 'Z') dict_path = optarg;
+        else { fprintf(stderr, "usage: %s [-z [-Z dict]] [unix:PATH | seqpacket:PATH]\n", argv[0]); return 2; }
+    }
+    if (z.on) {
+        if (!dict_path) zdict_default(&z.dict);
+        else if (zdict_load(&z.dict, dict_path) < 0) { perror(dict_path); return 1; }
+        if (zdict_dec_init(&z.dec, &z.dict) < 0) { perror("zlib"); return 1; }
+        snprintf(z.ack, sizeof(z.ack), ZDICT_ACK "%u\n", z.dict.id);
+    }
 
-int main(void) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { perror("socket"); return 1; }
+    int sock;
+    if (optind < argc) {                  // unix:PATH or seqpacket:PATH on this host
+        sock = local_connect(argv[optind]);
+        if (sock < 0) { perror(argv[optind]); return 1; }
+    } else {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) { perror("socket"); return 1; }
 
-    struct sockaddr_in sa = {0};
-    sa.sin_family = AF_INET; sa.sin_port = htons(PORT);
-    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+        struct sockaddr_in sa = {0};
+        sa.sin_family = AF_INET; sa.sin_port = htons(PORT);
+        inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
 
-    if (connect(sock, (struct sockaddr*)&sa, sizeof(sa)) < 0) { perror("connect"); return 1; }
+        if (connect(sock, (struct sockaddr*)&sa, sizeof(sa)) < 0) { perror("connect"); return 1; }
+    }
 
     printf("Connected. Type messages; 'exit' to quit.\n");
+    if (z.on) {
+        // No '\n', like everything else this client sends.
+        char req[64];
+        int n = snprintf(req, sizeof(req), "/compress deflate %u", z.dict.id);
+        send(sock, req, (size_t)n, 0);
+    }
 
     // Use select() to read from both stdin and socket so we can display broadcasts
     for (;;) {
@@ -37,7 +110,12 @@ int main(void) {
         }
 
         // Incoming broadcast from server?
-        if (FD_ISSET(sock, &rfds)) {
+        if (FD_ISSET(sock, &rfds) && z.on) {
+            ssize_t n = recv(sock, z.in + z.have, sizeof(z.in) - z.have, 0);
+            if (n <= 0) { puts("Disconnected."); break; }
+            z.have += (size_t)n;
+            if (z_show() < 0) { puts("Corrupt compressed stream."); break; }
+        } else if (FD_ISSET(sock, &rfds)) {
             char buf[1200];
             ssize_t n = recv(sock, buf, sizeof(buf)-1, 0);
             if (n <= 0) { puts("Disconnected."); break; }
@@ -51,7 +129,7 @@ int main(void) {
             if (!fgets(line, sizeof(line), stdin)) { // EOF
                 break;
             }
-            trim(line);
+            trim_eol(line);
             if (line[0] == '\0') continue;
             if (!strcmp(line, "exit")) {
                 send(sock, line, strlen(line), 0);
@@ -6,8 +6,19 @@
 //   - Parent select()s on all child-pipe read-ends; when data arrives,
 //     it broadcasts to every other client socket.
 //
-// Build: gcc -Wall -Wextra -O2 server.c -o server
-// Run:   ./server  (then run multiple ./client)
+// Build: gcc -Wall -Wextra -O2 server.c ../common/scan.c ../common/metrics.c
+//            ../common/listen.c ../common/presence.c ../common/overload.c ../common/netio.c -o server
+// Run:   ./server [-m metrics_port] [-A accept_opts] [-P presence_opts] [-O overload_opts]
+//                 [-l unix:PATH | -l seqpacket:PATH ...]
+//        -A = TCP listener tuning, backlog=N,defer=S,fastopen=Q (../common/listen.h);
+//             no shards: one parent has to own every client to broadcast
+//        -P = join/leave coalescing, window=MS,max=N (../common/presence.h);
+//             window=0 announces each one immediately
+//        -O = load shedding, target=MS,window=MS,resume=PCT,hold=MS,rate=N
+//             (../common/overload.h): past the loop-lag / queue-delay target,
+//             new clients are told "Server busy" and each pipe is read at a
+//             reduced rate; -O off never sheds
+//        (then run multiple ./client, or ./client unix:PATH on the same host)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,74 +32,89 @@
 #include <sys/select.h>
 #include <netinet/in.h>
 
+#include "../common/scan.h"
+#include "../common/latency.h"
+#include "../common/metrics.h"
+#include "../common/listen.h"
+#include "../common/presence.h"
+#include "../common/overload.h"
+#include "../common/netio.h"
+
 #define PORT 8080
 #define MAX_CLIENTS  FD_SETSIZE       // keep it simple; plenty for this lab
 #define MAX_MSG      1024
+#define RECV_BUF     65536            // child's receive buffer (pipelined lines)
+#define MAX_LINES    64               // spans per scan_lines() call
 
 // Header sent from child -> parent before each message payload
 typedef struct {
     int sender_fd;   // child's client socket fd (as seen in parent too)
     int len;         // payload length in bytes (no NUL)
+    uint64_t t_recv; // CLOCK_MONOTONIC when the child read it (0 with -O off)
 } msg_hdr_t;
 
-static void trim(char *s){
-    size_t n = strlen(s);
-    while (n && (s[n-1]=='\n' || s[n-1]=='\r')) s[--n] = '\0';
+// Counted in the children too (shared memory); -m serves them.
+static metric_t *m_conns, *m_active, *m_rejected, *m_msgs, *m_bytes_in, *m_bytes_out;
+static metric_t *m_deliveries, *m_drop_send, *m_drop_frame, *m_ready, *m_busy, *m_throttled;
+static overload_t g_ovl;              // -O
+
+// send() to one client, accounting for what got through.
+static void send_counted(int fd, const char *buf, size_t n) {
+    ssize_t w = send(fd, buf, n, 0);
+    if (w > 0) metric_add(m_bytes_out, w);
+    if (w == (ssize_t)n) metric_inc(m_deliveries);
+    else metric_inc(m_drop_send);
 }
 
-static ssize_t read_full(int fd, void *buf, size_t n) {
-    size_t off = 0;
-    while (off < n) {
-        ssize_t r = read(fd, (char*)buf + off, n - off);
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        if (r == 0) return (ssize_t)off; // EOF
-        off += (size_t)r;
-    }
-    return (ssize_t)off;
-}
+// Child: read from client socket -> send to parent via pipe
 
-static ssize_t write_full(int fd, const void *buf, size_t n) {
-    size_t off = 0;
-    while (off < n) {
-        ssize_t w = write(fd, (const char*)buf + off, n - off);
-        if (w < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        off += (size_t)w;
+// Forward one line (split if longer than a message).
+// Returns 1 on "exit", -1 if the pipe is gone, else 0.
+static int forward_line(int client_fd, int pipe_write_fd, const char *p, size_t len, uint64_t t_recv) {
+    if (len == 4 && !memcmp(p, "exit", 4)) return 1;
+    while (len > 0) {
+        size_t chunk = len < MAX_MSG-1 ? len : MAX_MSG-1;
+        // build header + payload for parent
+        msg_hdr_t hdr;
+        hdr.sender_fd = client_fd;
+        hdr.len = (int)chunk;
+        hdr.t_recv = t_recv;
+
+        if (write_full(pipe_write_fd, &hdr, sizeof(hdr)) < 0) return -1;
+        if (write_full(pipe_write_fd, p, chunk) < 0) return -1;
+        p += chunk; len -= chunk;
     }
-    return (ssize_t)off;
+    return 0;
 }
 
-// Child: read from client socket -> send to parent via pipe
 static void child_loop(int client_fd, int pipe_write_fd) {
-    char buf[MAX_MSG];
+    char buf[RECV_BUF];
+    span_t lines[MAX_LINES], tail;
+    linebuf_t lb;
+    linebuf_init(&lb, buf, sizeof(buf));
 
     // Greet
     const char *g = "Welcome! Type messages; 'exit' to quit.\n";
     (void)send(client_fd, g, strlen(g), 0);
 
     for (;;) {
-        ssize_t n = recv(client_fd, buf, sizeof(buf)-1, 0);
+        ssize_t n = linebuf_fill(&lb, client_fd, 0);
         if (n <= 0) break; // client closed or error
-        buf[n] = '\0';
-        trim(buf);
-        if (buf[0] == '\0') continue;
-
-        if (strcmp(buf, "exit") == 0) {
-            break;
-        }
-
-        // build header + payload for parent
-        msg_hdr_t hdr;
-        hdr.sender_fd = client_fd;
-        hdr.len = (int)strlen(buf);
-
-        if (write_full(pipe_write_fd, &hdr, sizeof(hdr)) < 0) break;
-        if (write_full(pipe_write_fd, buf, (size_t)hdr.len) < 0) break;
+        metric_add(m_bytes_in, n);
+        uint64_t t_recv = g_ovl.off ? 0 : mono_ns();
+
+        // Split all complete (possibly pipelined) lines in one pass.
+        size_t k;
+        int rc = 0;
+        while (rc == 0 && (k = linebuf_lines(&lb, lines, MAX_LINES)) > 0)
+            for (size_t j = 0; j < k && rc == 0; j++)
+                rc = forward_line(client_fd, pipe_write_fd, lines[j].p, lines[j].len, t_recv);
+
+        // Unterminated tail: one message per recv() for clients that never
+        // send '\n'; otherwise keep it until the line is complete.
+        if (rc == 0 && linebuf_tail(&lb, &tail))
+            rc = forward_line(client_fd, pipe_write_fd, tail.p, tail.len, t_recv);
+        if (rc != 0) break;
     }
 
     close(client_fd);
@@ -96,115 +122,190 @@ static void child_loop(int client_fd, int pipe_write_fd) {
     _exit(0);
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    int metrics_port = 0;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    presence_t pres;
+    presence_init(&pres);
+    overload_init(&g_ovl);
+    for (int ch; (ch = getopt(argc, argv, "m:l:A:P:O:")) != -1; ) {
+        if (ch == 'm') metrics_port = atoi(optarg);
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0 && lo.shards == 1) continue;
+        else if (ch == 'P' && presence_parse(&pres, optarg) == 0) continue;
+        else if (ch == 'O' && overload_parse(&g_ovl, optarg) == 0) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-m metrics_port] [-A backlog=N,defer=S,fastopen=Q] [-P window=MS,max=N] "
+                            "[-O target=MS,window=MS,resume=PCT,hold=MS,rate=N | -O off] "
+                            "[-l unix:PATH | -l seqpacket:PATH ...]\n", argv[0]);
+            exit(2);
+        }
+    }
+    metrics_init();
+    m_conns      = metric_counter("chat_connections_total", NULL, "Accepted client connections");
+    m_active     = metric_gauge("chat_connections_active", NULL, "Currently connected clients");
+    m_rejected   = metric_counter("chat_rejected_total", "reason=\"full\"", "Connections turned away");
+    m_busy       = metric_counter("chat_rejected_total", "reason=\"busy\"", "Connections turned away");
+    m_msgs       = metric_counter("chat_messages_total", NULL, "Inbound chat messages");
+    m_bytes_in   = metric_counter("chat_bytes_in_total", NULL, "Bytes received from clients (children)");
+    m_bytes_out  = metric_counter("chat_bytes_out_total", NULL, "Bytes sent to clients");
+    m_deliveries = metric_counter("chat_deliveries_total", NULL, "Messages handed to a recipient socket");
+    m_drop_send  = metric_counter("chat_dropped_total", "reason=\"send\"", "Messages not delivered");
+    m_drop_frame = metric_counter("chat_dropped_total", "reason=\"frame\"", "Messages not delivered");
+    m_ready      = metric_gauge("chat_ready_queue_depth", NULL, "Ready fds in the last select() pass");
+    pres.events  = metric_counter("chat_presence_events_total", NULL, "Joins and leaves");
+    pres.digests = metric_counter("chat_presence_digests_total", NULL, "Presence windows sent as one digest line");
+    m_throttled  = metric_counter("chat_throttled_reads_total", NULL, "Messages read under the shedding rate limit");
+    g_ovl.lag_hist   = metric_histogram("chat_loop_lag_seconds", NULL, "Broker loop pass duration");
+    g_ovl.delay_hist = metric_histogram("chat_queue_delay_seconds", NULL, "Child recv() to broker pick-up");
+    g_ovl.state      = metric_gauge("chat_overload_shedding", NULL, "1 while shedding load");
+    g_ovl.episodes   = metric_counter("chat_overload_episodes_total", NULL, "Times shedding started");
+    if (metrics_port && metrics_serve(metrics_port) < 0) { perror("metrics endpoint"); exit(1); }
+
     // Reap children automatically; avoid zombies
     signal(SIGCHLD, SIG_IGN);
+    // A client that hangs up (e.g. on "Server busy") must cost us an EPIPE, not our life
+    signal(SIGPIPE, SIG_IGN);
 
     // Listening socket
-    int s = socket(AF_INET, SOCK_STREAM, 0);
-    if (s < 0) { perror("socket"); exit(1); }
-
-    int opt = 1;
-    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
-
-    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(1); }
-    if (listen(s, 16) < 0) { perror("listen"); exit(1); }
+    int s = listen_tcp(PORT, &lo);
+    if (s < 0) { perror("listen"); exit(1); }
 
     printf("Broadcast server listening on %d …\n", PORT);
 
+    listen_set_t ls;
+    listen_set_init(&ls);
+    listen_set_add(&ls, s);
+    for (int k = 0; k < nlocal; k++) {
+        if (listen_set_add_spec(&ls, local[k], lo.backlog) < 0) { perror(local[k]); exit(1); }
+        printf("Also listening on %s\n", local[k]);
+    }
+
     // Parent's book-keeping
     int client_fds[MAX_CLIENTS];   // sockets open in the parent (for broadcasting)
     int pipe_fds[MAX_CLIENTS];     // read-ends of pipes from children
-    pid_t child_pids[MAX_CLIENTS];
+    uint64_t next_read[MAX_CLIENTS];  // shedding: pipe left alone until then
+    uint64_t held[MAX_CLIENTS];       // ... last time it was (what it sent before waited on us)
     int count = 0;
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         client_fds[i] = -1;
         pipe_fds[i] = -1;
-        child_pids[i] = -1;
+        next_read[i] = held[i] = 0;
     }
 
     for (;;) {
         // Build fdset for select()
         fd_set rfds;
         FD_ZERO(&rfds);
-        FD_SET(s, &rfds);
-        int maxfd = s;
+        int maxfd = -1;
+        for (int k = 0; k < ls.n; k++) {
+            FD_SET(ls.fd[k], &rfds);
+            if (ls.fd[k] > maxfd) maxfd = ls.fd[k];
+        }
 
+        uint64_t now = mono_ns(), wake = 0;
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (pipe_fds[i] != -1) {
-                FD_SET(pipe_fds[i], &rfds);
-                if (pipe_fds[i] > maxfd) maxfd = pipe_fds[i];
+            if (pipe_fds[i] == -1) continue;
+            if (next_read[i] > now) {             // over its shedding rate: later
+                if (!wake || next_read[i] < wake) wake = next_read[i];
+                held[i] = now;
+                continue;
             }
+            FD_SET(pipe_fds[i], &rfds);
+            if (pipe_fds[i] > maxfd) maxfd = pipe_fds[i];
         }
 
-        int ready = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+        struct timeval tv, tw;
+        int ready = select(maxfd + 1, &rfds, NULL, NULL,
+                           overload_timeout(presence_timeout(&pres, &tv), wake, now, &tw));
         if (ready < 0) {
             if (errno == EINTR) continue;
             perror("select");
             continue;
         }
-
-        // New connection?
-        if (FD_ISSET(s, &rfds)) {
-            struct sockaddr_in ca; socklen_t alen = sizeof(ca);
-            int cs = accept(s, (struct sockaddr*)&ca, &alen);
-            if (cs < 0) { perror("accept"); continue; }
-
-            // find a slot
-            int slot = -1;
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                if (client_fds[i] == -1) { slot = i; break; }
-            }
-            if (slot == -1) {
-                const char *full = "Server full. Try later.\n";
-                send(cs, full, strlen(full), 0);
-                close(cs);
-            } else {
-                int pfd[2];
-                if (pipe(pfd) < 0) {
-                    perror("pipe");
-                    close(cs);
-                    continue;
+        uint64_t t_pass = mono_ns();
+        int shed = overload_update(&g_ovl, t_pass);
+        metric_set(m_ready, ready);
+
+        // Presence window over?  One send per client covers all of it.
+        char digest[PRESENCE_BUF + 64];
+        size_t dn = presence_flush(&pres, count, 0, digest, sizeof(digest));
+        for (int i = 0; dn && i < MAX_CLIENTS; i++)
+            if (client_fds[i] != -1) send_counted(client_fds[i], digest, dn);
+
+        // New connections?  Drain every ready listener (TCP or local) in one pass.
+        for (int k = 0; k < ls.n; k++) {
+            if (!FD_ISSET(ls.fd[k], &rfds)) continue;
+            int acc[ACCEPT_BATCH];
+            int nacc = listen_drain(ls.fd[k], acc, ACCEPT_BATCH, SOCK_CLOEXEC);
+            if (nacc < 0) { perror("accept"); continue; }
+            for (int a = 0; a < nacc; a++) {
+                int cs = acc[a];
+                // find a slot
+                int slot = -1;
+                for (int i = 0; i < MAX_CLIENTS; i++) {
+                    if (client_fds[i] == -1) { slot = i; break; }
                 }
-
-                pid_t pid = fork();
-                if (pid < 0) {
-                    perror("fork");
+                if (shed) {
+                    const char *busy = "Server busy. Try later.\n";
+                    send(cs, busy, strlen(busy), 0);
                     close(cs);
-                    close(pfd[0]); close(pfd[1]);
-                    continue;
-                }
-                if (pid == 0) {
-                    // child
-                    close(s);
-                    close(pfd[0]); // close read end
-                    // child keeps client socket open
-                    child_loop(cs, pfd[1]); // never returns
+                    metric_inc(m_busy);
+                } else if (slot == -1) {
+                    const char *full = "Server full. Try later.\n";
+                    send(cs, full, strlen(full), 0);
+                    close(cs);
+                    metric_inc(m_rejected);
                 } else {
-                    // parent
-                    count++;
-                    client_fds[slot] = cs;   // keep client's socket for broadcasting
-                    pipe_fds[slot] = pfd[0]; // read-end from this child
-                    child_pids[slot] = pid;
-                    close(pfd[1]);           // parent closes write end
-
-                    char hello[128];
-                    snprintf(hello, sizeof(hello), "You are client #%d. %d user(s) connected.\n",
-                             slot, count);
-                    send(cs, hello, strlen(hello), 0);
-
-                    // Announce to others
-                    char joinmsg[128];
-                    snprintf(joinmsg, sizeof(joinmsg), "Client #%d joined. Active: %d\n", slot, count);
-                    for (int i = 0; i < MAX_CLIENTS; i++) {
-                        if (client_fds[i] != -1 && i != slot) {
-                            send(client_fds[i], joinmsg, strlen(joinmsg), 0);
+                    int pfd[2];
+                    if (pipe(pfd) < 0) {
+                        perror("pipe");
+                        close(cs);
+                        continue;
+                    }
+
+                    pid_t pid = fork();
+                    if (pid < 0) {
+                        perror("fork");
+                        close(cs);
+                        close(pfd[0]); close(pfd[1]);
+                        continue;
+                    }
+                    if (pid == 0) {
+                        // child
+                        listen_set_close(&ls);
+                        for (int b = a + 1; b < nacc; b++) close(acc[b]);   // not ours
+                        close(pfd[0]); // close read end
+                        // child keeps client socket open
+                        child_loop(cs, pfd[1]); // never returns
+                    } else {
+                        // parent
+                        count++;
+                        metric_inc(m_conns);
+                        metric_inc(m_active);
+                        client_fds[slot] = cs;   // keep client's socket for broadcasting
+                        pipe_fds[slot] = pfd[0]; // read-end from this child
+                        next_read[slot] = held[slot] = 0;
+                        close(pfd[1]);           // parent closes write end
+
+                        char hello[128];
+                        snprintf(hello, sizeof(hello), "You are client #%d. %d user(s) connected.\n",
+                                 slot, count);
+                        send(cs, hello, strlen(hello), 0);
+
+                        // Announce to others (or hold it for the next presence flush)
+                        char joinmsg[128];
+                        int jn = snprintf(joinmsg, sizeof(joinmsg), "Client #%d joined. Active: %d\n", slot, count);
+                        if (presence_note(&pres, 1, joinmsg, (size_t)jn)) {
+                            for (int i = 0; i < MAX_CLIENTS; i++) {
+                                if (client_fds[i] != -1 && i != slot) {
+                                    send_counted(client_fds[i], joinmsg, strlen(joinmsg));
+                                }
+                            }
                         }
                     }
                 }
@@ -225,10 +326,13 @@ int main(void) {
                     close(client_fds[i]);
                     client_fds[i] = -1;
                     count--;
+                    metric_dec(m_active);
                     char leave[128];
-                    snprintf(leave, sizeof(leave), "Client #%d left. Active: %d\n", i, count);
-                    for (int k = 0; k < MAX_CLIENTS; k++) {
-                        if (client_fds[k] != -1) send(client_fds[k], leave, strlen(leave), 0);
+                    int ln = snprintf(leave, sizeof(leave), "Client #%d left. Active: %d\n", i, count);
+                    if (presence_note(&pres, 0, leave, (size_t)ln)) {
+                        for (int k = 0; k < MAX_CLIENTS; k++) {
+                            if (client_fds[k] != -1) send_counted(client_fds[k], leave, strlen(leave));
+                        }
                     }
                 }
                 close(rfd);
@@ -244,6 +348,7 @@ int main(void) {
 
             if (hdr.len <= 0 || hdr.len > MAX_MSG-1) {
                 // bad length; drain/ignore
+                metric_inc(m_drop_frame);
                 continue;
             }
 
@@ -251,16 +356,22 @@ int main(void) {
             ssize_t m = read_full(rfd, msg, (size_t)hdr.len);
             if (m != hdr.len) continue;
             msg[hdr.len] = '\0';
+            metric_inc(m_msgs);
+            // Waiting out this client's own shedding rate is not broker lag.
+            if (hdr.t_recv > held[i]) overload_delay(&g_ovl, mono_ns() - hdr.t_recv);
+            next_read[i] = overload_next_read(&g_ovl, t_pass);
+            if (next_read[i]) metric_inc(m_throttled);
 
             // Broadcast to everyone except the sender
             char out[MAX_MSG + 64];
             int n = snprintf(out, sizeof(out), "Client #%d: %s\n", i, msg);
             for (int k = 0; k < MAX_CLIENTS; k++) {
                 if (client_fds[k] != -1 && client_fds[k] != hdr.sender_fd) {
-                    (void)send(client_fds[k], out, (size_t)n, 0);
+                    send_counted(client_fds[k], out, (size_t)n);
                 }
             }
         }
+        overload_lag(&g_ovl, mono_ns() - t_pass);
     }
     return 0;
 }
@@ -0,0 +1,238 @@
+// broker.c — Ex8's routing core (see broker.h)
+#include "broker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/latency.h"
+#include "../common/probes.h"
+#include "../common/flightrec.h"
+#include "../common/netio.h"
+
+// A reply to one client.
+static void send_to(broker_t *b, int i, const char *buf, size_t n) {
+    b->tp.send(b->tp.ctx, i, BROKER_LANE_CONTROL, buf, n);
+}
+
+// Send to every live client except `skip` (-1 = nobody skipped).
+// Returns the number of recipients.
+static int broadcast(broker_t *b, int lane, const char *buf, size_t n, int skip) {
+    int sent = 0;
+    for (int k = 0; k < b->max_clients; ++k)
+        if (b->live[k] && k != skip) { b->tp.send(b->tp.ctx, k, lane, buf, n); sent++; }
+    return sent;
+}
+
+// Join/leave notice: now, or with the rest of this presence window.
+static void announce(broker_t *b, int joined, const char *buf, size_t n) {
+    if (!b->presence || presence_note(b->presence, joined, buf, n)) broadcast(b, BROKER_LANE_CONTROL, buf, n, -1);
+}
+
+void broker_flush_presence(broker_t *b, int force) {
+    static char out[PRESENCE_BUF + 64];
+    if (!b->presence) return;
+    size_t n = presence_flush(b->presence, b->active, force, out, sizeof(out));
+    if (n) broadcast(b, BROKER_LANE_CONTROL, out, n, -1);
+}
+
+// --- Command registry --------------------------------------------------------
+//
+// Every command is listed once in COMMANDS[].  At startup we pick a hash seed
+// that maps each command word to its own slot (a perfect hash, gperf-style),
+// so resolving "/word" costs one hash + one memcmp no matter how many
+// commands exist.  Chat lines never get that far: anything not starting with
+// '/' is decided on its first byte.
+
+typedef void (*cmd_fn)(broker_t *b, int idx, const char *arg);
+
+typedef struct {
+    const char *name;     // without the leading '/'
+    cmd_fn      fn;
+    const char *usage;    // shown by /help
+} command_t;
+
+static void cmd_nick(broker_t *b, int i, const char *arg);
+static void cmd_who(broker_t *b, int i, const char *arg);
+static void cmd_quit(broker_t *b, int i, const char *arg);
+static void cmd_help(broker_t *b, int i, const char *arg);
+
+static const command_t COMMANDS[] = {
+    { "nick", cmd_nick, "/nick <name>  change your nickname" },
+    { "who",  cmd_who,  "/who          list connected users" },
+    { "quit", cmd_quit, "/quit         leave (same as 'exit')" },
+    { "help", cmd_help, "/help         show this list" },
+};
+#define NUM_COMMANDS (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+#define CMD_SLOTS 64                      // power of two, > NUM_COMMANDS
+static const command_t *cmd_table[CMD_SLOTS];
+static unsigned cmd_seed;
+static int cmd_built;
+
+// FNV-1a over every byte of the word, started from the seed: words that
+// share their length and first and last letters ("mute", "mode") still land
+// apart for some seed.
+static unsigned cmd_hash(const char *w, size_t len, unsigned seed) {
+    uint32_t h = (2166136261u ^ seed) * 16777619u;
+    for (size_t k = 0; k < len; ++k) h = (h ^ (unsigned char)w[k]) * 16777619u;
+    return (h ^ (h >> 15)) & (CMD_SLOTS - 1);
+}
+
+static void build_command_table(void) {
+    for (unsigned seed = 0; seed < 4096; ++seed) {
+        memset(cmd_table, 0, sizeof(cmd_table));
+        size_t k = 0;
+        for (; k < NUM_COMMANDS; ++k) {
+            const char *w = COMMANDS[k].name;
+            unsigned h = cmd_hash(w, strlen(w), seed);
+            if (cmd_table[h]) break;          // collision: try the next seed
+            cmd_table[h] = &COMMANDS[k];
+        }
+        if (k == NUM_COMMANDS) { cmd_seed = seed; cmd_built = 1; return; }
+    }
+    fprintf(stderr, "command table: no collision-free seed; raise CMD_SLOTS\n");
+    exit(1);
+}
+
+static const command_t *find_command(const char *w, size_t len) {
+    if (len == 0) return NULL;
+    const command_t *c = cmd_table[cmd_hash(w, len, cmd_seed)];
+    if (c && strlen(c->name) == len && !memcmp(c->name, w, len)) return c;
+    return NULL;
+}
+
+static void cmd_nick(broker_t *b, int i, const char *arg) {
+    char tmp[BROKER_NICK_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", arg);
+    trim_eol(tmp);
+    if (tmp[0] == '\0') {
+        const char *err = "Usage: /nick <name>\n";
+        send_to(b, i, err, strlen(err));
+        return;
+    }
+    char old[BROKER_NICK_MAX];
+    memcpy(old, b->nick[i], BROKER_NICK_MAX);
+    memcpy(b->nick[i], tmp, BROKER_NICK_MAX);
+    if (b->tp.renamed) b->tp.renamed(b->tp.ctx, i, b->nick[i]);
+
+    char note[160];
+    int n = snprintf(note, sizeof(note), "%s is now known as %s\n", old, b->nick[i]);
+    broadcast(b, BROKER_LANE_CONTROL, note, (size_t)n, -1);
+}
+
+// "Users (N):\n - nick\n..." for the live slots, in order.
+static size_t format_who(const broker_t *b, char *out, size_t cap) {
+    int count = 0;
+    for (int k = 0; k < b->max_clients; ++k) count += b->live[k];
+    size_t len = (size_t)snprintf(out, cap, "Users (%d):\n", count);
+    for (int k = 0; k < b->max_clients && len < cap; ++k)
+        if (b->live[k]) len += (size_t)snprintf(out + len, cap - len, " - %.*s\n", BROKER_NICK_MAX - 1, b->nick[k]);
+    return len < cap ? len : cap - 1;
+}
+
+static void cmd_who(broker_t *b, int i, const char *arg) {
+    (void)arg;
+    send_to(b, i, b->scratch, format_who(b, b->scratch, b->scratch_len));
+}
+
+static void cmd_quit(broker_t *b, int i, const char *arg) {
+    (void)arg;
+    // Child will also exit; we'll catch EOF on pipe next loop
+    // Send a small ack so client returns cleanly
+    const char *bye = "Goodbye.\n";
+    send_to(b, i, bye, strlen(bye));
+}
+
+static void cmd_help(broker_t *b, int i, const char *arg) {
+    (void)arg;
+    char line[160];
+    for (size_t k = 0; k < NUM_COMMANDS; ++k) {
+        int n = snprintf(line, sizeof(line), "%s\n", COMMANDS[k].usage);
+        send_to(b, i, line, (size_t)n);
+    }
+}
+
+// --- Public API ------------------------------------------------------------------
+
+int broker_init(broker_t *b, int max_clients, const broker_transport_t *tp) {
+    memset(b, 0, sizeof(*b));
+    b->tp = *tp;
+    b->max_clients = max_clients;
+    b->live = (unsigned char*)calloc((size_t)max_clients, 1);
+    b->nick = (char (*)[BROKER_NICK_MAX])calloc((size_t)max_clients, BROKER_NICK_MAX);
+    b->scratch_len = (size_t)max_clients * (BROKER_NICK_MAX + 4) + 32;   // a full /who
+    b->scratch = (char*)malloc(b->scratch_len);
+    if (!b->live || !b->nick || !b->scratch) { broker_free(b); return -1; }
+    for (int i = 0; i < max_clients; ++i) snprintf(b->nick[i], BROKER_NICK_MAX, "user%d", i);
+    if (!cmd_built) build_command_table();
+    return 0;
+}
+
+void broker_free(broker_t *b) {
+    free(b->live);
+    free(b->nick);
+    free(b->scratch);
+    b->live = NULL; b->nick = NULL; b->scratch = NULL;
+}
+
+void broker_join(broker_t *b, int idx) {
+    b->live[idx] = 1;
+    b->active++;
+    if (b->tp.renamed) b->tp.renamed(b->tp.ctx, idx, b->nick[idx]);
+
+    char join[128];
+    int n = snprintf(join, sizeof(join), "%s joined. Active: %d\n", b->nick[idx], b->active);
+    announce(b, 1, join, (size_t)n);
+}
+
+void broker_leave(broker_t *b, int idx) {
+    if (!b->live[idx]) return;
+    b->live[idx] = 0;
+    b->active--;
+    char leave[128];
+    int n = snprintf(leave, sizeof(leave), "%s left. Active: %d\n", b->nick[idx], b->active);
+    announce(b, 0, leave, (size_t)n);
+    snprintf(b->nick[idx], BROKER_NICK_MAX, "user%d", idx);     // ready for the next one
+}
+
+void broker_adopt(broker_t *b, int idx, const char *nick) {
+    if (!b->live[idx]) b->active++;
+    b->live[idx] = 1;
+    snprintf(b->nick[idx], BROKER_NICK_MAX, "%s", nick);
+}
+
+void broker_dispatch(broker_t *b, int i, const char *msg) {
+    if (msg[0] != '/') {
+        // One-byte fast path; the only slash-less command is the legacy 'exit'.
+        if (msg[0] == 'e' && !strcmp(msg, "exit")) { cmd_quit(b, i, ""); return; }
+        if (b->stamp) b->t_check = mono_ns();
+        PROBE2(dispatch, i, 0);
+        if (b->chat_msgs) metric_inc(b->chat_msgs);
+
+        // Normal chat: broadcast to everyone except sender
+        char out[BROKER_MSG_MAX + 64];
+        int n = snprintf(out, sizeof(out), "%s: %s\n", b->nick[i], msg);
+        if (n >= (int)sizeof(out)) n = (int)sizeof(out) - 1;
+        int fanout = broadcast(b, BROKER_LANE_BULK, out, (size_t)n, i);
+        PROBE2(broadcast_done, i, fanout);
+        flight_rec(FR_FANOUT, 0, (uint32_t)i, (uint32_t)fanout, (uint32_t)n);
+        return;
+    }
+
+    const char *word = msg + 1;
+    size_t wlen = strcspn(word, " ");
+    const char *arg = word + wlen;
+    while (*arg == ' ') arg++;
+
+    const command_t *c = find_command(word, wlen);
+    if (b->stamp) b->t_check = mono_ns();
+    PROBE2(dispatch, i, 1);
+    if (b->cmd_msgs) metric_inc(b->cmd_msgs);
+    if (c) { c->fn(b, i, arg); return; }
+
+    char err[96];
+    int n = snprintf(err, sizeof(err), "Unknown command: /%.*s (try /help)\n",
+                     (int)(wlen < 32 ? wlen : 32), word);
+    send_to(b, i, err, (size_t)n);
+}
@@ -0,0 +1,67 @@
+// broker.h — Ex8's message routing, independent of sockets, pipes and select()
+//
+// The broker owns who is connected and under which nick, parses commands and
+// decides who gets what.  It never touches a file descriptor: every delivery
+// goes through a broker_transport_t.  server.c plugs in client sockets (and
+// the shared session table); ../bench/broker_bench.c plugs in memory buffers
+// to time the routing on its own, without the kernel in the numbers.
+//
+// Clients are slots 0..max_clients-1.  Single-threaded: call everything from
+// one loop.
+#ifndef EX8_BROKER_H
+#define EX8_BROKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/metrics.h"
+#include "../common/presence.h"
+
+#define BROKER_MSG_MAX  1024      // longest message dispatched (NUL included)
+#define BROKER_NICK_MAX 32
+
+// Output lanes.  Replies, notices and presence are CONTROL; chat lines are
+// BULK.  A transport that queues should drain CONTROL first, so a /who or a
+// "Goodbye." never waits behind a flood.  Every message ends in '\n'.
+enum { BROKER_LANE_CONTROL, BROKER_LANE_BULK, BROKER_LANES };
+
+typedef struct {
+    // Deliver n bytes to slot idx.  Its result is not the broker's business:
+    // a transport that drops or queues accounts for that itself.
+    void (*send)(void *ctx, int idx, int lane, const char *buf, size_t n);
+    // Slot idx joined or changed nick (may be NULL).
+    void (*renamed)(void *ctx, int idx, const char *nick);
+    void *ctx;
+} broker_transport_t;
+
+typedef struct {
+    broker_transport_t tp;
+    int   max_clients;
+    int   active;                     // live slots
+    unsigned char *live;              // [max_clients]: receives broadcasts
+    char (*nick)[BROKER_NICK_MAX];    // [max_clients]; "user<idx>" when free
+    presence_t *presence;             // join/leave batching; NULL = announce at once
+    metric_t *chat_msgs, *cmd_msgs;   // may be NULL
+    int      stamp;                   // set t_check on each dispatch (-t)
+    uint64_t t_check;                 // when the last message was classified
+    char    *scratch;                 // /who reply
+    size_t   scratch_len;
+} broker_t;
+
+int  broker_init(broker_t *b, int max_clients, const broker_transport_t *tp);  // -1 (ENOMEM)
+void broker_free(broker_t *b);
+
+// Membership.  join/leave announce (through presence, if set); adopt takes
+// over a client from a previous server silently, with the nick it had.
+void broker_join(broker_t *b, int idx);
+void broker_leave(broker_t *b, int idx);
+void broker_adopt(broker_t *b, int idx, const char *nick);
+static inline const char *broker_nick(const broker_t *b, int idx) { return b->nick[idx]; }
+
+// Route one message (NUL-terminated, no line ending) from slot idx.
+void broker_dispatch(broker_t *b, int idx, const char *msg);
+
+// Send held presence notices if their window is up (or now, with force).
+void broker_flush_presence(broker_t *b, int force);
+
+#endif
@@ -1,4 +1,42 @@
-
+// server.c — Exercise 8 (C): chat server with nicknames and commands
+//
+// Build: gcc -Wall -Wextra -O2 server.c broker.c ../common/scan.c ../common/trace.c
+//            ../common/latency.c ../common/metrics.c ../common/fdpass.c
+//            ../common/listen.c ../common/busypoll.c ../common/shmtab.c
+//            ../common/presence.c ../common/flightrec.c ../common/zdict.c
+//            ../common/overload.c ../common/netio.c -lz -o server
+// Run:   ./server [-c capture.trace] [-t] [-m port] [-l unix:PATH ...] [-A accept_opts]
+//                 [-B busy_opts] [-P presence_opts] [-F flight_opts] [-Z dict | -Z off]
+//                 [-O overload_opts | -O off] [-U ctl.sock | -T ctl.sock]
+//        (then run multiple ../Ex7/client, or ../Ex7/client unix:PATH on this host)
+//        -c records every join/message/leave for ../bench/replay
+//        -t times each message stage by stage (kill -USR1 prints histograms)
+//        -m serves Prometheus metrics on 127.0.0.1:port/metrics
+//        -l also accepts local clients on unix:PATH or seqpacket:PATH (repeatable)
+//        -A tunes the TCP listener: backlog=N,defer=S,fastopen=Q (../common/listen.h);
+//             steer=1 moves each client's child to the CPU its packets arrive on
+//        -B low-latency broker loop, e.g. spin=50,sock=50,prefer=1,cpu=3: select()
+//             spins 50 us before sleeping, client sockets get SO_BUSY_POLL, and
+//             the parent (not the children) is pinned to CPU 3 (../common/busypoll.h)
+//        -P batches join/leave notices: window=MS,max=N sends each window's
+//             events as one digest line once there are more than N of them
+//             (../common/presence.h); window=0 announces each one at once
+//        -F tunes the flight recorder of recent events (accepts, reads, fan-outs,
+//             partial sends, disconnects), e.g. slots=65536,slow=20,dir=/tmp: it
+//             is dumped to dir/flight-<pid>-<n>.bin on kill -USR2, or when a loop
+//             pass takes over `slow` ms (../common/flightrec.h; ../bench/flightdump)
+//        -Z compresses output to clients that ask for it (../Ex7/client -z) with
+//             the dictionary in file `dict` instead of the built-in one; -Z off
+//             declines every request (../common/zdict.h)
+//        -O sheds load once the loop lag or the queue delay (child recv() to
+//             broker) has a p99 over target: target=MS,window=MS,resume=PCT,
+//             hold=MS,rate=N tells new clients "Server busy" and reads each
+//             client at most N messages/s, less while it stays over target
+//             (../common/overload.h); on by default, -O off never sheds
+//        -U listens for a hot-restart request on the Unix socket ctl.sock
+//        -T takes over a running server's clients via ctl.sock, e.g.
+//             ./server -U /tmp/chat.ctl &   ...   ./server.new -T /tmp/chat.ctl
+//             (metrics and the flight recorder carry over; -F is then ignored)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,249 +44,1060 @@
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/select.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "../common/scan.h"
+#include "../common/trace.h"
+#include "../common/latency.h"
+#include "../common/probes.h"
+#include "../common/metrics.h"
+#include "../common/fdpass.h"
+#include "../common/listen.h"
+#include "../common/busypoll.h"
+#include "../common/shmtab.h"
+#include "../common/presence.h"
+#include "../common/flightrec.h"
+#include "../common/zdict.h"
+#include "../common/overload.h"
+#include "../common/netio.h"
+#include "broker.h"
 
 #define PORT 8080
 #define MAX_CLIENTS FD_SETSIZE
-#define MAX_MSG     1024
-#define NICK_MAX    32
+#define MAX_MSG     BROKER_MSG_MAX
+#define NICK_MAX    BROKER_NICK_MAX
+#define RECV_BUF    65536     // child's receive buffer; may hold many pipelined lines
+#define MAX_LINES   64        // spans per scan_lines() call
+#define READ_MSGS   8         // a client's turn in one pass: this many messages ...
+#define READ_BYTES  8192      // ... or this many payload bytes, whichever comes first
+#define PASS_MSGS   16        // past the first round, a pass stops after this many
+
+// What a pipe message is, so the parent can put commands ahead of chat.
+enum { MSG_CHAT, MSG_COMMAND };
 
 typedef struct {
     int sender_idx;   // index in tables (parent's view)
     int len;          // bytes in payload (no NUL)
+    int kind;         // MSG_*
+    uint64_t t_recv;  // -t, -O: CLOCK_MONOTONIC when the child's recv() returned
+    uint64_t t_piped; // -t: ... and when it handed the message to the pipe
 } msg_hdr_t;
 
 static volatile sig_atomic_t g_shutdown = 0;
+static int g_handed_off = 0;           // -U: a new server took our clients; exit quietly
+static trace_writer_t g_trace;         // -c: capture of inbound traffic (f == NULL when off)
+
+// --- Per-message stage latency (-t) -------------------------------------------
+//
+// Each message is stamped with CLOCK_MONOTONIC (system-wide, so child and
+// parent stamps compare) at: child recv() -> pipe write -> parent select()
+// wake-up -> read_full() done -> command check done -> send loop done.
+// Histograms are printed on SIGUSR1 and at shutdown.  The chat:* USDT probes
+// fire at the same points whether or not -t is given.
+
+enum { ST_CHILD, ST_PIPE, ST_READ, ST_CHECK, ST_FANOUT, ST_TOTAL, NUM_STAGES };
+static const char *const STAGE_NAMES[NUM_STAGES] = {
+    "recv->pipe", "pipe->wake", "wake->read", "read->check", "check->sent", "end-to-end",
+};
+static int g_stages;                            // -t given
+static busypoll_t g_busy;                       // -B
+static presence_t g_presence;                   // -P
+static overload_t g_ovl;                        // -O
+static lat_hist_t g_stage_hist[NUM_STAGES];
+static volatile sig_atomic_t g_dump_stages = 0;
+static void on_sigusr1(int signo) { (void)signo; g_dump_stages = 1; }
+
+// --- Metrics (always counted; -m <port> serves them on 127.0.0.1) --------------
+
+static struct {
+    metric_t *conns, *active, *rejected, *busy, *throttled, *chat_msgs, *cmd_msgs;
+    metric_t *bytes_in, *bytes_out, *deliveries, *drop_send, *drop_frame, *ready_fds, *cross_cpu;
+    metric_t *budget_out;
+    metric_t *z_plain, *z_wire;
+    metric_t *stage[NUM_STAGES];
+} M;
+
+static void metrics_setup(void) {
+    static const char *const STAGE_LABELS[NUM_STAGES] = {
+        "stage=\"recv_pipe\"", "stage=\"pipe_wake\"", "stage=\"wake_read\"",
+        "stage=\"read_check\"", "stage=\"check_sent\"", "stage=\"end_to_end\"",
+    };
+    metrics_init();
+    M.conns      = metric_counter("chat_connections_total", NULL, "Accepted client connections");
+    M.active     = metric_gauge("chat_connections_active", NULL, "Currently connected clients");
+    M.rejected   = metric_counter("chat_rejected_total", "reason=\"full\"", "Connections turned away");
+    M.busy       = metric_counter("chat_rejected_total", "reason=\"busy\"", "Connections turned away");
+    M.throttled  = metric_counter("chat_throttled_reads_total", NULL, "Messages read under the shedding rate limit");
+    M.chat_msgs  = metric_counter("chat_messages_total", "kind=\"chat\"", "Inbound messages by kind");
+    M.cmd_msgs   = metric_counter("chat_messages_total", "kind=\"command\"", "Inbound messages by kind");
+    M.bytes_in   = metric_counter("chat_bytes_in_total", NULL, "Bytes received from clients (children)");
+    M.bytes_out  = metric_counter("chat_bytes_out_total", NULL, "Bytes sent to clients");
+    M.deliveries = metric_counter("chat_deliveries_total", NULL, "Messages handed to a recipient socket");
+    M.drop_send  = metric_counter("chat_dropped_total", "reason=\"send\"", "Messages not delivered");
+    M.drop_frame = metric_counter("chat_dropped_total", "reason=\"frame\"", "Messages not delivered");
+    M.budget_out = metric_counter("chat_read_budget_spent_total", NULL,
+                                  "Turns that ended with messages still in the client's pipe");
+    M.cross_cpu  = metric_counter("chat_cross_cpu_connections_total", NULL,
+                                  "Clients read on another CPU than the one processing their packets");
+    M.ready_fds  = metric_gauge("chat_ready_queue_depth", NULL, "Ready fds in the last select() pass");
+    M.z_plain    = metric_counter("chat_compress_bytes_total", "side=\"plain\"",
+                                  "Output to compressing clients, before and after");
+    M.z_wire     = metric_counter("chat_compress_bytes_total", "side=\"wire\"",
+                                  "Output to compressing clients, before and after");
+    g_presence.events  = metric_counter("chat_presence_events_total", NULL, "Joins and leaves");
+    g_presence.digests = metric_counter("chat_presence_digests_total", NULL, "Presence windows sent as one digest line");
+    g_ovl.lag_hist   = metric_histogram("chat_loop_lag_seconds", NULL, "Broker loop pass duration");
+    g_ovl.delay_hist = metric_histogram("chat_queue_delay_seconds", NULL, "Child recv() to broker pick-up");
+    g_ovl.state      = metric_gauge("chat_overload_shedding", NULL, "1 while shedding load");
+    g_ovl.episodes   = metric_counter("chat_overload_episodes_total", NULL, "Times shedding started");
+    for (int st = 0; st < NUM_STAGES; st++)
+        M.stage[st] = metric_histogram("chat_stage_seconds", STAGE_LABELS[st],
+                                       "Per-message latency by stage (-t)");
+}
+
+static void stage_add(int st, uint64_t from, uint64_t to) {
+    uint64_t ns = to > from ? to - from : 0;
+    lat_hist_add(&g_stage_hist[st], ns);
+    metric_observe(M.stage[st], ns);
+}
+
+static void dump_stages(void) {
+    lat_hist_print_header(stdout);
+    for (int st = 0; st < NUM_STAGES; st++) lat_hist_print(stdout, STAGE_NAMES[st], &g_stage_hist[st]);
+    fflush(stdout);
+}
 static void on_sigint(int signo) { (void)signo; g_shutdown = 1; }
 
-static void trim(char *s){
-    size_t n = strlen(s);
-    while (n && (s[n-1]=='\n' || s[n-1]=='\r')) s[--n] = '\0';
+// --- Parent state --------------------------------------------------------------
+
+static int   client_fds[MAX_CLIENTS];     // sockets parent keeps for broadcast
+static int   pipe_rfds[MAX_CLIENTS];      // read ends from children
+static pid_t child_pids[MAX_CLIENTS];
+static broker_t g_broker;                 // who is who, commands, fan-out (broker.c)
+
+// Session table shared with the children (keyed by slot).  The parent writes
+// it on join, /nick and leave, so a child can look a session up without a
+// pipe round trip; it travels with a hot restart.  /who is still the
+// broker's: only the parent knows which of a client's lines it has handled.
+typedef struct {
+    char  nick[NICK_MAX];
+    pid_t pid;
+} session_t;
+
+static shmtab_t *g_sessions;
+
+static void session_put(int slot, const char *name, pid_t pid) {
+    session_t s;
+    memset(&s, 0, sizeof(s));
+    snprintf(s.nick, sizeof(s.nick), "%s", name);
+    s.pid = pid;
+    if (shmtab_put(g_sessions, (uint64_t)slot, &s) < 0) perror("session table");
+}
+
+// --- Output lanes --------------------------------------------------------------
+//
+// Only the parent writes to client sockets.  Each client has a control and a
+// bulk queue (broker.h's lanes); a send goes straight to the socket when both
+// are empty, otherwise it waits its turn and select() reports when the socket
+// takes more.  The writer finishes the line it is in the middle of, then
+// drains control before bulk, so a /who or "Goodbye." overtakes a flood of
+// chat.  TCP_NOTSENT_LOWAT keeps the kernel's unsent backlog short, so the
+// backlog — and the choice of what goes next — stays here.
+//
+// MSG_DONTWAIT rather than O_NONBLOCK: the child shares the open file and
+// its recv() must keep blocking.
+//
+// A client that negotiated compression (/compress, ../common/zdict.h) gets
+// frames instead of lines: each message is framed once, in tp_send(), and a
+// broadcast's recipients share the encoder's memo of the last frame.
+
+#define LANE_MAX      (1 << 20)   // per lane; a client this far behind loses messages
+#define NOTSENT_LOWAT 16384
+
+typedef struct {
+    char  *buf;                   // malloc()ed while non-empty
+    size_t off, len, cap;
+} lane_t;
+
+typedef struct {
+    lane_t lane[BROKER_LANES];
+    int    cur;                   // lane with a half-sent line at its head, or -1
+    size_t cur_left;              // bytes of that line still to go
+} outq_t;
+
+static outq_t g_out[MAX_CLIENTS];
+static unsigned char g_zc[MAX_CLIENTS];   // client reads frames
+static zdict_t     g_zdict;
+static zdict_enc_t g_zenc;
+static int         g_zoff;                // -Z off
+
+static int outq_pending(const outq_t *q) {
+    return q->lane[BROKER_LANE_CONTROL].len || q->lane[BROKER_LANE_BULK].len;
+}
+
+static void lane_free(lane_t *l) {
+    free(l->buf);
+    memset(l, 0, sizeof(*l));
+}
+
+static int lane_push(lane_t *l, const char *p, size_t n) {
+    size_t pending = l->len - l->off;
+    if (pending + n > LANE_MAX) return -1;
+    if (l->len + n > l->cap) {
+        memmove(l->buf, l->buf + l->off, pending);
+        l->off = 0;
+        l->len = pending;
+        if (pending + n > l->cap) {
+            size_t cap = l->cap ? l->cap : 4096;
+            while (cap < pending + n) cap *= 2;
+            char *b = (char*)realloc(l->buf, cap);
+            if (!b) return -1;
+            l->buf = b;
+            l->cap = cap;
+        }
+    }
+    memcpy(l->buf + l->len, p, n);
+    l->len += n;
+    return 0;
+}
+
+static void outq_reset(int i) {
+    for (int ln = 0; ln < BROKER_LANES; ln++) lane_free(&g_out[i].lane[ln]);
+    g_out[i].cur = -1;
+}
+
+// A send of n bytes from a message boundary at p stopped after `at`: bytes
+// still to go of the message it stopped in (a line, or a frame), 0 if none.
+static size_t msg_left(int i, const char *p, size_t at, size_t n) {
+    if (!g_zc[i]) {
+        if (p[at - 1] == '\n') return 0;
+        const char *nl = (const char*)memchr(p + at, '\n', n - at);
+        return nl ? (size_t)(nl + 1 - (p + at)) : n - at;
+    }
+    size_t pos = 0;
+    while (pos < at) {
+        size_t f = zdict_frame_size(p + pos, n - pos);
+        if (f == 0) return n - at;
+        pos += f;
+    }
+    return pos - at;
+}
+
+// Switch client i to frames.  Whatever is queued is re-framed line by line,
+// except the rest of a half-sent line, which goes out as it is and is
+// followed by the plain ack line: the two are the lane's head, so nothing
+// overtakes the ack and everything after it is a frame.
+static void outq_compress(int i, const char *ack, size_t ack_len) {
+    outq_t *q = &g_out[i];
+    int cur = q->cur, head = cur >= 0 ? cur : BROKER_LANE_CONTROL;
+    size_t keep = cur >= 0 ? q->cur_left : 0;
+    for (int ln = 0; ln < BROKER_LANES; ln++) {
+        lane_t old = q->lane[ln];
+        memset(&q->lane[ln], 0, sizeof(lane_t));
+        size_t off = old.off;
+        if (ln == head) {
+            lane_push(&q->lane[ln], old.buf + off, keep);
+            lane_push(&q->lane[ln], ack, ack_len);
+            off += keep;
+        }
+        while (off < old.len) {
+            const char *nl = (const char*)memchr(old.buf + off, '\n', old.len - off);
+            size_t len = nl ? (size_t)(nl + 1 - (old.buf + off)) : old.len - off;
+            size_t fl;
+            const char *f = zdict_frame(&g_zenc, old.buf + off, len, &fl);
+            if (!f || lane_push(&q->lane[ln], f, fl) < 0) metric_inc(M.drop_send);
+            off += len;
+        }
+        free(old.buf);
+    }
+    q->cur = head;
+    q->cur_left = keep + ack_len;
+    g_zc[i] = 1;
 }
-static ssize_t read_full(int fd, void *buf, size_t n){
-    size_t off = 0;
-    while (off < n) {
-        ssize_t r = read(fd, (char*)buf + off, n - off);
-        if (r < 0) { if (errno == EINTR) continue; return -1; }
-        if (r == 0) return (ssize_t)off;
-        off += (size_t)r;
+
+// Write queued output until the socket is full.  Returns -1 if it is dead.
+static int out_flush(int i) {
+    outq_t *q = &g_out[i];
+    for (;;) {
+        int ln = q->cur;
+        if (ln < 0) ln = q->lane[BROKER_LANE_CONTROL].len ? BROKER_LANE_CONTROL : BROKER_LANE_BULK;
+        lane_t *l = &q->lane[ln];
+        if (!l->len) return 0;
+        size_t n = q->cur >= 0 ? q->cur_left : l->len - l->off;
+        ssize_t w = send(client_fds[i], l->buf + l->off, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        metric_add(M.bytes_out, w);
+        if ((size_t)w < n) flight_rec(FR_SEND_PARTIAL, 0, (uint32_t)i, (uint32_t)w, (uint32_t)n);
+        l->off += (size_t)w;
+        if (q->cur >= 0) {
+            if ((q->cur_left -= (size_t)w) == 0) q->cur = -1;
+        } else if ((size_t)w < n) {
+            // Stopped inside a message: it goes before anything else does.
+            size_t left = msg_left(i, l->buf + l->off - (size_t)w, (size_t)w, n);
+            if (left) { q->cur = ln; q->cur_left = left; }
+        }
+        if (l->off == l->len) lane_free(l);
+        if ((size_t)w < n) return 0;
     }
-    return (ssize_t)off;
 }
-static ssize_t write_full(int fd, const void *buf, size_t n){
-    size_t off = 0;
-    while (off < n) {
-        ssize_t w = write(fd, (const char*)buf + off, n - off);
-        if (w < 0) { if (errno == EINTR) continue; return -1; }
-        off += (size_t)w;
+
+// Keep flushing for up to `ms` milliseconds (shutdown: nobody will send the
+// rest after us).  Whatever is left is dropped.
+static void out_drain(int ms) {
+    uint64_t until = mono_ns() + (uint64_t)ms * 1000000ull;
+    for (;;) {
+        fd_set wfds; FD_ZERO(&wfds);
+        int maxfd = -1;
+        for (int i = 0; i < MAX_CLIENTS; ++i) {
+            if (client_fds[i] == -1 || !outq_pending(&g_out[i])) continue;
+            FD_SET(client_fds[i], &wfds);
+            if (client_fds[i] > maxfd) maxfd = client_fds[i];
+        }
+        uint64_t now = mono_ns();
+        if (maxfd < 0 || now >= until) break;
+        struct timeval tv = { 0, (suseconds_t)((until - now) / 1000) };
+        if (tv.tv_usec >= 1000000) { tv.tv_sec = tv.tv_usec / 1000000; tv.tv_usec %= 1000000; }
+        if (select(maxfd + 1, NULL, &wfds, NULL, &tv) < 0 && errno != EINTR) break;
+        for (int i = 0; i < MAX_CLIENTS; ++i)
+            if (client_fds[i] != -1 && FD_ISSET(client_fds[i], &wfds) && out_flush(i) < 0) outq_reset(i);
+    }
+    for (int i = 0; i < MAX_CLIENTS; ++i)
+        if (outq_pending(&g_out[i])) { metric_inc(M.drop_send); outq_reset(i); }
+}
+
+// Broker transport: the lanes above, and the session table so children see
+// nick changes.
+static void tp_send(void *ctx, int i, int lane, const char *buf, size_t n) {
+    (void)ctx;
+    if (client_fds[i] == -1) return;
+    if (g_zc[i]) {
+        size_t fl;
+        const char *f = zdict_frame(&g_zenc, buf, n, &fl);
+        if (!f) { metric_inc(M.drop_send); return; }
+        metric_add(M.z_plain, (int64_t)n);
+        metric_add(M.z_wire, (int64_t)fl);
+        buf = f;
+        n = fl;
+    }
+    outq_t *q = &g_out[i];
+    ssize_t w = 0;
+    if (!outq_pending(q)) {
+        w = send(client_fds[i], buf, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) { metric_inc(M.drop_send); return; }
+        if (w > 0) { metric_add(M.bytes_out, w); buf += w; n -= (size_t)w; }
+        if (n == 0) { metric_inc(M.deliveries); return; }
+        // The socket just filled up: from here on this client's output queues.
+        if (w > 0) flight_rec(FR_SEND_PARTIAL, 0, (uint32_t)i, (uint32_t)w, (uint32_t)(w + (ssize_t)n));
+        else flight_rec(FR_SEND_EAGAIN, 0, (uint32_t)i, (uint32_t)n, 0);
+    }
+    if (lane_push(&q->lane[lane], buf, n) < 0) { metric_inc(M.drop_send); return; }
+    if (w > 0) { q->cur = lane; q->cur_left = n; }    // the rest of this message goes first
+    metric_inc(M.deliveries);
+}
+
+static void tp_renamed(void *ctx, int i, const char *name) {
+    (void)ctx;
+    session_put(i, name, child_pids[i]);
+}
+
+// "/compress deflate <id>": frames from now on if we have dictionary <id>.
+// Handled here, not by the broker: it is about the wire, not the chat.
+static void compress_request(int i, const char *arg) {
+    char ack[64];
+    unsigned long id = 0;
+    if (g_zc[i]) return;
+    if (g_zoff || sscanf(arg, " deflate %lu", &id) != 1 || id != g_zdict.id) {
+        int n = snprintf(ack, sizeof(ack), "Compression unavailable (server has %s)\n",
+                         g_zoff ? "it off" : "another dictionary");
+        tp_send(NULL, i, BROKER_LANE_CONTROL, ack, (size_t)n);
+        return;
     }
-    return (ssize_t)off;
+    int n = snprintf(ack, sizeof(ack), ZDICT_ACK "%lu\n", id);
+    outq_compress(i, ack, (size_t)n);
+    if (out_flush(i) < 0) shutdown(client_fds[i], SHUT_RDWR);
 }
 
 // Child process: read from its client socket; forward lines to parent via pipe.
-static void child_loop(int client_fd, int pipe_write_fd, int my_index) {
-    char buf[MAX_MSG];
 
-    // Welcome message & small hint
-    const char *hello =
-        "Welcome! Commands: /nick <name>, /who, /quit (or 'exit').\n";
-    send(client_fd, hello, strlen(hello), 0);
+// One frame, header and payload in a single writev(): frames up to PIPE_BUF
+// reach the pipe whole, so once the parent sees a header it can read the
+// payload without blocking.  Everything sent is at most PIPE_MSG.
+#define PIPE_MSG (PIPE_BUF - sizeof(msg_hdr_t))
+
+static int pipe_send(int pipe_write_fd, const msg_hdr_t *hdr, const char *p) {
+    struct iovec iov[2] = { { (void*)hdr, sizeof(*hdr) }, { (void*)p, (size_t)hdr->len } };
+    ssize_t w;
+    do w = writev(pipe_write_fd, iov, 2); while (w < 0 && errno == EINTR);
+    return w == (ssize_t)(sizeof(*hdr) + (size_t)hdr->len) ? 0 : -1;
+}
+
+// Send one line to the parent (split if longer than a message).
+// Returns 1 if the line asks to leave, -1 if the pipe is gone, else 0.
+static int forward_line(int pipe_write_fd, int my_index, const char *p, size_t len,
+                        uint64_t t_recv) {
+    // Same test as the command registry: the word after '/' is "quit",
+    // whatever follows the space.
+    int quit = (len == 4 && !memcmp(p, "exit", 4)) ||
+               (len >= 5 && !memcmp(p, "/quit", 5) && (len == 5 || p[5] == ' '));
+    int kind = quit || (len && p[0] == '/') ? MSG_COMMAND : MSG_CHAT;
+    while (len > 0) {
+        size_t chunk = len < MAX_MSG-1 ? len : MAX_MSG-1;
+        // package: index + length + payload (+ stage stamps with -t)
+        msg_hdr_t hdr = { .sender_idx = my_index, .len = (int)chunk, .kind = kind,
+                          .t_recv = t_recv, .t_piped = g_stages ? mono_ns() : 0 };
+        PROBE2(pipe_write, my_index, chunk);
+        if (pipe_send(pipe_write_fd, &hdr, p) < 0) return -1;
+        p += chunk; len -= chunk;
+    }
+    return quit;
+}
+
+static void child_loop(int client_fd, int pipe_write_fd, int my_index) {
+    char buf[RECV_BUF];
+    span_t lines[MAX_LINES], tail;
+    linebuf_t lb;
+    linebuf_init(&lb, buf, sizeof(buf));
 
     for (;;) {
-        ssize_t n = recv(client_fd, buf, sizeof(buf)-1, 0);
-        if (n <= 0) break;
-        buf[n] = '\0';
-        trim(buf);
-        if (!buf[0]) continue;
+        ssize_t n = linebuf_fill(&lb, client_fd, 0);
+        if (n <= 0) {
+            flight_rec(FR_CLOSE, n ? FR_WHY_ERROR : FR_WHY_EOF, (uint32_t)my_index, n ? (uint32_t)errno : 0, 0);
+            break;
+        }
+        flight_rec(FR_RECV, 0, (uint32_t)my_index, (uint32_t)n, 0);
+        uint64_t t_recv = g_stages || !g_ovl.off ? mono_ns() : 0;
+        PROBE2(child_recv, my_index, n);
+        metric_add(M.bytes_in, n);
 
-        // package: index + length + payload
-        msg_hdr_t hdr = { .sender_idx = my_index, .len = (int)strlen(buf) };
-        if (write_full(pipe_write_fd, &hdr, sizeof(hdr)) < 0) break;
-        if (write_full(pipe_write_fd, buf, (size_t)hdr.len) < 0) break;
+        // Pipelined input: split every complete line out of the buffer in
+        // one vectorized pass, forwarding spans without copying them.
+        size_t k;
+        int rc = 0;
+        while (rc == 0 && (k = linebuf_lines(&lb, lines, MAX_LINES)) > 0)
+            for (size_t j = 0; j < k && rc == 0; j++)
+                rc = forward_line(pipe_write_fd, my_index, lines[j].p, lines[j].len, t_recv);
 
-        if (!strcmp(buf, "exit") || !strcmp(buf, "/quit")) break;
+        // Unterminated tail.  Clients that never send '\n' (./client strips
+        // it) still get one message per recv(); line-mode clients keep the
+        // partial line for the next recv() unless it fills the whole buffer.
+        if (rc == 0 && linebuf_tail(&lb, &tail))
+            rc = forward_line(pipe_write_fd, my_index, tail.p, tail.len, t_recv);
+        if (rc != 0) {
+            flight_rec(FR_CLOSE, rc > 0 ? FR_WHY_QUIT : FR_WHY_ERROR, (uint32_t)my_index, rc > 0 ? 0 : (uint32_t)errno, 0);
+            break;
+        }
     }
     close(client_fd);
     close(pipe_write_fd);
     _exit(0);
 }
 
-int main(void) {
-    signal(SIGCHLD, SIG_IGN);         // reap children
-    signal(SIGINT,  on_sigint);       // graceful shutdown on Ctrl+C
+// --- Hot restart (-U / -T) ------------------------------------------------------
+//
+// The running server listens on a Unix SOCK_SEQPACKET socket.  A new binary
+// started with -T connects and receives, one record per client, the client
+// socket, the read end of that client's pipe, its nick and whether it reads
+// compressed frames; the first record carries the control socket, every
+// listener (TCP and -l) and the memfds of the session table, the metrics
+// registry and the flight ring, which both parents and all children map at
+// once: counts and events from adopted children land where the new parent
+// reads them, and the ring keeps its settings.  Children are left alone: they keep reading
+// their sockets and writing their pipes, and whatever they write while the
+// handoff runs simply waits in the pipe for the new parent.  Output the
+// socket has not taken yet goes along too: each client's record carries the
+// lengths of its lanes and the half-sent message at their head (cur,
+// cur_left), and the lanes' bytes follow it in HANDOFF_CHUNK messages, so the
+// new parent picks up mid-line or mid-frame where the old one stopped.  The
+// old server exits only after the new one acks; without an ack it keeps
+// serving as if nothing happened.
 
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) { perror("socket"); exit(1); }
-    int opt = 1; setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#define HANDOFF_MAGIC   0x43484f46u       // "CHOF"
+#define HANDOFF_VERSION 7
+#define HANDOFF_CHUNK   32768             // lane bytes per SEQPACKET message
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET; addr.sin_addr.s_addr = INADDR_ANY; addr.sin_port = htons(PORT);
-    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); exit(1); }
-    if (listen(listen_fd, 32) < 0) { perror("listen"); exit(1); }
+typedef struct {
+    uint32_t magic, version;
+    uint32_t msg_hdr_size;    // children keep framing with the old binary's msg_hdr_t
+    int      active, nclients;
+    int      nlisten;         // fds after the control socket, in listen_set_t order;
+                              // the session table, metrics and flight ring follow
+    uint32_t zdict_id;        // compressing clients need the same dictionary
+    char     listen_path[LISTEN_MAX][108];
+} handoff_hdr_t;
 
-    printf("Chat server (Ex8) on %d … (Ctrl+C to shut down)\n", PORT);
+typedef struct {
+    int   slot;
+    pid_t pid;
+    int   compressed;         // reads frames (/compress)
+    char  nick[NICK_MAX];
+    int      cur;             // outq_t: lane with a half-sent message at its head, or -1
+    uint32_t cur_left;        // ... bytes of it still to go
+    uint32_t lane_len[BROKER_LANES];   // queued bytes that follow, lane by lane
+} handoff_client_t;
 
-    int client_fds[MAX_CLIENTS];     // sockets parent keeps for broadcast
-    int pipe_rfds[MAX_CLIENTS];      // read ends from children
-    pid_t child_pids[MAX_CLIENTS];
-    char nick[MAX_CLIENTS][NICK_MAX];
-    int active = 0;
+static int ctl_listen(const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(sa.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(sa.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, 1) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+// Old side: hand every client to whoever connected on ctl_fd.
+// Returns 1 once the new server has acked, 0 if the handoff was abandoned.
+static int handoff(int ctl_fd, const listen_set_t *ls) {
+    int c = accept(ctl_fd, NULL, NULL);
+    if (c < 0) { perror("handoff accept"); return 0; }
+
+    handoff_hdr_t hh;
+    memset(&hh, 0, sizeof(hh));
+    hh.magic = HANDOFF_MAGIC; hh.version = HANDOFF_VERSION;
+    hh.msg_hdr_size = sizeof(msg_hdr_t);
+    hh.active = g_broker.active;
+    hh.zdict_id = g_zdict.id;
+    for (int i = 0; i < MAX_CLIENTS; ++i) if (pipe_rfds[i] != -1) hh.nclients++;
+    int lfds[4 + LISTEN_MAX] = { ctl_fd };
+    hh.nlisten = ls->n;
+    for (int k = 0; k < ls->n; k++) {
+        lfds[1 + k] = ls->fd[k];
+        memcpy(hh.listen_path[k], ls->path[k], sizeof(hh.listen_path[k]));
+    }
+    lfds[1 + ls->n] = shmtab_fd(g_sessions);
+    lfds[2 + ls->n] = metrics_fd();
+    lfds[3 + ls->n] = flight_fd();
+    int ok = fdpass_send(c, &hh, sizeof(hh), lfds, 4 + ls->n) == 0;
+
+    for (int i = 0; i < MAX_CLIENTS && ok; ++i) {
+        if (pipe_rfds[i] == -1) continue;
+        // A client whose socket is already closed still has a pipe to drain;
+        // send the pipe alone so its EOF is seen by the new parent.
+        const outq_t *q = &g_out[i];
+        handoff_client_t hc = { .slot = i, .pid = child_pids[i], .compressed = g_zc[i],
+                                .cur = q->cur, .cur_left = (uint32_t)q->cur_left };
+        memcpy(hc.nick, broker_nick(&g_broker, i), NICK_MAX);
+        for (int ln = 0; ln < BROKER_LANES; ln++) hc.lane_len[ln] = (uint32_t)(q->lane[ln].len - q->lane[ln].off);
+        int fds[2] = { pipe_rfds[i], client_fds[i] };
+        ok = fdpass_send(c, &hc, sizeof(hc), fds, client_fds[i] != -1 ? 2 : 1) == 0;
+        for (int ln = 0; ln < BROKER_LANES && ok; ln++) {
+            const lane_t *l = &q->lane[ln];
+            for (size_t off = l->off; off < l->len && ok; off += HANDOFF_CHUNK) {
+                size_t n = l->len - off < HANDOFF_CHUNK ? l->len - off : HANDOFF_CHUNK;
+                ok = send(c, l->buf + off, n, MSG_NOSIGNAL) == (ssize_t)n;
+            }
+        }
+    }
+
+    char ack = 0;
+    struct timeval tv = { 5, 0 };
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (ok && recv(c, &ack, 1, 0) == 1 && ack == 'k') {
+        printf("Handed off %d clients; exiting.\n", hh.nclients);
+        // c is left open on purpose: the new server waits for it to close.
+        return 1;
+    }
+    fprintf(stderr, "handoff abandoned; still serving\n");
+    close(c);
+    return 0;
+}
+
+// New side, first step: connect, adopt the listeners and attach the shared
+// regions.  Runs before metrics_setup(), which then finds the old server's
+// metrics in the registry instead of making new ones.  Returns the socket.
+static int take_over_begin(const char *path, handoff_hdr_t *hh, listen_set_t *ls, int *ctl_fd) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(sa.sun_path)) { fprintf(stderr, "%s: path too long\n", path); exit(1); }
+    strcpy(sa.sun_path, path);
+    int c = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (c < 0 || connect(c, (struct sockaddr*)&sa, sizeof(sa)) < 0) { perror(path); exit(1); }
+
+    int fds[4 + LISTEN_MAX], nfds;
+    if (fdpass_recv(c, hh, sizeof(*hh), fds, 4 + LISTEN_MAX, &nfds) != (ssize_t)sizeof(*hh)) {
+        fprintf(stderr, "takeover: bad handoff header\n"); exit(1);
+    }
+    if (hh->magic != HANDOFF_MAGIC || hh->version != HANDOFF_VERSION ||
+        hh->msg_hdr_size != sizeof(msg_hdr_t) || hh->nlisten < 1 || nfds != 4 + hh->nlisten) {
+        fprintf(stderr, "takeover: incompatible server (version %u, msg_hdr %u bytes)\n",
+                hh->version, hh->msg_hdr_size);
+        exit(1);   // no ack: the old server keeps running
+    }
+    *ctl_fd = fds[0];
+    listen_set_init(ls);
+    for (int k = 0; k < hh->nlisten; k++) {
+        listen_set_add(ls, fds[1 + k]);
+        memcpy(ls->path[k], hh->listen_path[k], sizeof(ls->path[k]));
+        ls->path[k][sizeof(ls->path[k]) - 1] = '\0';
+    }
+    if (!(g_sessions = shmtab_attach(fds[1 + hh->nlisten]))) { perror("takeover: session table"); exit(1); }
+    if (metrics_attach(fds[2 + hh->nlisten]) < 0) { perror("takeover: metrics"); exit(1); }
+    if (flight_attach(fds[3 + hh->nlisten]) < 0) { perror("takeover: flight recorder"); exit(1); }
+    return c;
+}
+
+// New side, second step: adopt the clients.  Blocks until the old server has
+// exited so we never run two parents at once.
+static void take_over(int c, const handoff_hdr_t *hh, const char *path) {
+    int fds[2], nfds;
+    for (int k = 0; k < hh->nclients; ++k) {
+        handoff_client_t hc;
+        if (fdpass_recv(c, &hc, sizeof(hc), fds, 2, &nfds) != (ssize_t)sizeof(hc) || nfds < 1 ||
+            hc.slot < 0 || hc.slot >= MAX_CLIENTS) {
+            fprintf(stderr, "takeover: bad client record\n"); exit(1);
+        }
+        if (hc.compressed && (g_zoff || hh->zdict_id != g_zdict.id)) {
+            fprintf(stderr, "takeover: clients use compression dictionary %u, we have %s\n",
+                    hh->zdict_id, g_zoff ? "compression off" : "another one");
+            exit(1);
+        }
+        pipe_rfds[hc.slot]  = fds[0];
+        client_fds[hc.slot] = nfds == 2 ? fds[1] : -1;
+        g_zc[hc.slot] = (unsigned char)hc.compressed;
+        child_pids[hc.slot] = hc.pid;
+        outq_t *q = &g_out[hc.slot];
+        for (int ln = 0; ln < BROKER_LANES; ln++) {
+            static char chunk[HANDOFF_CHUNK];
+            for (uint32_t left = hc.lane_len[ln]; left > 0; ) {
+                ssize_t r = recv(c, chunk, sizeof(chunk), 0);
+                if (r <= 0 || (size_t)r > left || lane_push(&q->lane[ln], chunk, (size_t)r) < 0) {
+                    fprintf(stderr, "takeover: bad output queue\n"); exit(1);
+                }
+                left -= (uint32_t)r;
+            }
+        }
+        q->cur = hc.cur >= 0 && hc.cur < BROKER_LANES && q->lane[hc.cur].len ? hc.cur : -1;
+        q->cur_left = q->cur >= 0 ? hc.cur_left : 0;
+        hc.nick[NICK_MAX - 1] = '\0';
+        if (nfds == 2) broker_adopt(&g_broker, hc.slot, hc.nick);
+    }
+    metric_set(M.active, g_broker.active);
+
+    char ack = 'k', eof;
+    if (send(c, &ack, 1, MSG_NOSIGNAL) != 1) { perror("takeover ack"); exit(1); }
+    while (recv(c, &eof, 1, 0) > 0) { }       // returns 0 once the old server is gone
+    close(c);
+    printf("Took over %d clients from %s\n", hh->nclients, path);
+}
+
+// A message read from a child's pipe.
+typedef struct {
+    int       idx;
+    msg_hdr_t hdr;
+    uint64_t  t_read;
+    int       leave;          // not a message: the child has exited
+    char      msg[MAX_MSG];
+} pending_msg_t;
+
+static pending_msg_t g_chat[MAX_CLIENTS];       // chat lines deferred to the end of a pass
+static int      g_nchat;
+static int      g_queued[MAX_CLIENTS];          // this pass: client has entries in g_chat
+static int      g_rr;                           // the next pass starts at the first ready slot from here
+static uint64_t g_next_read[MAX_CLIENTS];       // -O shedding: pipe left alone until then
+static uint64_t g_held[MAX_CLIENTS];            // ... last time it was (what it sent before waited on us)
+
+// The child exited: the client is gone.
+static void client_gone(int i) {
+    trace_write(&g_trace, TR_LEAVE, (unsigned)i, NULL, 0);
+    shmtab_del(g_sessions, (uint64_t)i);
+    if (client_fds[i] != -1) {
+        close(client_fds[i]); client_fds[i] = -1;
+        outq_reset(i);
+        metric_dec(M.active);
+        broker_leave(&g_broker, i);
+    }
+}
+
+static void handle_message(pending_msg_t *m, uint64_t t_wake) {
+    if (m->leave) { client_gone(m->idx); return; }
+    trace_write(&g_trace, TR_MSG, (unsigned)m->idx, m->msg, (uint32_t)m->hdr.len);
+    if (!strncmp(m->msg, "/compress", 9) && (m->msg[9] == ' ' || m->msg[9] == '\0')) {
+        compress_request(m->idx, m->msg + 9);
+        return;
+    }
+    g_broker.t_check = 0;
+    broker_dispatch(&g_broker, m->idx, m->msg);
+
+    if (g_stages && m->hdr.t_recv && g_broker.t_check) {
+        uint64_t t_done = mono_ns();
+        stage_add(ST_CHILD,  m->hdr.t_recv,  m->hdr.t_piped);
+        stage_add(ST_PIPE,   m->hdr.t_piped, t_wake);
+        stage_add(ST_READ,   t_wake,         m->t_read);
+        stage_add(ST_CHECK,  m->t_read,      g_broker.t_check);
+        stage_add(ST_FANOUT, g_broker.t_check, t_done);
+        stage_add(ST_TOTAL,  m->hdr.t_recv,  t_done);
+    }
+}
+
+// Is a whole frame waiting in a child's pipe?  The child writes each one with a
+// single writev() of at most PIPE_BUF (pipe_send()), which the kernel never
+// splits: if the header is there, so is the payload, and read_full() won't block.
+static int pipe_has_msg(int rfd) {
+    int n = 0;
+    return rfd != -1 && ioctl(rfd, FIONREAD, &n) == 0 && n >= (int)sizeof(msg_hdr_t);
+}
+
+// Reads one message from client i's pipe: commands are handled at once, chat
+// lines are queued in g_chat for the end of the pass.  Once a client has chat
+// queued, its commands and its leaving queue up behind it: they may overtake
+// other clients' broadcasts, never its own.  Returns the payload length, or
+// -1 if the child is gone or the frame was bad.
+static int pipe_read_one(int i, uint64_t t_pass, uint64_t t_wake) {
+    int rfd = pipe_rfds[i];
+    msg_hdr_t hdr;
+    ssize_t h = read_full(rfd, &hdr, sizeof(hdr));
+    if (h == 0) {
+        close(rfd); pipe_rfds[i] = -1;
+        if (!g_queued[i]) { client_gone(i); return -1; }
+        pending_msg_t *m = &g_chat[g_nchat++];
+        m->idx = i;
+        m->leave = 1;
+        return -1;
+    } else if (h < 0 || h != (ssize_t)sizeof(hdr)) {
+        return -1;
+    }
+    // Waiting out this client's own shedding rate is not broker lag.
+    if (hdr.t_recv > g_held[i]) overload_delay(&g_ovl, mono_ns() - hdr.t_recv);
+    g_next_read[i] = overload_next_read(&g_ovl, t_pass);
+    if (g_next_read[i]) metric_inc(M.throttled);
+
+    if (hdr.len <= 0 || hdr.len > MAX_MSG-1) { metric_inc(M.drop_frame); return -1; }
+
+    pending_msg_t *m = &g_chat[g_nchat];
+    if (read_full(rfd, m->msg, (size_t)hdr.len) != hdr.len) return -1;
+    m->msg[hdr.len] = '\0';
+    m->idx = i;
+    m->hdr = hdr;
+    m->t_read = g_stages ? mono_ns() : 0;
+    m->leave = 0;
+    PROBE2(msg_read, i, hdr.len);
+    if (hdr.kind == MSG_CHAT || g_queued[i]) { g_nchat++; g_queued[i] = 1; }
+    else handle_message(m, t_wake);
+    return hdr.len;
+}
+
+int main(int argc, char **argv) {
+    const char *capture_path = NULL, *flight_opts = NULL, *zdict_path = NULL;
+    const char *ctl_path = NULL, *takeover_path = NULL;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners
+    int metrics_port = 0, nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    busypoll_init(&g_busy);
+    presence_init(&g_presence);
+    overload_init(&g_ovl);
+    for (int ch; (ch = getopt(argc, argv, "c:tm:l:A:B:P:F:Z:O:U:T:")) != -1; ) {
+        if (ch == 'c') capture_path = optarg;
+        else if (ch == 'B' && busypoll_parse(&g_busy, optarg) == 0) continue;
+        else if (ch == 'P' && presence_parse(&g_presence, optarg) == 0) continue;
+        else if (ch == 'O' && overload_parse(&g_ovl, optarg) == 0) continue;
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0 && lo.shards == 1) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else if (ch == 'F') flight_opts = optarg;
+        else if (ch == 'Z') zdict_path = optarg;
+        else if (ch == 't') g_stages = 1;
+        else if (ch == 'm') metrics_port = atoi(optarg);
+        else if (ch == 'U') ctl_path = optarg;
+        else if (ch == 'T') takeover_path = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-c capture.trace] [-t] [-m metrics_port] "
+                            "[-l unix:PATH | -l seqpacket:PATH ...] [-A backlog=N,defer=S,fastopen=Q,steer=0|1] "
+                            "[-B spin=US,sock=US,prefer=0|1,cpu=N] [-P window=MS,max=N] "
+                            "[-F slots=N,slow=MS,gap=S,dir=PATH] [-Z dict | -Z off] "
+                            "[-O target=MS,window=MS,resume=PCT,hold=MS,rate=N | -O off] [-U ctl.sock | -T ctl.sock]\n", argv[0]);
+            exit(2);
+        }
+    }
+    listen_set_t ls;                  // TCP first, then -l; a takeover inherits all of them
+    handoff_hdr_t hh;
+    int ctl_fd = -1, takeover_sock = -1;
+    if (takeover_path) takeover_sock = take_over_begin(takeover_path, &hh, &ls, &ctl_fd);
+    else if (flight_init(flight_opts) < 0) { perror("flight recorder (-F)"); exit(2); }
+    metrics_setup();
+    if (zdict_path && !strcmp(zdict_path, "off")) g_zoff = 1;
+    else if (zdict_path && zdict_load(&g_zdict, zdict_path) < 0) { perror(zdict_path); exit(1); }
+    else if (!zdict_path) zdict_default(&g_zdict);
+    if (zdict_enc_init(&g_zenc, &g_zdict) < 0) { perror("compression"); exit(1); }
+    if (g_busy.spin_us > 0) {
+        g_busy.spin_wakeups  = metric_counter("chat_wakeups_total", "how=\"spin\"", "Broker select() returns with work");
+        g_busy.sleep_wakeups = metric_counter("chat_wakeups_total", "how=\"sleep\"", "Broker select() returns with work");
+    }
 
     for (int i = 0; i < MAX_CLIENTS; ++i) {
         client_fds[i] = -1; pipe_rfds[i] = -1; child_pids[i] = -1;
-        snprintf(nick[i], NICK_MAX, "user%d", i);
+        g_out[i].cur = -1;
+    }
+    broker_transport_t tp = { tp_send, tp_renamed, NULL };
+    if (broker_init(&g_broker, MAX_CLIENTS, &tp) < 0) { perror("broker"); exit(1); }
+    g_broker.presence  = &g_presence;
+    g_broker.chat_msgs = M.chat_msgs;
+    g_broker.cmd_msgs  = M.cmd_msgs;
+    g_broker.stamp     = g_stages;
+
+    if (takeover_path) {
+        take_over(takeover_sock, &hh, takeover_path);
+        ctl_path = takeover_path;
+        for (int i = 0; i < MAX_CLIENTS; i++) if (client_fds[i] != -1) busypoll_socket(client_fds[i], &g_busy);
+    } else {
+        // No shards: every client must land in this one broker.
+        int listen_fd = listen_tcp(PORT, &lo);
+        if (listen_fd < 0) { perror("listen"); exit(1); }
+
+        listen_set_init(&ls);
+        listen_set_add(&ls, listen_fd);
+        for (int k = 0; k < nlocal; k++)
+            if (listen_set_add_spec(&ls, local[k], lo.backlog) < 0) { perror(local[k]); exit(1); }
+        if (ctl_path && (ctl_fd = ctl_listen(ctl_path)) < 0) { perror(ctl_path); exit(1); }
+        if (!(g_sessions = shmtab_create(2 * MAX_CLIENTS, sizeof(session_t)))) { perror("session table"); exit(1); }
+    }
+
+    if (metrics_port) {
+        // After a takeover the old admin process may hold the port for a moment.
+        int tries = takeover_path ? 20 : 1;
+        while (metrics_serve(metrics_port) < 0) {
+            if (--tries == 0) { perror("metrics endpoint"); exit(1); }
+            usleep(100 * 1000);
+        }
+        printf("Metrics on http://127.0.0.1:%d/metrics\n", metrics_port);
+    }
+    if (capture_path) {
+        if (trace_open_write(&g_trace, capture_path) < 0) { perror(capture_path); exit(1); }
+        printf("Capturing inbound traffic to %s\n", capture_path);
     }
+    if (busypoll_pin(&g_busy) < 0) { perror("pin to cpu"); exit(1); }
+    if (busypoll_enabled(&g_busy))
+        printf("Low-latency loop: spin %d us, SO_BUSY_POLL %d us%s, cpu %d\n", g_busy.spin_us,
+               g_busy.sock_us, g_busy.prefer ? " (preferred)" : "", g_busy.cpu);
+
+    signal(SIGCHLD, SIG_IGN);         // reap children
+    signal(SIGINT,  on_sigint);       // graceful shutdown on Ctrl+C
+    if (g_stages) signal(SIGUSR1, on_sigusr1);   // dump stage histograms
+    signal(SIGUSR2, flight_on_signal);           // dump the flight recorder (children's events too)
+
+    printf("Chat server (Ex8) on %d … (Ctrl+C to shut down)\n", PORT);
+    if (!g_zoff) printf("Compression on request: deflate, dictionary %u (%zu bytes)\n", g_zdict.id, g_zdict.len);
+    for (int k = 1; k < ls.n; k++) printf("Also listening on %s\n", ls.path[k]);
+    if (ctl_fd != -1) printf("Hot restart: ./server -T %s\n", ctl_path);
 
     while (!g_shutdown) {
+        if (g_dump_stages) { g_dump_stages = 0; dump_stages(); }
+
         fd_set rfds; FD_ZERO(&rfds);
-        FD_SET(listen_fd, &rfds);
-        int maxfd = listen_fd;
+        int maxfd = -1;
+        for (int k = 0; k < ls.n; k++) {
+            FD_SET(ls.fd[k], &rfds);
+            if (ls.fd[k] > maxfd) maxfd = ls.fd[k];
+        }
+        if (ctl_fd != -1) {
+            FD_SET(ctl_fd, &rfds);
+            if (ctl_fd > maxfd) maxfd = ctl_fd;
+        }
 
+        fd_set wfds; FD_ZERO(&wfds);
+        uint64_t now = mono_ns(), wake = 0;
         for (int i = 0; i < MAX_CLIENTS; ++i) {
-            if (pipe_rfds[i] != -1) {
+            if (pipe_rfds[i] != -1 && g_next_read[i] > now) {      // over its shedding rate
+                if (!wake || g_next_read[i] < wake) wake = g_next_read[i];
+                g_held[i] = now;
+            } else if (pipe_rfds[i] != -1) {
                 FD_SET(pipe_rfds[i], &rfds);
                 if (pipe_rfds[i] > maxfd) maxfd = pipe_rfds[i];
             }
+            if (client_fds[i] != -1 && outq_pending(&g_out[i])) {
+                FD_SET(client_fds[i], &wfds);
+                if (client_fds[i] > maxfd) maxfd = client_fds[i];
+            }
         }
 
-        int ready = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+        struct timeval tv, tw;
+        int ready = busypoll_select(maxfd + 1, &rfds, &wfds,
+                                    overload_timeout(presence_timeout(&g_presence, &tv), wake, now, &tw), &g_busy);
         if (ready < 0) {
             if (errno == EINTR) continue;  // signal woke us; check g_shutdown
             perror("select"); continue;
         }
+        uint64_t t_pass = mono_ns();
+        uint64_t t_wake = g_stages ? t_pass : 0;
+        int shed = overload_update(&g_ovl, t_pass);
+        PROBE1(parent_wake, ready);
+        metric_set(M.ready_fds, ready);
 
-        // New connection?
-        if (FD_ISSET(listen_fd, &rfds)) {
-            struct sockaddr_in ca; socklen_t alen = sizeof(ca);
-            int cs = accept(listen_fd, (struct sockaddr*)&ca, &alen);
-            if (cs < 0) { perror("accept"); continue; }
-
-            int slot = -1;
-            for (int i = 0; i < MAX_CLIENTS; ++i) if (client_fds[i] == -1) { slot = i; break; }
-            if (slot == -1) {
-                const char *full = "Server full. Try later.\n";
-                send(cs, full, strlen(full), 0);
-                close(cs);
-            } else {
-                int pfd[2];
-                if (pipe(pfd) < 0) { perror("pipe"); close(cs); continue; }
-                pid_t pid = fork();
-                if (pid < 0) { perror("fork"); close(cs); close(pfd[0]); close(pfd[1]); continue; }
-
-                if (pid == 0) {
-                    // child
-                    close(listen_fd);
-                    close(pfd[0]);
-                    child_loop(cs, pfd[1], slot);
-                } else {
-                    // parent
-                    client_fds[slot] = cs;
-                    pipe_rfds[slot]  = pfd[0];
-                    child_pids[slot] = pid;
-                    close(pfd[1]);
-                    snprintf(nick[slot], NICK_MAX, "user%d", slot);
-                    active++;
-
-                    char join[128];
-                    int n = snprintf(join, sizeof(join), "%s joined. Active: %d\n", nick[slot], active);
-                    for (int k = 0; k < MAX_CLIENTS; ++k)
-                        if (client_fds[k] != -1) send(client_fds[k], join, (size_t)n, 0);
-                }
-            }
-        }
-
-        // Messages from children?
+        // Sockets that can take more of their queued output.  A dead one is
+        // shut down so its child sees EOF and the usual leave path runs.
         for (int i = 0; i < MAX_CLIENTS; ++i) {
-            int rfd = pipe_rfds[i];
-            if (rfd == -1 || !FD_ISSET(rfd, &rfds)) continue;
-
-            msg_hdr_t hdr;
-            ssize_t h = read_full(rfd, &hdr, sizeof(hdr));
-            if (h == 0) {
-                // child exited -> client gone
-                if (client_fds[i] != -1) {
-                    close(client_fds[i]); client_fds[i] = -1;
-                    active--;
-                    char leave[128];
-                    int n = snprintf(leave, sizeof(leave), "%s left. Active: %d\n", nick[i], active);
-                    for (int k = 0; k < MAX_CLIENTS; ++k)
-                        if (client_fds[k] != -1) send(client_fds[k], leave, (size_t)n, 0);
-                }
-                close(rfd); pipe_rfds[i] = -1;
-                continue;
-            } else if (h < 0 || h != (ssize_t)sizeof(hdr)) {
-                continue;
-            }
-
-            if (hdr.len <= 0 || hdr.len > MAX_MSG-1) { continue; }
-
-            char msg[MAX_MSG];
-            if (read_full(rfd, msg, (size_t)hdr.len) != hdr.len) continue;
-            msg[hdr.len] = '\0';
+            if (client_fds[i] == -1 || !FD_ISSET(client_fds[i], &wfds) || out_flush(i) == 0) continue;
+            flight_rec(FR_CLOSE, FR_WHY_SEND, (uint32_t)i, (uint32_t)errno, 0);
+            metric_inc(M.drop_send);
+            outq_reset(i);
+            shutdown(client_fds[i], SHUT_RDWR);
+        }
+        broker_flush_presence(&g_broker, 0);
 
-            // Handle commands (/nick, /who, /quit) in parent
-            if (!strncmp(msg, "/nick ", 6)) {
-                const char *newn = msg + 6;
-                char tmp[NICK_MAX]; strncpy(tmp, newn, NICK_MAX-1); tmp[NICK_MAX-1] = '\0';
-                trim(tmp);
-                if (tmp[0] == '\0') {
-                    const char *err = "Usage: /nick <name>\n";
-                    send(client_fds[i], err, strlen(err), 0);
+        // New connections?  Drain every ready listener (TCP or local) in one pass.
+        for (int k = 0; k < ls.n; k++) {
+            if (!FD_ISSET(ls.fd[k], &rfds)) continue;
+            int acc[ACCEPT_BATCH];
+            int nacc = listen_drain(ls.fd[k], acc, ACCEPT_BATCH, SOCK_CLOEXEC);
+            if (nacc < 0) { perror("accept"); continue; }
+            for (int a = 0; a < nacc; a++) {
+                int cs = acc[a];
+                int slot = -1;
+                for (int i = 0; i < MAX_CLIENTS; ++i) if (client_fds[i] == -1) { slot = i; break; }
+                if (shed) {
+                    const char *busy = "Server busy. Try later.\n";
+                    send(cs, busy, strlen(busy), MSG_NOSIGNAL);
+                    close(cs);
+                    metric_inc(M.busy);
+                    flight_rec(FR_CLOSE, FR_WHY_BUSY, FLIGHT_NO_CONN, 0, 0);
+                } else if (slot == -1) {
+                    const char *full = "Server full. Try later.\n";
+                    send(cs, full, strlen(full), 0);
+                    close(cs);
+                    metric_inc(M.rejected);
+                    flight_rec(FR_CLOSE, FR_WHY_FULL, FLIGHT_NO_CONN, 0, 0);
                 } else {
-                    char old[NICK_MAX]; strncpy(old, nick[i], NICK_MAX);
-                    strncpy(nick[i], tmp, NICK_MAX-1); nick[i][NICK_MAX-1] = '\0';
+                    busypoll_socket(cs, &g_busy);   // the child's recv() busy-polls too
+                    int lowat = NOTSENT_LOWAT;      // TCP only; AF_UNIX clients just skip it
+                    setsockopt(cs, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+                    int pfd[2];
+                    if (pipe(pfd) < 0) { perror("pipe"); close(cs); continue; }
+                    session_put(slot, broker_nick(&g_broker, slot), 0);  // before fork: the child finds itself
+                    flight_rec(FR_ACCEPT, 0, (uint32_t)slot, (uint32_t)cs, 0);
+                    pid_t pid = fork();
+                    if (pid < 0) {
+                        perror("fork"); close(cs); close(pfd[0]); close(pfd[1]);
+                        shmtab_del(g_sessions, (uint64_t)slot);
+                        continue;
+                    }
 
-                    char note[160];
-                    int n = snprintf(note, sizeof(note), "%s is now known as %s\n", old, nick[i]);
-                    for (int k = 0; k < MAX_CLIENTS; ++k)
-                        if (client_fds[k] != -1) send(client_fds[k], note, (size_t)n, 0);
-                }
-                continue;
-            } else if (!strcmp(msg, "/who")) {
-                // List users to requester only
-                char line[160];
-                int n = snprintf(line, sizeof(line), "Users (%d):\n", active);
-                send(client_fds[i], line, (size_t)n, 0);
-                for (int k = 0; k < MAX_CLIENTS; ++k) {
-                    if (client_fds[k] != -1) {
-                        n = snprintf(line, sizeof(line), " - %s\n", nick[k]);
-                        send(client_fds[i], line, (size_t)n, 0);
+                    if (pid == 0) {
+                        // child
+                        flight_forked();
+                        signal(SIGUSR1, SIG_IGN);   // histograms live in the parent
+                        busypoll_unpin();           // leave the pinned core to the broker
+                        if (lo.steer) listen_follow(cs);
+                        if (listen_cross_cpu(cs)) metric_inc(M.cross_cpu);
+                        listen_set_close(&ls);
+                        for (int b = a + 1; b < nacc; b++) close(acc[b]);   // not ours
+                        if (ctl_fd != -1) close(ctl_fd);
+                        close(pfd[0]);
+                        child_loop(cs, pfd[1], slot);
+                    } else {
+                        // parent
+                        client_fds[slot] = cs;
+                        pipe_rfds[slot]  = pfd[0];
+                        child_pids[slot] = pid;
+                        g_next_read[slot] = g_held[slot] = 0;
+                        close(pfd[1]);
+                        metric_inc(M.conns);
+                        metric_inc(M.active);
+                        trace_write(&g_trace, TR_JOIN, (unsigned)slot, NULL, 0);
+                        g_zc[slot] = 0;
+                        const char *hello =
+                            "Welcome! Commands: /nick <name>, /who, /help, /quit (or 'exit').\n";
+                        tp_send(NULL, slot, BROKER_LANE_CONTROL, hello, strlen(hello));
+                        broker_join(&g_broker, slot);      // + session table entry with the pid
                     }
                 }
-                continue;
-            } else if (!strcmp(msg, "/quit") || !strcmp(msg, "exit")) {
-                // Child will also exit; we’ll catch EOF on pipe next loop
-                // Send a small ack so client returns cleanly
-                const char *bye = "Goodbye.\n";
-                send(client_fds[i], bye, strlen(bye), 0);
-                continue;
             }
+        }
 
-            // Normal chat: broadcast to everyone except sender
-            char out[MAX_MSG + 64];
-            int n = snprintf(out, sizeof(out), "%s: %s\n", nick[i], msg);
-            for (int k = 0; k < MAX_CLIENTS; ++k) {
-                if (client_fds[k] != -1 && k != i) {
-                    (void)send(client_fds[k], out, (size_t)n, 0);
-                }
+        // Messages from children, in rounds: each round reads one message from
+        // every ready pipe whose turn is not used up (READ_MSGS or READ_BYTES).
+        // The start rotates over the ready clients: a pass begins right after
+        // the one that went first last time, or, if PASS_MSGS cut a round
+        // short, right after the last one that got a turn in it, so neither
+        // low slots nor the front of the order are favoured.  Every chat line
+        // is a broadcast, so a long pass is what a light user waits behind:
+        // the first round always runs, more only until the pass has read
+        // PASS_MSGS.  A few busy clients are drained in fewer select() calls;
+        // many are read one message each.
+        // What is left stays in the pipe; select() reports it again next pass.
+        // Commands and replies are handled as they are read; chat lines wait
+        // until the pass is over, so interactive traffic never queues behind
+        // other clients' broadcasts (pipe_read_one() keeps each client's own
+        // order).
+        static int order[MAX_CLIENTS];
+        static size_t taken[MAX_CLIENTS];
+        int nready = 0, nread = 0, last = -1, cut = 0;
+        for (int k = 0; k < MAX_CLIENTS; ++k) {
+            int i = (g_rr + k) % MAX_CLIENTS;
+            if (pipe_rfds[i] == -1 || !FD_ISSET(pipe_rfds[i], &rfds)) continue;
+            order[nready++] = i;
+            taken[i] = 0;
+            g_queued[i] = 0;
+        }
+        int first = nready ? order[0] : -1;
+        g_nchat = 0;
+        for (int round = 0; round < READ_MSGS && nready > 0; round++) {
+            int keep = 0;
+            for (int k = 0; k < nready; k++) {
+                int i = order[k];
+                if (round > 0 && (nread >= PASS_MSGS || g_nchat == MAX_CLIENTS)) { order[keep++] = i; cut = 1; continue; }
+                if (round > 0 && !pipe_has_msg(pipe_rfds[i])) continue;
+                int len = pipe_read_one(i, t_pass, t_wake);
+                nread++;
+                if (!cut) last = i;
+                if (len < 0 || g_next_read[i]) continue;        // gone, or over its shedding rate
+                taken[i] += (size_t)len;
+                if (taken[i] < READ_BYTES) order[keep++] = i;
+                else if (pipe_has_msg(pipe_rfds[i])) metric_inc(M.budget_out);
             }
+            nready = keep;
+            if (nread >= PASS_MSGS) break;
+        }
+        if (first >= 0) g_rr = ((cut ? last : first) + 1) % MAX_CLIENTS;
+        for (int k = 0; k < nready; k++)
+            if (pipe_has_msg(pipe_rfds[order[k]])) metric_inc(M.budget_out);
+        for (int k = 0; k < g_nchat; k++) handle_message(&g_chat[k], t_wake);
+        uint64_t pass_ns = mono_ns() - t_pass;
+        flight_slow(FR_OP_PASS, FLIGHT_NO_CONN, pass_ns);
+        overload_lag(&g_ovl, pass_ns);
+
+        // Hot restart?  Checked after the message pass so no message is half read;
+        // held presence notices go out first, the new server starts with none.
+        if (ctl_fd != -1 && FD_ISSET(ctl_fd, &rfds)) broker_flush_presence(&g_broker, 1);
+        if (ctl_fd != -1 && FD_ISSET(ctl_fd, &rfds) && handoff(ctl_fd, &ls)) {
+            g_handed_off = 1;
+            break;
         }
     }
 
-    // Graceful shutdown
-    const char *shutdown_msg = "\n*** Server shutting down ***\n";
+    // Graceful shutdown (after a handoff the sockets live on in the new server)
+    if (!g_handed_off) {
+        const char *shutdown_msg = "\n*** Server shutting down ***\n";
+        flight_rec(FR_CLOSE, FR_WHY_SHUTDOWN, FLIGHT_NO_CONN, 0, (uint32_t)g_broker.active);
+        for (int i = 0; i < MAX_CLIENTS; ++i)
+            tp_send(NULL, i, BROKER_LANE_CONTROL, shutdown_msg, strlen(shutdown_msg));
+        out_drain(1000);
+    }
     for (int i = 0; i < MAX_CLIENTS; ++i) {
-        if (client_fds[i] != -1) {
-            send(client_fds[i], shutdown_msg, strlen(shutdown_msg), 0);
-            close(client_fds[i]); client_fds[i] = -1;
-        }
+        if (client_fds[i] != -1) { close(client_fds[i]); client_fds[i] = -1; }
         if (pipe_rfds[i] != -1) { close(pipe_rfds[i]); pipe_rfds[i] = -1; }
     }
-    close(listen_fd);
+    listen_set_close(&ls);
+    if (!g_handed_off) listen_set_unlink(&ls);
+    if (ctl_fd != -1) {
+        close(ctl_fd);
+        if (!g_handed_off) unlink(ctl_path);
+    }
+    if (g_stages) dump_stages();
+    if (g_trace.f) {
+        printf("Captured %llu records.\n", (unsigned long long)g_trace.records);
+        trace_close_write(&g_trace);
+    }
     printf("Server stopped.\n");
     return 0;
 }
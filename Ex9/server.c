@@ -0,0 +1,736 @@
+// server.c — Exercise 9 (C): sharded multi-threaded chat broker
+//
+// Ex8 funnels every broadcast through one parent process, so it tops out at
+// one core.  Here clients are spread over N broker threads ("shards"), each
+// with its own SO_REUSEPORT listener and epoll loop; a shard only ever reads
+// and writes its own clients.  A broadcast is stamped with a global sequence
+// number (one atomic add) and pushed onto every shard's lock-free MPSC queue;
+// each shard delivers strictly in sequence order, holding back anything that
+// overtook an earlier number, so every user sees joins, leaves, nick changes
+// and chat lines in the same order no matter which shard they are on.
+//
+// An idle client costs a ~100-byte handle (from a per-shard slab) plus its
+// table entries.  Read and write buffers come from the shard's buffer pool
+// only while data is in flight: the read buffer goes back once a read drains
+// the socket with no partial line left, the write buffer once the socket has
+// taken everything.  chat_conn_bytes_avg reports what that adds up to.
+//
+// Same protocol and commands as Ex8; ../Ex7/client works unchanged.
+//
+// Build: gcc -Wall -Wextra -O2 -pthread server.c ../common/scan.c ../common/metrics.c
+//            ../common/listen.c ../common/pool.c ../common/netio.c -o server
+// Run:   ./server [-m metrics_port] [-A shards=N,backlog=N,defer=S,fastopen=Q,steer=0|1]
+//                 [-l unix:PATH | -l seqpacket:PATH ...]
+//        shards defaults to the number of online CPUs; -l listeners belong to shard 0.
+//        steer=1 pins shard k to the k-th CPU and has the kernel give it the
+//        connections whose packets that CPU processes (SO_INCOMING_CPU), so a
+//        client is read, parsed and written on the core that already has its
+//        socket in cache; its buffers come from pages on that core's NUMA node.
+//        Up to MAX_CONNS clients in all; raise `ulimit -n` to match.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "../common/scan.h"
+#include "../common/metrics.h"
+#include "../common/netio.h"
+#include "../common/listen.h"
+#include "../common/mpsc.h"
+#include "../common/pool.h"
+
+#define PORT 8080
+#define MAX_SHARDS  64
+#define MAX_CONNS   (1 << 20)     // clients over all shards
+#define MAX_MSG     1024
+#define NICK_MAX    32
+#define RECV_BUF    4096          // borrowed per read; holds many pipelined lines
+#define READ_LINES  16            // lines handled per client per turn (spans per scan_lines() call)
+#define OUT_MAX     (1 << 20)     // a client this far behind starts losing messages
+                                  // (beyond BUFPOOL_MAX_SIZE the buffer is malloc()ed)
+#define WHO_MAX     (OUT_MAX / 2) // /who lists this many bytes of nicks, then counts the rest
+#define EPOLL_BATCH 64
+#define WAKE_TAG    LISTEN_MAX    // epoll data: < LISTEN_MAX listener, this = wake-up, else conn_t*
+
+// One broadcast, shared by every shard until the last one has delivered it.
+typedef struct {
+    uint64_t    seq;
+    int         refs;             // shards that have not delivered it yet
+    int         skip;             // client id that does not get it (-1 = nobody)
+    size_t      len;
+    char       *data;             // follows the links in the same allocation
+    mpsc_node_t link[];           // link[j] sits on shard j's queue
+} bcast_t;
+
+// Everything an idle client holds; keep it small.
+typedef struct {
+    int      fd, id, slot, pos;   // pos: index in the shard's live[]
+    int      line_mode;           // set once the client has sent a '\n'
+    uint32_t have;                // bytes in `in`
+    char     nick[NICK_MAX];
+    char    *in;                  // RECV_BUF from the pool, NULL between reads
+    char    *out;                 // bytes the socket would not take yet; NULL when none
+    uint32_t out_off, out_len, out_cap;
+    int      queued;              // 1 + index in the shard's backlog[]; 0 if not there
+} conn_t;
+
+// Per-client bytes outside the handle itself: slots[], live[], backlog[],
+// free_slots[].
+#define CONN_TABLE_BYTES (3 * sizeof(conn_t*) + sizeof(int))
+
+typedef struct {
+    int          idx;
+    int          cpu;             // pinned here with steer=1, else -1
+    pthread_t    tid;
+    int          ep, wake_fd;
+    int          sleeping;        // in epoll_wait(): producers must kick wake_fd
+    listen_set_t ls;
+    mpsc_queue_t q;
+    uint64_t     next_seq;        // next broadcast this shard may deliver
+    bcast_t    **held;            // min-heap by seq: arrived ahead of next_seq
+    size_t       nheld, held_cap;
+    conn_t     **slots;           // [g_shard_conns], by slot
+    conn_t     **live;            // [nlive], for fan-out and /who
+    pthread_mutex_t roster_mu;    // live[] and nicks, as other shards' /who reads them
+    conn_t     **backlog;         // [nback]: whole lines left over when their turn ran out
+    int         *free_slots;      // stack of slots given back
+    int          nlive, nfree, nback;
+    int          next_slot;       // slots from here on were never used
+    slab_t       conns;           // conn_t handles
+    bufpool_t    bufs;            // in/out buffers while data is in flight
+    int64_t      mem, mem_published;   // bytes held for clients; last added to M.conn_bytes
+} shard_t;
+
+static shard_t  g_shards[MAX_SHARDS];
+static int      g_nshards;
+static int      g_shard_conns;    // MAX_CONNS / shards
+static uint64_t g_seq;            // the one global broadcast order
+static int      g_active;         // clients on all shards
+static int      g_stop;
+
+static struct {
+    metric_t *conns, *active, *rejected, *chat_msgs, *cmd_msgs;
+    metric_t *bytes_in, *bytes_out, *deliveries, *drop_send, *held;
+    metric_t *conn_bytes, *conn_bytes_avg, *cross_cpu, *budget_out;
+} M;
+
+static void metrics_setup(void) {
+    metrics_init();
+    M.conns      = metric_counter("chat_connections_total", NULL, "Accepted client connections");
+    M.active     = metric_gauge("chat_connections_active", NULL, "Currently connected clients");
+    M.rejected   = metric_counter("chat_rejected_total", NULL, "Connections turned away (shard full)");
+    M.chat_msgs  = metric_counter("chat_messages_total", "kind=\"chat\"", "Inbound messages by kind");
+    M.cmd_msgs   = metric_counter("chat_messages_total", "kind=\"command\"", "Inbound messages by kind");
+    M.bytes_in   = metric_counter("chat_bytes_in_total", NULL, "Bytes received from clients");
+    M.bytes_out  = metric_counter("chat_bytes_out_total", NULL, "Bytes sent to clients");
+    M.deliveries = metric_counter("chat_deliveries_total", NULL, "Messages handed to a recipient socket");
+    M.drop_send  = metric_counter("chat_dropped_total", "reason=\"send\"", "Messages not delivered");
+    M.held       = metric_counter("chat_reordered_total", NULL, "Broadcasts held back behind an earlier sequence number");
+    M.conn_bytes = metric_gauge("chat_conn_bytes", NULL, "User-space memory held for clients: handles, tables, borrowed buffers");
+    M.conn_bytes_avg = metric_gauge("chat_conn_bytes_avg", NULL, "chat_conn_bytes per connected client");
+    M.budget_out = metric_counter("chat_read_budget_spent_total", NULL,
+                                  "Turns that ended with whole lines still buffered for the client");
+    M.cross_cpu  = metric_counter("chat_cross_cpu_connections_total", NULL,
+                                  "Clients accepted on another CPU than the one processing their packets");
+}
+
+// --- Cross-shard broadcast ----------------------------------------------------
+
+static void kick(shard_t *sh) {
+    // Pairs with the fence in shard_main(): either it sees our push, or we
+    // see it asleep.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&sh->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(sh->wake_fd, &one, sizeof(one)) < 0) { /* counter saturated: a wake-up is pending anyway */ }
+    }
+}
+
+// Stamp buf with the next sequence number and queue it on every shard.
+static void publish(const shard_t *self, const char *buf, size_t len, int skip) {
+    bcast_t *b = (bcast_t*)malloc(sizeof(*b) + (size_t)g_nshards * sizeof(mpsc_node_t) + len);
+    if (!b) { perror("broadcast"); return; }
+    b->refs = g_nshards;
+    b->skip = skip;
+    b->len = len;
+    b->data = (char*)&b->link[g_nshards];
+    memcpy(b->data, buf, len);
+    b->seq = __atomic_fetch_add(&g_seq, 1, __ATOMIC_RELAXED);
+    for (int j = 0; j < g_nshards; j++) {
+        mpsc_push(&g_shards[j].q, &b->link[j]);
+        if (j != self->idx) kick(&g_shards[j]);   // our own queue is drained before we sleep
+    }
+}
+
+static void held_push(shard_t *sh, bcast_t *b) {
+    if (sh->nheld == sh->held_cap) {
+        size_t cap = sh->held_cap ? sh->held_cap * 2 : 64;
+        bcast_t **h = (bcast_t**)realloc(sh->held, cap * sizeof(*h));
+        if (!h) { perror("reorder heap"); exit(1); }   // losing it would stall this shard for good
+        sh->held = h;
+        sh->held_cap = cap;
+    }
+    size_t i = sh->nheld++;
+    while (i && sh->held[(i - 1) / 2]->seq > b->seq) { sh->held[i] = sh->held[(i - 1) / 2]; i = (i - 1) / 2; }
+    sh->held[i] = b;
+}
+
+static bcast_t *held_pop(shard_t *sh) {
+    bcast_t *top = sh->held[0], *last = sh->held[--sh->nheld];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= sh->nheld) break;
+        if (c + 1 < sh->nheld && sh->held[c + 1]->seq < sh->held[c]->seq) c++;
+        if (sh->held[c]->seq >= last->seq) break;
+        sh->held[i] = sh->held[c];
+        i = c;
+    }
+    if (sh->nheld) sh->held[i] = last;
+    return top;
+}
+
+static void conn_send(shard_t *sh, conn_t *c, const char *p, size_t n);
+
+static void deliver(shard_t *sh, bcast_t *b) {
+    for (int k = 0; k < sh->nlive; k++)
+        if (sh->live[k]->id != b->skip) conn_send(sh, sh->live[k], b->data, b->len);
+    sh->next_seq++;
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) free(b);
+}
+
+static void drain_broadcasts(shard_t *sh) {
+    mpsc_node_t *n;
+    while ((n = mpsc_pop(&sh->q)) != NULL) {
+        bcast_t *b = (bcast_t*)((char*)(n - sh->idx) - offsetof(bcast_t, link));
+        if (b->seq != sh->next_seq) { held_push(sh, b); metric_inc(M.held); continue; }
+        deliver(sh, b);
+        while (sh->nheld && sh->held[0]->seq == sh->next_seq) deliver(sh, held_pop(sh));
+    }
+}
+
+// --- Client sockets -------------------------------------------------------------
+
+static void want_write(shard_t *sh, conn_t *c, int on) {
+    struct epoll_event ev = { .events = EPOLLIN | (on ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(sh->ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// --- Borrowed buffers -------------------------------------------------------------
+
+static void in_release(shard_t *sh, conn_t *c) {
+    if (!c->in) return;
+    bufpool_put(&sh->bufs, c->in, RECV_BUF);
+    sh->mem -= RECV_BUF;
+    c->in = NULL;
+    c->have = 0;
+}
+
+static void out_release(shard_t *sh, conn_t *c) {
+    if (!c->out) return;
+    if (c->out_cap <= BUFPOOL_MAX_SIZE) bufpool_put(&sh->bufs, c->out, c->out_cap);
+    else free(c->out);
+    sh->mem -= c->out_cap;
+    c->out = NULL;
+    c->out_off = c->out_len = c->out_cap = 0;
+}
+
+// Room for n more output bytes: compact, or move to the next size class (to
+// malloc() past the largest).  0, or -1 if out of memory.
+static int out_reserve(shard_t *sh, conn_t *c, size_t n) {
+    size_t pending = c->out_len - c->out_off;
+    if (c->out_len + n <= c->out_cap) return 0;
+    if (pending + n <= c->out_cap) {
+        memmove(c->out, c->out + c->out_off, pending);
+        c->out_off = 0;
+        c->out_len = (uint32_t)pending;
+        return 0;
+    }
+    size_t want = pending + n, cap;
+    char *o;
+    if (want <= BUFPOOL_MAX_SIZE) {
+        o = (char*)bufpool_get(&sh->bufs, want, &cap);
+    } else {
+        for (cap = 2 * BUFPOOL_MAX_SIZE; cap < want; cap *= 2) { }
+        o = (char*)malloc(cap);
+    }
+    if (!o) return -1;
+    memcpy(o, c->out + c->out_off, pending);
+    out_release(sh, c);
+    c->out = o;
+    c->out_len = (uint32_t)pending;
+    c->out_cap = (uint32_t)cap;
+    sh->mem += (int64_t)cap;
+    return 0;
+}
+
+// Add this shard's change in client memory to the global gauge and refresh
+// the per-client average.  Once per loop pass, and only if something moved.
+static void publish_mem(shard_t *sh) {
+    if (sh->mem == sh->mem_published) return;
+    int64_t total = __atomic_add_fetch(&M.conn_bytes->value, sh->mem - sh->mem_published, __ATOMIC_RELAXED);
+    sh->mem_published = sh->mem;
+    int active = __atomic_load_n(&g_active, __ATOMIC_RELAXED);
+    metric_set(M.conn_bytes_avg, active > 0 ? total / active : 0);
+}
+
+// Straight to the socket when nothing is queued; the rest waits for EPOLLOUT.
+static void conn_send(shard_t *sh, conn_t *c, const char *p, size_t n) {
+    if (c->out_off == c->out_len) {
+        ssize_t w = send_nb(c->fd, p, n);
+        if (w < 0) { metric_inc(M.drop_send); return; }
+        if (w > 0) { metric_add(M.bytes_out, w); p += w; n -= (size_t)w; }
+        if (n == 0) { metric_inc(M.deliveries); return; }
+    }
+    size_t pending = c->out_len - c->out_off;
+    if (pending + n > OUT_MAX || out_reserve(sh, c, n) < 0) { metric_inc(M.drop_send); return; }
+    memcpy(c->out + c->out_len, p, n);
+    c->out_len += (uint32_t)n;
+    metric_inc(M.deliveries);
+    if (pending == 0) want_write(sh, c, 1);
+}
+
+// Returns -1 if the connection is dead.
+static int conn_flush(shard_t *sh, conn_t *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t w = send_nb(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+        if (w <= 0) return (int)w;
+        metric_add(M.bytes_out, w);
+        c->out_off += (uint32_t)w;
+    }
+    out_release(sh, c);                            // caught up: back to the pool
+    want_write(sh, c, 0);
+    return 0;
+}
+
+static void conn_open(shard_t *sh, int fd) {
+    int slot = sh->nfree ? sh->free_slots[--sh->nfree] : sh->next_slot < g_shard_conns ? sh->next_slot++ : -1;
+    conn_t *c = slot < 0 ? NULL : (conn_t*)slab_alloc(&sh->conns);
+    if (!c) {
+        if (slot >= 0) sh->free_slots[sh->nfree++] = slot;
+        const char *full = "Server full. Try later.\n";
+        send(fd, full, strlen(full), MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(fd);
+        metric_inc(M.rejected);
+        return;
+    }
+    if (listen_cross_cpu(fd)) metric_inc(M.cross_cpu);
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->slot = slot;
+    c->id = sh->idx * g_shard_conns + c->slot;
+    snprintf(c->nick, NICK_MAX, "user%d", c->id);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (epoll_ctl(sh->ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(fd);
+        sh->free_slots[sh->nfree++] = c->slot;
+        slab_free(&sh->conns, c);
+        return;
+    }
+    sh->slots[c->slot] = c;
+    sh->mem += (int64_t)(sh->conns.obj_size + CONN_TABLE_BYTES);
+    pthread_mutex_lock(&sh->roster_mu);
+    c->pos = sh->nlive;
+    sh->live[sh->nlive++] = c;
+    pthread_mutex_unlock(&sh->roster_mu);
+    int active = __atomic_add_fetch(&g_active, 1, __ATOMIC_RELAXED);
+    metric_inc(M.conns);
+    metric_inc(M.active);
+
+    const char *hello = "Welcome! Commands: /nick <name>, /who, /help, /quit (or 'exit').\n";
+    conn_send(sh, c, hello, strlen(hello));
+    char join[128];
+    int n = snprintf(join, sizeof(join), "%s joined. Active: %d\n", c->nick, active);
+    publish(sh, join, (size_t)n, -1);
+}
+
+// The backlog is unordered, like live[]: every client on it gets one turn
+// per loop pass, which is all the fairness it needs.
+static void backlog_add(shard_t *sh, conn_t *c) {
+    if (c->queued) return;
+    sh->backlog[sh->nback++] = c;
+    c->queued = sh->nback;
+}
+
+static void backlog_del(shard_t *sh, conn_t *c) {
+    if (!c->queued) return;
+    conn_t *last = sh->backlog[--sh->nback];
+    sh->backlog[c->queued - 1] = last;
+    last->queued = c->queued;
+    c->queued = 0;
+}
+
+static void conn_close(shard_t *sh, conn_t *c) {
+    close(c->fd);                                  // also drops it from the epoll set
+    backlog_del(sh, c);
+    sh->slots[c->slot] = NULL;
+    sh->free_slots[sh->nfree++] = c->slot;
+    pthread_mutex_lock(&sh->roster_mu);
+    sh->live[c->pos] = sh->live[--sh->nlive];
+    sh->live[c->pos]->pos = c->pos;
+    pthread_mutex_unlock(&sh->roster_mu);
+    int active = __atomic_sub_fetch(&g_active, 1, __ATOMIC_RELAXED);
+    metric_dec(M.active);
+
+    char leave[128];
+    int n = snprintf(leave, sizeof(leave), "%s left. Active: %d\n", c->nick, active);
+    publish(sh, leave, (size_t)n, -1);
+    in_release(sh, c);
+    out_release(sh, c);
+    sh->mem -= (int64_t)(sh->conns.obj_size + CONN_TABLE_BYTES);
+    slab_free(&sh->conns, c);
+}
+
+// --- Commands -------------------------------------------------------------------
+
+static void cmd_nick(shard_t *sh, conn_t *c, const char *arg) {
+    char tmp[NICK_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", arg);
+    if (tmp[0] == '\0') {
+        const char *err = "Usage: /nick <name>\n";
+        conn_send(sh, c, err, strlen(err));
+        return;
+    }
+    char note[160];
+    int n = snprintf(note, sizeof(note), "%s is now known as %s\n", c->nick, tmp);
+    pthread_mutex_lock(&sh->roster_mu);
+    memcpy(c->nick, tmp, NICK_MAX);
+    pthread_mutex_unlock(&sh->roster_mu);
+    publish(sh, note, (size_t)n, -1);
+}
+
+static void cmd_who(shard_t *sh, conn_t *c, const char *arg) {
+    (void)arg;
+    // One shard at a time, each under its own lock and only for as long as
+    // it takes to copy its live clients' nicks: joins and leaves elsewhere
+    // never wait on it.  Sent after the last unlock, so a slow client holds
+    // none.  Past WHO_MAX (more than the output queue would take) the rest
+    // are only counted.
+    static __thread char *list;
+    static __thread size_t cap;
+    size_t len = 0;
+    int users = 0, more = 0;
+    for (int j = 0; j < g_nshards; j++) {
+        shard_t *o = &g_shards[j];
+        pthread_mutex_lock(&o->roster_mu);
+        for (int k = 0; k < o->nlive; k++) {
+            users++;
+            if (len + NICK_MAX + 4 > WHO_MAX) { more++; continue; }
+            if (len + NICK_MAX + 4 > cap) {
+                size_t ncap = cap ? cap * 2 : 4096;
+                char *l = (char*)realloc(list, ncap);
+                if (!l) { more++; continue; }
+                list = l;
+                cap = ncap;
+            }
+            len += (size_t)snprintf(list + len, cap - len, " - %s\n", o->live[k]->nick);
+        }
+        pthread_mutex_unlock(&o->roster_mu);
+    }
+
+    char line[64];
+    int n = snprintf(line, sizeof(line), "Users (%d):\n", users);
+    conn_send(sh, c, line, (size_t)n);
+    if (len) conn_send(sh, c, list, len);
+    if (more) {
+        n = snprintf(line, sizeof(line), " ... and %d more\n", more);
+        conn_send(sh, c, line, (size_t)n);
+    }
+}
+
+static void cmd_quit(shard_t *sh, conn_t *c, const char *arg) {
+    (void)arg;
+    const char *bye = "Goodbye.\n";
+    conn_send(sh, c, bye, strlen(bye));
+}
+
+static void cmd_help(shard_t *sh, conn_t *c, const char *arg);
+
+typedef struct {
+    const char *name;     // without the leading '/'
+    void (*fn)(shard_t *sh, conn_t *c, const char *arg);
+    const char *usage;    // shown by /help
+} command_t;
+
+static const command_t COMMANDS[] = {
+    { "nick", cmd_nick, "/nick <name>  change your nickname" },
+    { "who",  cmd_who,  "/who          list connected users" },
+    { "quit", cmd_quit, "/quit         leave (same as 'exit')" },
+    { "help", cmd_help, "/help         show this list" },
+};
+#define NUM_COMMANDS (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+
+static void cmd_help(shard_t *sh, conn_t *c, const char *arg) {
+    (void)arg;
+    char line[160];
+    for (size_t k = 0; k < NUM_COMMANDS; ++k) {
+        int n = snprintf(line, sizeof(line), "%s\n", COMMANDS[k].usage);
+        conn_send(sh, c, line, (size_t)n);
+    }
+}
+
+// One line from client c.  Returns 1 if the client asked to leave.
+static int dispatch(shard_t *sh, conn_t *c, const char *p, size_t len) {
+    char msg[MAX_MSG];
+    if (len >= sizeof(msg)) len = sizeof(msg) - 1;
+    memcpy(msg, p, len);
+    msg[len] = '\0';
+
+    if (msg[0] != '/') {
+        if (!strcmp(msg, "exit")) { cmd_quit(sh, c, ""); return 1; }
+        metric_inc(M.chat_msgs);
+        char out[MAX_MSG + 64];
+        int n = snprintf(out, sizeof(out), "%s: %s\n", c->nick, msg);
+        publish(sh, out, (size_t)n, c->id);
+        return 0;
+    }
+
+    const char *word = msg + 1;
+    size_t wlen = strcspn(word, " ");
+    const char *arg = word + wlen;
+    while (*arg == ' ') arg++;
+    metric_inc(M.cmd_msgs);
+    for (size_t k = 0; k < NUM_COMMANDS; k++) {
+        if (strlen(COMMANDS[k].name) == wlen && !memcmp(COMMANDS[k].name, word, wlen)) {
+            COMMANDS[k].fn(sh, c, arg);
+            return COMMANDS[k].fn == cmd_quit;
+        }
+    }
+    char err[96];
+    int n = snprintf(err, sizeof(err), "Unknown command: /%.*s (try /help)\n",
+                     (int)(wlen < 32 ? wlen : 32), word);
+    conn_send(sh, c, err, (size_t)n);
+    return 0;
+}
+
+// One turn for client c: at most READ_LINES of the lines in its buffer.  If
+// whole lines are left it goes on the backlog and the loop comes back to it
+// next pass, after everyone else ready then has had a turn, so one client
+// pipelining a full buffer cannot hold up the rest of its shard.  drained:
+// the socket is known to be empty.  Returns -1 once the connection is gone
+// (closed here).
+static int conn_lines(shard_t *sh, conn_t *c, int drained) {
+    span_t lines[READ_LINES];
+    size_t off, k = scan_lines(c->in, c->have, lines, READ_LINES, &off);
+    int quit = 0;
+    if (k) c->line_mode = 1;
+    for (size_t j = 0; j < k && !quit; j++) quit = dispatch(sh, c, lines[j].p, lines[j].len);
+
+    size_t tail = c->have - off;
+    if (!quit && k == READ_LINES && memchr(c->in + off, '\n', tail)) {
+        metric_inc(M.budget_out);
+        memmove(c->in, c->in + off, tail);
+        c->have = (uint32_t)tail;
+        backlog_add(sh, c);
+        return 0;
+    }
+    backlog_del(sh, c);
+
+    // Unterminated tail: same rule as Ex8 — one message per recv() for
+    // clients that never send '\n', otherwise wait for the rest of the line.
+    if (!quit && tail && (!c->line_mode || tail == RECV_BUF)) {
+        size_t len = tail;
+        if (c->in[off + len - 1] == '\r') len--;
+        quit = dispatch(sh, c, c->in + off, len);
+        tail = 0;
+    }
+    if (quit) { conn_flush(sh, c); conn_close(sh, c); return -1; }
+    memmove(c->in, c->in + off, tail);
+    c->have = (uint32_t)tail;
+    // Without a partial line to keep, the buffer goes back until the client
+    // says something again (if the socket was not drained, EPOLLIN says so).
+    if (tail == 0 && drained) in_release(sh, c);
+    return 0;
+}
+
+// Returns -1 once the connection is gone (closed here).
+static int conn_read(shard_t *sh, conn_t *c) {
+    if (!c->in) {
+        if (!(c->in = (char*)bufpool_get(&sh->bufs, RECV_BUF, NULL))) { perror("recv buffer"); conn_close(sh, c); return -1; }
+        sh->mem += RECV_BUF;
+    }
+    size_t room = RECV_BUF - c->have;
+    ssize_t n = recv(c->fd, c->in + c->have, room, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        if (c->have == 0) in_release(sh, c);
+        return 0;
+    }
+    if (n <= 0) { conn_close(sh, c); return -1; }
+    metric_add(M.bytes_in, n);
+    c->have += (size_t)n;
+    // A short read means the socket is drained.
+    return conn_lines(sh, c, (size_t)n < room);
+}
+
+// --- Shard thread ----------------------------------------------------------------
+
+static void *shard_main(void *arg) {
+    shard_t *sh = (shard_t*)arg;
+    struct epoll_event evs[EPOLL_BATCH];
+    // Pinned before it touches anything: its tables and pool chunks are only
+    // faulted in from here on, so they land on this CPU's node.
+    if (sh->cpu >= 0 && listen_pin(sh->cpu) < 0) fprintf(stderr, "shard %d: cannot pin to CPU %d\n", sh->idx, sh->cpu);
+
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        // With a backlog there is work to get back to: poll, don't sleep.
+        int idle = sh->nback == 0;
+        if (idle) {
+            __atomic_store_n(&sh->sleeping, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+        drain_broadcasts(sh);                     // anything pushed before we said so
+
+        int n = epoll_wait(sh->ep, evs, EPOLL_BATCH, idle ? -1 : 0);
+        __atomic_store_n(&sh->sleeping, 0, __ATOMIC_RELAXED);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); break; }
+
+        // Clients queued before this pass get their next turn after the new
+        // events; one queued during it already had its turn.  Going down from
+        // the end, backlog_del() only moves entries already seen.
+        int queued = sh->nback;
+
+        for (int e = 0; e < n; e++) {
+            uint64_t tag = evs[e].data.u64;
+            if (tag == WAKE_TAG) {
+                uint64_t cnt;
+                if (read(sh->wake_fd, &cnt, sizeof(cnt)) < 0) { /* spurious */ }
+            } else if (tag < LISTEN_MAX) {
+                int acc[ACCEPT_BATCH];
+                int got = listen_drain(sh->ls.fd[tag], acc, ACCEPT_BATCH, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (got < 0) perror("accept");
+                for (int a = 0; a < got; a++) conn_open(sh, acc[a]);
+            } else {
+                conn_t *c = (conn_t*)evs[e].data.ptr;
+                if ((evs[e].events & EPOLLOUT) && conn_flush(sh, c) < 0) { conn_close(sh, c); continue; }
+                if ((evs[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c->queued) conn_read(sh, c);
+            }
+        }
+        for (int k = (queued < sh->nback ? queued : sh->nback) - 1; k >= 0; k--) conn_lines(sh, sh->backlog[k], 0);
+        drain_broadcasts(sh);
+        publish_mem(sh);
+    }
+
+    const char *bye = "\n*** Server shutting down ***\n";
+    for (int k = 0; k < sh->nlive; k++) {
+        send(sh->live[k]->fd, bye, strlen(bye), MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(sh->live[k]->fd);
+    }
+    listen_set_close(&sh->ls);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int metrics_port = 0;
+    const char *local[LISTEN_MAX];           // -l: extra AF_UNIX listeners (shard 0)
+    int nlocal = 0;
+    listen_opts_t lo;
+    listen_opts_init(&lo);
+    lo.shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (int ch; (ch = getopt(argc, argv, "m:l:A:")) != -1; ) {
+        if (ch == 'm') metrics_port = atoi(optarg);
+        else if (ch == 'A' && listen_opts_parse(&lo, optarg) == 0) continue;
+        else if (ch == 'l' && nlocal < LISTEN_MAX - 1) local[nlocal++] = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-m metrics_port] [-A shards=N,backlog=N,defer=S,fastopen=Q,steer=0|1] "
+                            "[-l unix:PATH | -l seqpacket:PATH ...]\n", argv[0]);
+            exit(2);
+        }
+    }
+    if (lo.shards < 1) lo.shards = 1;
+    if (lo.shards > MAX_SHARDS) lo.shards = MAX_SHARDS;
+    g_nshards = lo.shards;
+    int pool_flags = lo.steer ? POOL_LOCAL : 0;
+    g_shard_conns = (MAX_CONNS + g_nshards - 1) / g_nshards;
+
+    // Every client is an fd; take whatever the hard limit allows.
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // Before any thread exists: the metrics endpoint is a forked process.
+    metrics_setup();
+    if (metrics_port && metrics_serve(metrics_port) < 0) { perror("metrics endpoint"); exit(1); }
+
+    // Shards get SIGINT/SIGTERM blocked (inherited); main waits for them.
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < g_nshards; i++) {
+        shard_t *sh = &g_shards[i];
+        sh->idx = i;
+        sh->cpu = lo.steer ? listen_cpu(i) : -1;
+        mpsc_init(&sh->q);
+        pthread_mutex_init(&sh->roster_mu, NULL);
+        // Sized for the worst case but only touched as clients arrive.
+        sh->slots = (conn_t**)calloc((size_t)g_shard_conns, sizeof(conn_t*));
+        sh->live = (conn_t**)calloc((size_t)g_shard_conns, sizeof(conn_t*));
+        sh->backlog = (conn_t**)calloc((size_t)g_shard_conns, sizeof(conn_t*));
+        sh->free_slots = (int*)calloc((size_t)g_shard_conns, sizeof(int));
+        if (!sh->slots || !sh->live || !sh->backlog || !sh->free_slots ||
+            slab_init(&sh->conns, sizeof(conn_t), 0, pool_flags) < 0 || bufpool_init(&sh->bufs, pool_flags) < 0) {
+            perror("shard tables"); exit(1);
+        }
+        sh->ep = epoll_create1(EPOLL_CLOEXEC);
+        sh->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (sh->ep < 0 || sh->wake_fd < 0) { perror("epoll/eventfd"); exit(1); }
+
+        // Each shard's own listener; the kernel spreads connections over the
+        // SO_REUSEPORT group (listen_tcp sets it because shards > 1).
+        int lfd = listen_tcp(PORT, &lo);
+        if (lfd < 0) { perror("listen"); exit(1); }
+        if (sh->cpu >= 0 && listen_steer(lfd, sh->cpu) < 0) perror("SO_INCOMING_CPU");
+        listen_set_init(&sh->ls);
+        listen_set_add(&sh->ls, lfd);
+        for (int k = 0; k < nlocal && i == 0; k++) {
+            if (listen_set_add_spec(&sh->ls, local[k], lo.backlog) < 0) { perror(local[k]); exit(1); }
+            printf("Also listening on %s\n", local[k]);
+        }
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = WAKE_TAG };
+        epoll_ctl(sh->ep, EPOLL_CTL_ADD, sh->wake_fd, &ev);
+        for (int k = 0; k < sh->ls.n; k++) {
+            ev.data.u64 = (uint64_t)k;
+            epoll_ctl(sh->ep, EPOLL_CTL_ADD, sh->ls.fd[k], &ev);
+        }
+    }
+    for (int i = 0; i < g_nshards; i++) {
+        if (pthread_create(&g_shards[i].tid, NULL, shard_main, &g_shards[i]) != 0) {
+            fprintf(stderr, "cannot start shard %d\n", i);
+            exit(1);
+        }
+    }
+    printf("Sharded chat server (Ex9) on %d: %d shard%s … (Ctrl+C to shut down)\n",
+           PORT, g_nshards, g_nshards > 1 ? "s" : "");
+    fflush(stdout);
+
+    int sig;
+    sigwait(&sigs, &sig);
+    printf("\nShutting down…\n");
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < g_nshards; i++) {
+        uint64_t one = 1;
+        if (write(g_shards[i].wake_fd, &one, sizeof(one)) < 0) perror("wake shard");
+    }
+    for (int i = 0; i < g_nshards; i++) pthread_join(g_shards[i].tid, NULL);
+    listen_set_unlink(&g_shards[0].ls);
+    puts("Server closed.");
+    return 0;
+}
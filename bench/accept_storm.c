@@ -0,0 +1,152 @@
+// accept_storm.c — connection-rate benchmark: connect, one echo, close, repeat
+//
+// Build: gcc -Wall -Wextra -O2 accept_storm.c -o accept_storm
+// Run:   ../Ex5/server [-A backlog=N,defer=S,shards=N]   then
+//        ./accept_storm [-c concurrency] [-n conns] [-t max_secs] [-H host] [-p port]
+//
+// Keeps -c non-blocking connects in flight until -n connections have each
+// sent "x\n" and seen the server's "Echo" reply.  Latency runs from connect()
+// to that reply, so it includes time spent in the listen queue and any SYN
+// retransmits after an overflowing backlog dropped the handshake (1 s, 3 s, ...).
+// -t stops early and reports what completed, which a stalled run needs.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define MAX_CONC 4096
+
+typedef struct {
+    int      fd;
+    int      sent;             // request written; waiting for the reply
+    uint64_t start_ns;
+} slot_t;
+
+static slot_t slots[MAX_CONC];
+static struct pollfd pfds[MAX_CONC];
+static uint64_t *lat;          // one per completed connection
+static uint64_t done, failed, started, target = 10000;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void start_conn(int i, const struct sockaddr_in *sa) {
+    slot_t *s = &slots[i];
+    s->fd = -1;
+    pfds[i].fd = -1;
+    if (started >= target) return;
+    started++;
+
+    s->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (s->fd < 0) { perror("socket"); exit(1); }
+    s->sent = 0;
+    s->start_ns = now_ns();
+    if (connect(s->fd, (const struct sockaddr*)sa, sizeof(*sa)) < 0 && errno != EINPROGRESS) {
+        close(s->fd);
+        failed++;
+        s->fd = -1;
+        return;
+    }
+    pfds[i].fd = s->fd;
+    pfds[i].events = POLLOUT;
+}
+
+// Returns 1 when the slot is finished (either way), else 0.
+static int step(int i) {
+    slot_t *s = &slots[i];
+    short re = pfds[i].revents;
+    if (!s->sent && (re & (POLLOUT | POLLERR | POLLHUP))) {
+        if (send(s->fd, "x\n", 2, MSG_NOSIGNAL) != 2) { failed++; return 1; }
+        s->sent = 1;
+        pfds[i].events = POLLIN;
+        return 0;
+    }
+    if (s->sent && (re & (POLLIN | POLLERR | POLLHUP))) {
+        char buf[64];
+        ssize_t n = recv(s->fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EAGAIN) return 0;
+        if (n >= 4 && !memcmp(buf, "Echo", 4)) lat[done++] = now_ns() - s->start_ns;
+        else failed++;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 8080, conc = 64;
+    double max_secs = 0;
+    for (int ch; (ch = getopt(argc, argv, "c:n:t:H:p:")) != -1; ) {
+        switch (ch) {
+        case 'c': conc = atoi(optarg); break;
+        case 'n': target = strtoull(optarg, NULL, 10); break;
+        case 't': max_secs = atof(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-c concurrency] [-n conns] [-t max_secs] [-H host] [-p port]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (conc < 1 || conc > MAX_CONC || target < 1) {
+        fprintf(stderr, "need 1 <= concurrency <= %d and conns >= 1\n", MAX_CONC);
+        return 2;
+    }
+
+    // Every in-flight connection is an fd; make room for them.
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)conc + 64) {
+        rl.rlim_cur = rl.rlim_max < (rlim_t)conc + 64 ? rl.rlim_max : (rlim_t)conc + 64;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    struct sockaddr_in sa = {0};
+    sa.sin_family = AF_INET; sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 1; }
+    lat = malloc(target * sizeof(*lat));
+    if (!lat) { perror("malloc"); return 1; }
+
+    uint64_t t0 = now_ns();
+    uint64_t deadline = max_secs > 0 ? t0 + (uint64_t)(max_secs * 1e9) : UINT64_MAX;
+    for (int i = 0; i < conc; i++) start_conn(i, &sa);
+    while (done + failed < target && now_ns() < deadline) {
+        if (poll(pfds, (nfds_t)conc, 1000) < 0 && errno != EINTR) { perror("poll"); return 1; }
+        for (int i = 0; i < conc; i++) {
+            if (slots[i].fd < 0) {                   // connect() failed outright
+                if (started < target) start_conn(i, &sa);
+                continue;
+            }
+            if (!pfds[i].revents || !step(i)) continue;
+            close(slots[i].fd);
+            start_conn(i, &sa);
+        }
+    }
+    double secs = (double)(now_ns() - t0) / 1e9;
+
+    qsort(lat, done, sizeof(*lat), cmp_u64);
+    printf("%llu connections (%d in flight) in %.3f s: %.0f conn/s, %llu failed, %llu unfinished\n",
+           (unsigned long long)done, conc, secs, (double)done / secs, (unsigned long long)failed,
+           (unsigned long long)(started - done - failed));
+    if (done)
+        printf("connect-to-reply latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               (double)lat[done / 2] / 1e3, (double)lat[done * 99 / 100] / 1e3, (double)lat[done - 1] / 1e3);
+    return 0;
+}
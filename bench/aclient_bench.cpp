@@ -0,0 +1,100 @@
+// aclient_bench.cpp — request rate through the pooled async client (common/aclient.h)
+//
+// Build: g++ -Wall -Wextra -O2 aclient_bench.cpp ../common/aclient.cpp ../common/listen.c
+//            ../common/latency.c -pthread -o aclient_bench
+// Run:   ../Ex5/server -n          then   ./aclient_bench [-o conns=4,window=128] [-n requests] [-q outstanding]
+//        ../Ex2/server > /dev/null then   ./aclient_bench -o proto=keepalive [...]
+//        ./aclient_bench -f [...]  futures from this thread, I/O on the client's own
+//        ./aclient_bench -e unix:/tmp/echo.sock [...]
+//
+// Callback mode keeps -q requests outstanding and drives the client with
+// poll() from main(), the way an event-loop service would embed it.  -f
+// instead starts the client's I/O thread and waits on call() futures in
+// batches of -q, the blocking style.  Prints requests/s, latency from
+// submit() to completion, failures by errno and the client's counters
+// (reconnects, "BYE"s from keep-alive servers that ran into max=).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+#include "../common/aclient.h"
+#include "../common/latency.h"
+
+static lat_hist_t g_lat;
+static std::map<int, long> g_errs;
+
+static void count(const aclient_result_t &r) {
+    if (r.err) g_errs[r.err]++;
+    else lat_hist_add(&g_lat, r.latency_ns);
+}
+
+int main(int argc, char **argv) {
+    const char *spec = "127.0.0.1:8080";
+    aclient_opts_t o;
+    long n = 200000, q = 4096;
+    int futures = 0;
+    for (int ch; (ch = getopt(argc, argv, "e:o:n:q:f")) != -1; ) {
+        switch (ch) {
+        case 'e': spec = optarg; break;
+        case 'o':
+            if (aclient_opts_parse(&o, optarg) < 0) { fprintf(stderr, "bad -o %s\n", optarg); return 2; }
+            break;
+        case 'n': n = atol(optarg); break;
+        case 'q': q = atol(optarg); break;
+        case 'f': futures = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-e host:port|unix:PATH] [-o client_opts] [-n requests] [-q outstanding] [-f]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (q < 1) q = 1;
+
+    aclient c(o);
+    int ep = c.endpoint(spec);
+    if (ep < 0) { perror(spec); return 1; }
+
+    uint64_t t0 = mono_ns();
+    long submitted = 0, done = 0;
+    if (!futures) {
+        while (done < n) {
+            while (submitted < n && submitted - done < q) {
+                c.submit(ep, "ping " + std::to_string(submitted), [&done](aclient_result_t &r) { count(r); done++; });
+                submitted++;
+            }
+            c.poll(100);
+        }
+    } else {
+        c.start();
+        std::vector<std::future<aclient_result_t>> batch;
+        while (done < n) {
+            batch.clear();
+            for (long k = 0; k < q && submitted < n; k++, submitted++)
+                batch.push_back(c.call(ep, "ping " + std::to_string(submitted)));
+            for (auto &f : batch) {
+                aclient_result_t r = f.get();
+                count(r);
+                done++;
+            }
+        }
+        c.stop();
+    }
+    double secs = (mono_ns() - t0) / 1e9;
+
+    aclient_stats_t s = c.stats();
+    printf("%s, %s, %d conns x window %d, %ld outstanding, %s\n", spec,
+           o.proto == ACLIENT_KEEPALIVE ? "keepalive" : "lines", o.conns, o.window, q,
+           futures ? "futures" : "callbacks + poll()");
+    printf("%ld requests in %.2f s: %.0f req/s, %llu ok, %llu failed\n", done, secs, done / secs,
+           (unsigned long long)s.replies, (unsigned long long)s.failed);
+    for (auto &e : g_errs) printf("  %-12s %ld\n", strerror(e.first), e.second);
+    printf("connects %llu, reconnects %llu, server BYEs %llu\n",
+           (unsigned long long)s.connects, (unsigned long long)s.reconnects, (unsigned long long)s.byes);
+    lat_hist_print_header(stdout);
+    lat_hist_print(stdout, "submit->reply", &g_lat);
+    return 0;
+}
@@ -0,0 +1,146 @@
+// broker_bench.c — Ex8's routing core alone, through an in-memory transport
+//
+// Build: gcc -Wall -Wextra -O2 broker_bench.c ../Ex8/broker.c ../common/presence.c
+//            ../common/flightrec.c ../common/scan.c ../common/netio.c -o broker_bench
+// Run:   ./broker_bench [-n msgs] [-d deliveries] [-s payload_bytes] [-c command_pct] [-C clients,...]
+//
+// For each client count, joins that many slots and pushes synthetic lines
+// through broker_dispatch() from rotating senders.  Every delivery is a
+// memcpy into the recipient's 4 KiB ring, i.e. roughly what appending to an
+// output buffer costs, so the numbers are the broker's own work with no
+// syscalls, scheduling or socket buffers in them.
+//
+//   ns/msg        wall time per dispatched message
+//   deliv/msg     recipients per message (clients - 1 for chat)
+//   ns/recipient  fan-out cost: (ns/msg - ns/msg with one client) / (clients - 1)
+//
+// -n caps the messages per client count; -d caps messages x recipients so
+// the large rooms finish in a few seconds.  -c mixes in /nick commands.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../Ex8/broker.h"
+
+#define SINK_SIZE 4096
+
+typedef struct {
+    char     ring[SINK_SIZE];
+    size_t   at;
+    uint64_t bytes, msgs;
+} sink_t;
+
+static sink_t *sinks;
+static uint64_t renames;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void mem_send(void *ctx, int idx, int lane, const char *buf, size_t n) {
+    (void)ctx; (void)lane;
+    sink_t *s = &sinks[idx];
+    if (n > SINK_SIZE) n = SINK_SIZE;
+    if (s->at + n > SINK_SIZE) s->at = 0;
+    memcpy(s->ring + s->at, buf, n);
+    s->at += n;
+    s->bytes += n;
+    s->msgs++;
+}
+
+static void mem_renamed(void *ctx, int idx, const char *nick) {
+    (void)ctx; (void)idx; (void)nick;
+    renames++;
+}
+
+// One room of `clients`; returns ns per message and sets *deliv_per_msg.
+static double run(int clients, long msgs, size_t payload, int cmd_pct, double *deliv_per_msg) {
+    broker_transport_t tp = { mem_send, mem_renamed, NULL };
+    broker_t b;
+    if (broker_init(&b, clients, &tp) < 0) { perror("broker_init"); exit(1); }
+    sinks = (sink_t*)calloc((size_t)clients, sizeof(*sinks));
+    if (!sinks) { perror("calloc"); exit(1); }
+    for (int i = 0; i < clients; i++) broker_join(&b, i);     // no presence: announced at once
+
+    // Pre-built lines, so the loop measures dispatch and not snprintf.
+    enum { VARIANTS = 64 };
+    static char lines[VARIANTS][BROKER_MSG_MAX];
+    srand(7);
+    for (int v = 0; v < VARIANTS; v++) {
+        if (rand() % 100 < cmd_pct) {
+            snprintf(lines[v], sizeof(lines[v]), "/nick n%d", v);
+        } else {
+            size_t len = payload < BROKER_MSG_MAX - 1 ? payload : BROKER_MSG_MAX - 1;
+            for (size_t k = 0; k < len; k++) lines[v][k] = (char)('a' + (v + (int)k) % 26);
+            lines[v][len] = '\0';
+        }
+    }
+    uint64_t before = 0;
+    for (int i = 0; i < clients; i++) { before += sinks[i].msgs; }
+
+    double t0 = now_ns();
+    for (long m = 0; m < msgs; m++)
+        broker_dispatch(&b, (int)(m % clients), lines[m % VARIANTS]);
+    double ns = now_ns() - t0;
+
+    uint64_t delivered = 0, bytes = 0;
+    for (int i = 0; i < clients; i++) { delivered += sinks[i].msgs; bytes += sinks[i].bytes; }
+    delivered -= before;
+    *deliv_per_msg = (double)delivered / (double)msgs;
+    if (bytes == 0) printf("(no output)\n");       // keeps the copies observable
+
+    free(sinks);
+    broker_free(&b);
+    return ns / (double)msgs;
+}
+
+int main(int argc, char **argv) {
+    long nmsgs = 2000000, budget = 50000000;
+    size_t payload = 60;
+    int cmd_pct = 0;
+    int counts[32], ncounts = 0;
+    for (int ch; (ch = getopt(argc, argv, "n:d:s:c:C:")) != -1; ) {
+        switch (ch) {
+        case 'n': nmsgs = atol(optarg); break;
+        case 'd': budget = atol(optarg); break;
+        case 's': payload = (size_t)atol(optarg); break;
+        case 'c': cmd_pct = atoi(optarg); break;
+        case 'C':
+            for (char *p = optarg; *p && ncounts < 32; ) {
+                int c = (int)strtol(p, &p, 10);
+                if (c > 0) counts[ncounts++] = c;
+                if (*p == ',') p++; else break;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n msgs] [-d deliveries] [-s payload_bytes] [-c command_pct] "
+                            "[-C clients,...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (ncounts == 0) {
+        static const int def[] = { 1, 2, 8, 64, 256, 1024 };
+        for (size_t k = 0; k < sizeof(def) / sizeof(def[0]); k++) counts[ncounts++] = def[k];
+    }
+    if (nmsgs < 1) nmsgs = 1;
+
+    double d1;
+    double base = run(1, nmsgs, payload, cmd_pct, &d1);       // dispatch with nobody to send to
+    printf("payload %zu bytes, %d%% commands; 1 client: %.1f ns/msg\n", payload, cmd_pct, base);
+    printf("%8s %10s %10s %10s %14s\n", "clients", "msgs", "ns/msg", "deliv/msg", "ns/recipient");
+    for (int k = 0; k < ncounts; k++) {
+        int c = counts[k];
+        long n = budget / c < nmsgs ? budget / c : nmsgs;
+        if (n < 1000) n = 1000;
+        double dpm, ns = run(c, n, payload, cmd_pct, &dpm);
+        if (c > 1) printf("%8d %10ld %10.1f %10.2f %14.2f\n", c, n, ns, dpm, (ns - base) / (c - 1));
+        else       printf("%8d %10ld %10.1f %10.2f %14s\n", c, n, ns, dpm, "-");
+    }
+    return 0;
+}
@@ -0,0 +1,261 @@
+// echo_bench.c — echo throughput: batched UDP vs pipelined TCP vs AF_UNIX
+//
+// Build: gcc -Wall -Wextra -O2 echo_bench.c ../common/listen.c -o echo_bench
+// Run:   ../Ex5/server -u 1 [-G]   then   ./echo_bench [-G] [-c conns] [-n msgs] [-w window] [-s size]
+//        ../Ex5/server -n          then   ./echo_bench -t [-c conns] [-n msgs] [-w window] [-s size]
+//        ../Ex5/server -n -l unix:/tmp/echo.sock
+//                                  then   ./echo_bench -a unix:/tmp/echo.sock [...]
+//        (-a seqpacket:PATH likewise; -a implies the pipelined stream protocol)
+//
+// Each of -c sockets keeps -w messages of -s bytes in flight until -n
+// messages in total have been echoed.  UDP sends a window with one
+// sendmmsg() (one GSO sendmsg() with -G) and drains replies with recvmmsg();
+// TCP writes the window as newline-terminated lines in one send() and counts
+// "Echo: ...\n" lines coming back.  A UDP window that sees no reply for
+// 200 ms is written off as lost and resent.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "../common/listen.h"
+
+#define MAX_CONNS  256
+#define MAX_WINDOW 64
+#define MAX_SIZE   1400
+#define REPLY_MAX  (MAX_SIZE + 16)
+
+typedef struct {
+    int      fd;
+    int      inflight;
+    uint64_t last_reply_ns;
+    size_t   have;                         // TCP: partial reply bytes
+    char     rbuf[MAX_WINDOW * REPLY_MAX];
+} conn_t;
+
+static conn_t conns[MAX_CONNS];
+static int nconns = 1, window = 16, size = 32, use_tcp, use_gso;
+static const char *local_spec;             // -a: AF_UNIX instead of TCP (use_tcp stays set)
+static uint64_t target = 1000000, sent, echoed, lost, send_calls, recv_calls;
+static char payload[MAX_WINDOW * (MAX_SIZE + 1)];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int open_conn(const struct sockaddr_in *sa) {
+    if (local_spec) {
+        int fd = local_connect(local_spec);
+        if (fd < 0) { perror(local_spec); exit(1); }
+        return fd;
+    }
+    int fd = socket(AF_INET, use_tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0) { perror("socket"); exit(1); }
+    if (connect(fd, (const struct sockaddr*)sa, sizeof(*sa)) < 0) { perror("connect"); exit(1); }
+    int one = 1;
+    if (use_tcp) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    else if (use_gso) setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+    return fd;
+}
+
+static int window_for(void) {
+    uint64_t left = target - sent;
+    return left < (uint64_t)window ? (int)left : window;
+}
+
+static void send_window(conn_t *c) {
+    int k = window_for();
+    if (k == 0) return;
+
+    if (use_tcp) {
+        // payload holds `window` lines of size-1 bytes + '\n'
+        size_t n = (size_t)k * (size_t)size;
+        size_t off = 0;
+        while (off < n) {
+            ssize_t w = send(c->fd, payload + off, n - off, MSG_NOSIGNAL);
+            if (w < 0) { if (errno == EINTR) continue; perror("send"); exit(1); }
+            off += (size_t)w;
+            send_calls++;
+        }
+    } else if (use_gso && k > 1) {
+        union { char b[CMSG_SPACE(sizeof(uint16_t))]; struct cmsghdr a; } ctl;
+        struct iovec iov = { payload, (size_t)k * (size_t)size };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctl.b;
+        mh.msg_controllen = sizeof(ctl.b);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t seg = (uint16_t)size;
+        memcpy(CMSG_DATA(cm), &seg, sizeof(seg));
+        if (sendmsg(c->fd, &mh, 0) < 0) { perror("sendmsg (GSO)"); exit(1); }
+        send_calls++;
+    } else {
+        struct mmsghdr mm[MAX_WINDOW];
+        struct iovec iov[MAX_WINDOW];
+        memset(mm, 0, sizeof(mm));
+        for (int i = 0; i < k; i++) {
+            iov[i].iov_base = payload + (size_t)i * (size_t)size;
+            iov[i].iov_len = (size_t)size;
+            mm[i].msg_hdr.msg_iov = &iov[i];
+            mm[i].msg_hdr.msg_iovlen = 1;
+        }
+        int off = 0;
+        while (off < k) {
+            int r = sendmmsg(c->fd, mm + off, (unsigned)(k - off), 0);
+            if (r < 0) { if (errno == EINTR) continue; perror("sendmmsg"); exit(1); }
+            off += r;
+            send_calls++;
+        }
+    }
+    sent += (uint64_t)k;
+    c->inflight = k;
+    c->last_reply_ns = now_ns();
+}
+
+// Returns the number of replies that arrived on c.
+static int drain(conn_t *c) {
+    int got = 0;
+    if (use_tcp) {
+        ssize_t r = recv(c->fd, c->rbuf + c->have, sizeof(c->rbuf) - c->have, MSG_DONTWAIT);
+        if (r == 0) { fprintf(stderr, "server closed the connection\n"); exit(1); }
+        if (r < 0) return 0;
+        recv_calls++;
+        c->have += (size_t)r;
+        char *p = c->rbuf, *end = c->rbuf + c->have, *nl;
+        while ((nl = memchr(p, '\n', (size_t)(end - p)))) { got++; p = nl + 1; }
+        c->have = (size_t)(end - p);
+        memmove(c->rbuf, p, c->have);
+        return got;
+    }
+
+    struct mmsghdr mm[MAX_WINDOW];
+    struct iovec iov[MAX_WINDOW];
+    union { char b[CMSG_SPACE(sizeof(int))]; struct cmsghdr a; } ctl[MAX_WINDOW];
+    static char rb[MAX_WINDOW][65536];
+    memset(mm, 0, sizeof(mm));
+    for (int i = 0; i < MAX_WINDOW; i++) {
+        iov[i].iov_base = rb[i];
+        iov[i].iov_len = use_gso ? sizeof(rb[i]) : REPLY_MAX;
+        mm[i].msg_hdr.msg_iov = &iov[i];
+        mm[i].msg_hdr.msg_iovlen = 1;
+        if (use_gso) { mm[i].msg_hdr.msg_control = ctl[i].b; mm[i].msg_hdr.msg_controllen = sizeof(ctl[i].b); }
+    }
+    int n = recvmmsg(c->fd, mm, MAX_WINDOW, MSG_DONTWAIT, NULL);
+    if (n <= 0) return 0;
+    recv_calls++;
+    for (int i = 0; i < n; i++) {
+        size_t len = mm[i].msg_len, seg = len;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mm[i].msg_hdr); cm; cm = CMSG_NXTHDR(&mm[i].msg_hdr, cm)) {
+            int g;
+            if (cm->cmsg_level != SOL_UDP || cm->cmsg_type != UDP_GRO) continue;
+            memcpy(&g, CMSG_DATA(cm), sizeof(g));
+            if (g > 0) seg = (size_t)g;
+        }
+        got += seg && len ? (int)((len + seg - 1) / seg) : 1;
+    }
+    return got;
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 8080;
+    for (int ch; (ch = getopt(argc, argv, "tGa:c:n:w:s:H:p:")) != -1; ) {
+        switch (ch) {
+        case 't': use_tcp = 1; break;
+        case 'a': local_spec = optarg; use_tcp = 1; break;
+        case 'G': use_gso = 1; break;
+        case 'c': nconns = atoi(optarg); break;
+        case 'n': target = strtoull(optarg, NULL, 10); break;
+        case 'w': window = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t | -a unix:PATH | -a seqpacket:PATH] [-G] [-c conns] [-n msgs] [-w window] "
+                            "[-s size] [-H host] [-p port]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (nconns < 1 || nconns > MAX_CONNS || window < 1 || window > MAX_WINDOW ||
+        size < 2 || size > MAX_SIZE || (use_tcp && use_gso)) {
+        fprintf(stderr, "need 1 <= conns <= %d, 1 <= window <= %d, 2 <= size <= %d; -G is UDP only\n",
+                MAX_CONNS, MAX_WINDOW, MAX_SIZE);
+        return 2;
+    }
+
+    for (int i = 0; i < window; i++) {
+        char *p = payload + (size_t)i * (size_t)size;
+        memset(p, 'a' + i % 26, (size_t)size);
+        if (use_tcp) p[size - 1] = '\n';
+    }
+
+    struct sockaddr_in sa = {0};
+    sa.sin_family = AF_INET; sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 1; }
+
+    struct pollfd pfds[MAX_CONNS];
+    for (int i = 0; i < nconns; i++) {
+        conns[i].fd = open_conn(&sa);
+        pfds[i].fd = conns[i].fd;
+        pfds[i].events = POLLIN;
+    }
+    if (use_tcp) usleep(100 * 1000);       // let the forked handlers start
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+    uint64_t start = now_ns();
+    for (int i = 0; i < nconns; i++) send_window(&conns[i]);
+    while (echoed + lost < target) {
+        int r = poll(pfds, (nfds_t)nconns, 50);
+        if (r < 0 && errno != EINTR) { perror("poll"); return 1; }
+        uint64_t t = now_ns();
+        for (int i = 0; i < nconns; i++) {
+            conn_t *c = &conns[i];
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                int got = drain(c);
+                if (got > c->inflight) got = c->inflight;
+                c->inflight -= got;
+                echoed += (uint64_t)got;
+                if (got) c->last_reply_ns = t;
+            }
+            if (c->inflight && !use_tcp && t - c->last_reply_ns > 200000000ull) {
+                lost += (uint64_t)c->inflight;       // UDP: give up on this window
+                c->inflight = 0;
+            }
+            if (c->inflight == 0) send_window(c);
+        }
+    }
+    double secs = (double)(now_ns() - start) / 1e9;
+    getrusage(RUSAGE_SELF, &ru1);
+    double cpu = (double)(ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec + ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec)
+               + (double)(ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec + ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec) / 1e6;
+
+    printf("%s%s: %d conns, window %d, %d-byte messages\n",
+           local_spec ? local_spec : use_tcp ? "tcp" : "udp", use_gso ? "+gso" : "", nconns, window, size);
+    printf("echoed %llu msgs in %.3f s: %.0f msg/s, %.1f MB/s out; lost %llu\n",
+           (unsigned long long)echoed, secs, (double)echoed / secs,
+           (double)echoed * size / secs / 1e6, (unsigned long long)lost);
+    printf("client syscalls per msg: send %.3f, recv %.3f; client CPU %.2f us/msg, round trip %.1f us\n",
+           (double)send_calls / (double)(sent ? sent : 1), (double)recv_calls / (double)(echoed ? echoed : 1),
+           cpu * 1e6 / (double)(echoed ? echoed : 1),
+           secs * 1e6 / ((double)(echoed ? echoed : 1) / (double)(nconns * window)));
+    return 0;
+}
@@ -0,0 +1,145 @@
+// flightdump.c — print a flight recorder dump as a timeline
+//
+// Build: gcc -Wall -Wextra -O2 flightdump.c ../common/flightrec.c -o flightdump
+// Run:   kill -USR2 $(pgrep -o server)        (or wait for a slow-pass dump)
+//        ./flightdump [-p pid] [-c conn] [-n last_events] flight-1234-1.bin ...
+//
+// One line per event, oldest first: wall-clock time, time before the dump in
+// ms, gap to the previous line in us, the process that recorded it and its
+// connection (Ex6: the socket fd; Ex8: the client slot).  Ticks are turned
+// into time with the two (tsc, CLOCK_MONOTONIC) pairs in the file, so the
+// timeline holds as long as the TSC is invariant and synchronized across
+// cores (any x86 from the last decade).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../common/flightrec.h"
+
+typedef struct {
+    uint64_t idx;
+    flight_rec_t r;
+} event_t;
+
+static int cmp_event(const void *a, const void *b) {
+    const event_t *x = (const event_t*)a, *y = (const event_t*)b;
+    if (x->r.tsc != y->r.tsc) return x->r.tsc < y->r.tsc ? -1 : 1;
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static void describe(const flight_rec_t *r, char *out, size_t cap) {
+    switch (r->type) {
+    case FR_ACCEPT:       snprintf(out, cap, "fd %u", r->a); break;
+    case FR_RECV:         snprintf(out, cap, "%u B", r->a); break;
+    case FR_FANOUT:       snprintf(out, cap, "%u recipients x %u B", r->a, r->b); break;
+    case FR_SEND_PARTIAL: snprintf(out, cap, "%u of %u B", r->a, r->b); break;
+    case FR_SEND_EAGAIN:  snprintf(out, cap, "%u B queued", r->a); break;
+    case FR_CLOSE:
+        if (r->aux == FR_WHY_SHUTDOWN) snprintf(out, cap, "shutdown, %u clients", r->b);
+        else if (r->a) snprintf(out, cap, "%s (%s)", flight_why_name(r->aux), strerror((int)r->a));
+        else snprintf(out, cap, "%s", flight_why_name(r->aux));
+        break;
+    case FR_SLOW:         snprintf(out, cap, "%s took %.3f ms", flight_op_name(r->aux), r->a / 1e3); break;
+    case FR_DUMP:
+        snprintf(out, cap, "%s", r->aux == FR_TRIG_SIGNAL ? "on signal"
+                               : r->aux == FR_TRIG_SLOW   ? "slow operation" : "requested");
+        break;
+    default:              snprintf(out, cap, "aux %u a %u b %u", r->aux, r->a, r->b); break;
+    }
+}
+
+static int dump_file(const char *path, long pid, long conn, long last) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return -1; }
+    flight_file_hdr_t h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, FLIGHT_MAGIC, 4) ||
+        h.version != FLIGHT_VERSION || h.rec_size != sizeof(flight_rec_t) ||
+        h.slots == 0 || (h.slots & (h.slots - 1))) {
+        fprintf(stderr, "%s: not a flight recorder dump (or another version)\n", path);
+        fclose(f);
+        return -1;
+    }
+    flight_rec_t *ring = (flight_rec_t*)malloc((size_t)h.slots * sizeof(*ring));
+    event_t *ev = (event_t*)malloc((size_t)h.slots * sizeof(*ev));
+    if (!ring || !ev || fread(ring, sizeof(*ring), h.slots, f) != h.slots) {
+        fprintf(stderr, "%s: truncated\n", path);
+        free(ring); free(ev); fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    // A slot is kept if it still holds the event its position implies: older
+    // ones were overwritten, torn ones went out with seq 0.
+    uint64_t mask = h.slots - 1, first = h.head > h.slots ? h.head - h.slots : 0;
+    size_t n = 0;
+    for (uint64_t i = first; i < h.head; i++) {
+        const flight_rec_t *r = &ring[i & mask];
+        if (r->seq != (uint32_t)(i + 1)) continue;
+        if ((pid >= 0 && r->pid != pid) || (conn >= 0 && r->conn != (uint32_t)conn)) continue;
+        ev[n].idx = i;
+        ev[n].r = *r;
+        n++;
+    }
+    qsort(ev, n, sizeof(*ev), cmp_event);
+    size_t from = last > 0 && (size_t)last < n ? n - (size_t)last : 0;
+
+    double ns_per_tick = h.tsc1 > h.tsc0 && h.mono1_ns > h.mono0_ns
+                       ? (double)(h.mono1_ns - h.mono0_ns) / (double)(h.tsc1 - h.tsc0) : 1.0;
+    printf("%s: pid %d, %s; %llu events since start, %zu shown (ring of %u); %.3f GHz ticks\n",
+           path, h.pid,
+           h.trigger == FR_TRIG_SIGNAL ? "on SIGUSR2" : h.trigger == FR_TRIG_SLOW ? "after a slow operation" : "on request",
+           (unsigned long long)h.head, n - from, h.slots, 1.0 / ns_per_tick);
+    if (h.slow_ns) printf("slow threshold %.1f ms\n", h.slow_ns / 1e6);
+    printf("%-15s %12s %10s %7s %5s  %s\n", "wall clock", "ms to dump", "+us", "pid", "conn", "event");
+
+    uint64_t prev = 0;
+    for (size_t k = from; k < n; k++) {
+        const flight_rec_t *r = &ev[k].r;
+        double since0 = ((double)r->tsc - (double)h.tsc0) * ns_per_tick;     // ns after flight_init()
+        double to_dump = ((double)r->tsc - (double)h.tsc1) * ns_per_tick;
+        uint64_t wall = h.wall0_ns + (since0 > 0 ? (uint64_t)since0 : 0);
+        time_t secs = (time_t)(wall / 1000000000ull);
+        struct tm tm;
+        localtime_r(&secs, &tm);
+        char clock[16], what[128], who[16];
+        strftime(clock, sizeof(clock), "%H:%M:%S", &tm);
+        describe(r, what, sizeof(what));
+        if (r->conn == FLIGHT_NO_CONN) snprintf(who, sizeof(who), "-");
+        else snprintf(who, sizeof(who), "%u", r->conn);
+        double gap = prev ? ((double)r->tsc - (double)prev) * ns_per_tick / 1e3 : 0;
+        printf("%s.%06u %12.3f %10.1f %7d %5s  %-12s %s\n", clock, (unsigned)(wall % 1000000000ull / 1000),
+               to_dump / 1e6, gap, r->pid, who, flight_type_name(r->type), what);
+        prev = r->tsc;
+    }
+    free(ring);
+    free(ev);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long pid = -1, conn = -1, last = 0;
+    for (int ch; (ch = getopt(argc, argv, "p:c:n:")) != -1; ) {
+        switch (ch) {
+        case 'p': pid = atol(optarg); break;
+        case 'c': conn = atol(optarg); break;
+        case 'n': last = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-p pid] [-c conn] [-n last_events] dump.bin ...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "usage: %s [-p pid] [-c conn] [-n last_events] dump.bin ...\n", argv[0]);
+        return 2;
+    }
+    int rc = 0;
+    for (int k = optind; k < argc; k++) {
+        if (k > optind) putchar('\n');
+        if (dump_file(argv[k], pid, conn, last) < 0) rc = 1;
+    }
+    return rc;
+}
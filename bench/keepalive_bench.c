@@ -0,0 +1,164 @@
+// keepalive_bench.c — one-shot vs keep-alive request rate against Ex2/Ex4
+//
+// Build: gcc -Wall -Wextra -O2 keepalive_bench.c -o keepalive_bench
+// Run:   ../Ex2/server > /dev/null   (or ../Ex4/server)   then
+//        ./keepalive_bench [-n requests] [-w window] [-H host] [-p port]
+//
+// Sends -n requests twice: one connection per request (connect, "ping",
+// read the reply, close), then over keep-alive connections with -w requests
+// in flight ("KEEPALIVE\n", then "<id> ping\n" lines, replies matched by
+// ID).  When the server ends a connection with "BYE max" the bench opens the
+// next one and carries on.  For each run it prints requests/s and how many
+// sockets to the port were left in TIME_WAIT (from /proc/net/tcp), which is
+// the table the one-shot protocol fills.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+static struct sockaddr_in g_addr;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sockets in TIME_WAIT (state 06) with the port at either end.
+static int time_wait(int port) {
+    const char *files[] = { "/proc/net/tcp", "/proc/net/tcp6" };
+    int n = 0;
+    for (int f = 0; f < 2; f++) {
+        FILE *fp = fopen(files[f], "r");
+        if (!fp) continue;
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char local[64], remote[64];
+            unsigned st;
+            if (sscanf(line, "%*d: %63s %63s %x", local, remote, &st) != 3 || st != 0x06) continue;
+            const char *lp = strrchr(local, ':'), *rp = strrchr(remote, ':');
+            if ((lp && strtol(lp + 1, NULL, 16) == port) || (rp && strtol(rp + 1, NULL, 16) == port)) n++;
+        }
+        fclose(fp);
+    }
+    return n;
+}
+
+static int dial(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&g_addr, sizeof(g_addr)) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+static long run_oneshot(long n) {
+    char buf[256];
+    long done = 0;
+    for (; done < n; done++) {
+        int fd = dial();
+        if (fd < 0) { perror("connect"); break; }
+        ssize_t r = 0;
+        if (send(fd, "ping", 4, 0) == 4) r = recv(fd, buf, sizeof(buf), 0);
+        // Read to the server's close so it, not us, closes first, as the
+        // original clients do.
+        while (r > 0) r = recv(fd, buf, sizeof(buf), 0);
+        close(fd);
+        if (r < 0) { perror("recv"); break; }
+    }
+    return done;
+}
+
+// Keep-alive: returns requests answered; *conns counts the connections used.
+static long run_keepalive(long n, int window, long *conns) {
+    static char in[65536];
+    char out[64 * 64];
+    long sent = 0, done = 0;
+    *conns = 0;
+    while (done < n) {
+        int fd = dial();
+        if (fd < 0) { perror("connect"); break; }
+        (*conns)++;
+        if (send(fd, "KEEPALIVE\n", 10, 0) != 10) { close(fd); break; }
+        size_t have = 0;
+        int greeted = 0, bye = 0;
+        long base = done;                          // requests sent on this connection start here
+        sent = done;
+        while (!bye && done < n) {
+            // Top the window up.
+            size_t ol = 0;
+            while (sent < n && sent - done < window && ol + 64 <= sizeof(out))
+                ol += (size_t)snprintf(out + ol, sizeof(out) - ol, "%ld ping\n", sent++);
+            if (ol && send(fd, out, ol, 0) != (ssize_t)ol) { perror("send"); bye = 1; break; }
+
+            ssize_t r = recv(fd, in + have, sizeof(in) - have, 0);
+            if (r <= 0) { fprintf(stderr, "keep-alive connection lost after %ld requests\n", done - base); break; }
+            have += (size_t)r;
+            char *p = in, *nl;
+            while ((nl = (char*)memchr(p, '\n', (size_t)(in + have - p))) != NULL) {
+                *nl = '\0';
+                if (!greeted && !strncmp(p, "KEEPALIVE", 9)) greeted = 1;
+                else if (!strncmp(p, "BYE", 3)) bye = 1;
+                else if (strtol(p, NULL, 10) == done) done++;
+                else { fprintf(stderr, "reply out of order: %s (expected %ld)\n", p, done); close(fd); return done; }
+                p = nl + 1;
+            }
+            have = (size_t)(in + have - p);
+            memmove(in, p, have);
+        }
+        // Whatever was sent past the server's last request goes again on the next connection.
+        sent = done;
+        close(fd);
+        if (!bye && done < n) break;
+    }
+    return done;
+}
+
+int main(int argc, char **argv) {
+    long n = 20000;
+    int window = 32, port = 8080;
+    const char *host = "127.0.0.1";
+    for (int ch; (ch = getopt(argc, argv, "n:w:H:p:")) != -1; ) {
+        switch (ch) {
+        case 'n': n = atol(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n requests] [-w window] [-H host] [-p port]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (window < 1) window = 1;
+    if (window > 64) window = 64;
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &g_addr.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 2; }
+
+    printf("%-22s %10s %8s %12s %10s\n", "mode", "requests", "conns", "req/s", "TIME_WAIT");
+
+    int tw0 = time_wait(port);
+    double t0 = now_s();
+    long done = run_oneshot(n);
+    double dt = now_s() - t0;
+    printf("%-22s %10ld %8ld %12.0f %+10d\n", "one-shot", done, done, done / dt, time_wait(port) - tw0);
+
+    long conns;
+    tw0 = time_wait(port);
+    t0 = now_s();
+    done = run_keepalive(n, window, &conns);
+    dt = now_s() - t0;
+    char mode[32];
+    snprintf(mode, sizeof(mode), "keep-alive, window %d", window);
+    printf("%-22s %10ld %8ld %12.0f %+10d\n", mode, done, conns, done / dt, time_wait(port) - tw0);
+    return 0;
+}
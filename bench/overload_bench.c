@@ -0,0 +1,168 @@
+// overload_bench.c — chat broker latency for light users while others flood it
+//
+// Build: gcc -Wall -Wextra -O2 overload_bench.c ../common/latency.c -o overload_bench
+// Run:   ../Ex8/server [-O target=MS,... | -O off]   (or ../Ex7/server)   then
+//        ./overload_bench [-f flooders] [-u users] [-r user_msgs_per_s] [-d secs] [-F] [-H host] [-p port]
+//
+// -f clients write chat lines as fast as their sockets take them; -u light
+// users each send a tagged line -r times a second, and one more client
+// times how long each tag takes to come back in the broadcast.  Every 200 ms
+// a newcomer connects and the first line it gets is classified (welcome,
+// "Server busy", "Server full", nothing within a second).  With shedding on,
+// the light users' p99 should stay near the -O target while newcomers are
+// turned away; with -O off it grows with the backlog.  Everyone reads and
+// discards what they are sent, as fast as this one thread can, so the
+// broker only goes past capacity if this runs on other cores than it does.
+// -F connects the flooders first, so they hold the low client slots: a broker
+// that serves its clients in slot order then makes the light users wait.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "../common/latency.h"
+
+#define MAX_CONNS 1024
+
+typedef struct {
+    int    fd;
+    int    role;           // R_*
+    size_t have;
+    char   in[8192];
+} peer_t;
+
+enum { R_FLOOD, R_USER, R_WATCH };
+
+static struct sockaddr_in g_addr;
+static peer_t g_peer[MAX_CONNS];
+
+static int dial(int nonblock) {
+    int fd = socket(AF_INET, SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&g_addr, sizeof(g_addr)) < 0 && errno != EINPROGRESS) { close(fd); return -1; }
+    return fd;
+}
+
+// First line a newcomer gets: 0 welcome, 1 busy, 2 full, 3 nothing / error.
+static int newcomer(void) {
+    int fd = dial(0);
+    if (fd < 0) return 3;
+    struct pollfd p = { fd, POLLIN, 0 };
+    char buf[256];
+    ssize_t n = poll(&p, 1, 1000) > 0 ? recv(fd, buf, sizeof(buf) - 1, 0) : -1;
+    close(fd);
+    if (n <= 0) return 3;
+    buf[n] = '\0';
+    return strstr(buf, "busy") ? 1 : strstr(buf, "full") ? 2 : 0;
+}
+
+int main(int argc, char **argv) {
+    int flooders = 40, users = 10, port = 8080;
+    int flood_first = 0;
+    double rate = 2, secs = 10;
+    const char *host = "127.0.0.1";
+    for (int ch; (ch = getopt(argc, argv, "f:u:r:d:FH:p:")) != -1; ) {
+        switch (ch) {
+        case 'f': flooders = atoi(optarg); break;
+        case 'u': users = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'd': secs = atof(optarg); break;
+        case 'F': flood_first = 1; break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-f flooders] [-u users] [-r user_msgs_per_s] [-d secs] [-F] [-H host] [-p port]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (flooders + users + 1 > MAX_CONNS || users < 1 || rate <= 0) { fprintf(stderr, "bad -f/-u/-r\n"); return 2; }
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &g_addr.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 2; }
+
+    // g_peer[0] watches, [1..users] are the light users, the rest flood.
+    int ep = epoll_create1(0);
+    for (int j = 0; j < 1 + users + flooders; j++) {
+        int k = flood_first ? (j + 1 + users) % (1 + users + flooders) : j;
+        peer_t *p = &g_peer[k];
+        p->fd = dial(1);
+        if (p->fd < 0) { perror("connect"); return 1; }
+        p->role = k == 0 ? R_WATCH : k <= users ? R_USER : R_FLOOD;
+        struct epoll_event ev = { .events = EPOLLIN | (p->role == R_FLOOD ? EPOLLOUT : 0), .data.ptr = p };
+        epoll_ctl(ep, EPOLL_CTL_ADD, p->fd, &ev);
+    }
+    usleep(300 * 1000);                       // let the joins settle before the clock starts
+
+    char flood[64 * 62];
+    for (int k = 0; k < 64; k++) memcpy(flood + k * 62, "flood flood flood flood flood flood flood flood flood flood.\n", 62);
+
+    lat_hist_t lat = {0};
+    uint64_t t0 = mono_ns(), end = t0 + (uint64_t)(secs * 1e9);
+    uint64_t gap = (uint64_t)(1e9 / (rate * users)), next_tag = t0, next_newcomer = t0;
+    long tags_sent = 0, flood_lines = 0, seen[4] = {0};
+    int who = 0;
+
+    for (uint64_t now = t0; now < end; now = mono_ns()) {
+        while (next_tag <= now) {                 // light users take turns
+            char line[64];
+            int n = snprintf(line, sizeof(line), "tag %llu\n", (unsigned long long)mono_ns());
+            if (send(g_peer[1 + who].fd, line, (size_t)n, MSG_NOSIGNAL) == n) tags_sent++;
+            who = (who + 1) % users;
+            next_tag += gap;
+        }
+        if (next_newcomer <= now) {
+            seen[newcomer()]++;
+            next_newcomer = mono_ns() + 200 * 1000000ull;
+        }
+
+        struct epoll_event evs[64];
+        int n = epoll_wait(ep, evs, 64, 1);
+        for (int e = 0; e < n; e++) {
+            peer_t *p = (peer_t*)evs[e].data.ptr;
+            if (evs[e].events & EPOLLOUT) {
+                ssize_t w = send(p->fd, flood, sizeof(flood), MSG_NOSIGNAL);
+                if (w > 0) flood_lines += w / 62;
+            }
+            if (!(evs[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) continue;
+            ssize_t r = recv(p->fd, p->in + p->have, sizeof(p->in) - p->have, 0);
+            if (r <= 0) {
+                if (r < 0 && errno == EAGAIN) continue;
+                epoll_ctl(ep, EPOLL_CTL_DEL, p->fd, NULL);
+                fprintf(stderr, "a %s was disconnected\n",
+                        p->role == R_WATCH ? "watcher" : p->role == R_USER ? "user" : "flooder");
+                continue;
+            }
+            if (p->role != R_WATCH) continue;
+            p->have += (size_t)r;
+            uint64_t t = mono_ns();
+            char *s = p->in, *nl;
+            while ((nl = memchr(s, '\n', (size_t)(p->in + p->have - s))) != NULL) {
+                *nl = '\0';
+                char *tag = strstr(s, "tag ");
+                if (tag) lat_hist_add(&lat, t - strtoull(tag + 4, NULL, 10));
+                s = nl + 1;
+            }
+            p->have = (size_t)(p->in + p->have - s);
+            memmove(p->in, s, p->have);
+            if (p->have == sizeof(p->in)) p->have = 0;
+        }
+    }
+
+    printf("%d flooders (%ld lines sent), %d users at %.1f msg/s each, %.0f s\n",
+           flooders, flood_lines, users, rate, secs);
+    printf("user lines delivered to the watcher: %llu of %ld\n", (unsigned long long)lat.count, tags_sent);
+    printf("newcomers: %ld welcomed, %ld busy, %ld full, %ld no answer\n", seen[0], seen[1], seen[2], seen[3]);
+    lat_hist_print_header(stdout);
+    lat_hist_print(stdout, "user->watcher", &lat);
+    return 0;
+}
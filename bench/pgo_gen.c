@@ -0,0 +1,27 @@
+// pgo_gen.c — linked into the instrumented servers of `make pgo` (not a tool)
+//
+// gcov writes a process's profile when it returns from main() or calls
+// exit().  The servers' per-connection children leave with _exit() and the
+// servers themselves are stopped with a signal, so neither would ever hand in
+// its counts.  Linked with -Wl,--wrap=_exit, every _exit() here dumps them
+// first, and SIGTERM dumps and exits (a server that handles SIGTERM itself,
+// like Ex9, returns from main() anyway).
+#include <signal.h>
+#include <unistd.h>
+
+void __gcov_dump(void);
+void __real__exit(int status) __attribute__((noreturn));
+
+void __wrap__exit(int status) {
+    __gcov_dump();
+    __real__exit(status);
+}
+
+static void on_term(int signo) {
+    (void)signo;
+    __wrap__exit(0);
+}
+
+__attribute__((constructor)) static void pgo_gen_init(void) {
+    signal(SIGTERM, on_term);
+}
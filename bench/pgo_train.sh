@@ -0,0 +1,57 @@
+#!/bin/sh
+# pgo_train.sh — the workloads `make pgo` profiles the servers on
+#
+# Usage: bench/pgo_train.sh SERVERS_DIR TOOLS_DIR
+#   SERVERS_DIR  the instrumented build (build/pgo), whose servers get run
+#   TOOLS_DIR    a plain build (build/O2) of the bench tools that drive them
+#
+# Each server runs alone (from inside SERVERS_DIR, so whatever it logs stays
+# there) on port 8080 under the benchmark that exercises its hot path, and is
+# stopped with SIGTERM so it writes its profile.  Ex1 and Ex3 are not trained
+# (one recv() per message is no protocol to benchmark);
+# -fprofile-partial-training keeps their code optimized as usual.
+set -e
+srv=$1
+tools=$2
+[ -x "$srv/Ex5/server" ] && [ -x "$tools/bench/echo_bench" ] || {
+    echo "usage: $0 SERVERS_DIR TOOLS_DIR (run by make pgo)" >&2; exit 2; }
+
+pid=
+start() {
+    bin=$1; shift
+    echo "== $bin $*"
+    (cd "$srv" && exec "./$bin" "$@") > /dev/null 2>&1 &     # logs land in there too
+    pid=$!
+    sleep 0.5
+}
+stop() {
+    kill -TERM "$pid" 2>/dev/null || true
+    wait "$pid" 2>/dev/null || true
+    sleep 0.3                         # children finish writing their profiles
+}
+trap 'kill -TERM $pid 2>/dev/null || true' EXIT
+
+# Echo: pipelined TCP lines, batched UDP, fork-per-client with pools.
+start Ex5/server -n
+"$tools/bench/echo_bench" -t -c 8 -w 16 -n 400000
+stop
+start Ex5/server -u 1
+"$tools/bench/echo_bench" -c 8 -w 16 -n 400000
+stop
+start Ex6/server
+"$tools/bench/steer_bench" -c 16 -d 3
+stop
+
+# One-shot and keep-alive request/reply.
+for ex in Ex2 Ex4; do
+    start $ex/server
+    "$tools/bench/keepalive_bench" -n 5000
+    stop
+done
+
+# Chat brokers: floods, light users, newcomers.
+for ex in Ex7 Ex8 Ex9; do
+    start $ex/server
+    "$tools/bench/overload_bench" -f 10 -u 5 -d 3
+    stop
+done
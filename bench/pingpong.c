@@ -0,0 +1,168 @@
+// pingpong.c — request/reply tail latency against server CPU, for -B tuning
+//
+// Build: gcc -Wall -Wextra -O2 pingpong.c -o pingpong
+// Run:   ../Ex5/server -n [-B spin=US,...]   then   ./pingpong [-n msgs] [-i idle_us] [-P cpu]
+//        ../Ex8/server [-B spin=US,...]      then   ./pingpong -x [-n msgs] [-i idle_us] [-P cpu]
+//
+// One message at a time: send a line, wait for its echo (-x: for a second
+// chat client to receive the broadcast), record the round trip, then stay
+// quiet for -i microseconds so the server has a chance to go to sleep — the
+// wake-up is what busy polling is meant to save.  CPU is the whole machine's
+// busy share from /proc/stat over the run minus this process, i.e. roughly
+// what the server burnt, in cores.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Busy and total jiffies over all CPUs.
+static void cpu_jiffies(uint64_t *busy, uint64_t *total) {
+    unsigned long long v[8] = {0};
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f || fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                     &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8) {
+        *busy = *total = 0;
+    } else {
+        *total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        *busy = *total - v[3] - v[4];               // minus idle and iowait
+    }
+    if (f) fclose(f);
+}
+
+static double self_cpu_secs(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+         + (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int dial(const struct sockaddr_in *sa) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const struct sockaddr*)sa, sizeof(*sa)) < 0) { perror("connect"); exit(1); }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Read lines from fd until one contains `want`; anything else (welcome,
+// join notices) is skipped.  Returns 0, or -1 on EOF/error.
+static int wait_for(int fd, const char *want) {
+    static char buf[8192];
+    static size_t have;
+    for (;;) {
+        char *nl;
+        while ((nl = memchr(buf, '\n', have)) != NULL) {
+            *nl = '\0';
+            int hit = strstr(buf, want) != NULL;
+            size_t used = (size_t)(nl + 1 - buf);
+            memmove(buf, nl + 1, have - used);
+            have -= used;
+            if (hit) return 0;
+        }
+        if (have == sizeof(buf)) have = 0;          // overlong junk line
+        ssize_t n = recv(fd, buf + have, sizeof(buf) - have, 0);
+        if (n <= 0) return -1;
+        have += (size_t)n;
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 8080, chat = 0, pin = -1;
+    long nmsgs = 20000, idle_us = 200;
+    for (int ch; (ch = getopt(argc, argv, "xn:i:P:H:p:")) != -1; ) {
+        switch (ch) {
+        case 'x': chat = 1; break;
+        case 'n': nmsgs = atol(optarg); break;
+        case 'i': idle_us = atol(optarg); break;
+        case 'P': pin = atoi(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-x] [-n msgs] [-i idle_us] [-P cpu] [-H host] [-p port]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (nmsgs < 1) nmsgs = 1;
+    if (pin >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(pin, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) perror("pin");
+    }
+
+    struct sockaddr_in sa = {0};
+    sa.sin_family = AF_INET; sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 1; }
+
+    int tx = dial(&sa), rx = tx;
+    if (chat) {
+        rx = dial(&sa);
+        usleep(200 * 1000);                         // let both children start
+        if (send(tx, "ping-sync\n", 10, 0) != 10 || wait_for(rx, "ping-sync") < 0) {
+            fprintf(stderr, "no broadcast from the chat server\n");
+            return 1;
+        }
+    }
+
+    uint64_t *rtt = malloc((size_t)nmsgs * sizeof(*rtt));
+    if (!rtt) { perror("malloc"); return 1; }
+    struct timespec idle = { idle_us / 1000000, (idle_us % 1000000) * 1000 };
+
+    uint64_t busy0, total0, busy1, total1;
+    cpu_jiffies(&busy0, &total0);
+    double self0 = self_cpu_secs();
+    uint64_t t0 = now_ns();
+    for (long i = 0; i < nmsgs; i++) {
+        char line[64], want[32];
+        int len = snprintf(line, sizeof(line), "ping %ld\n", i);
+        snprintf(want, sizeof(want), "ping %ld", i);
+        uint64_t t = now_ns();
+        if (send(tx, line, (size_t)len, 0) != len || wait_for(rx, want) < 0) {
+            fprintf(stderr, "connection lost after %ld messages\n", i);
+            nmsgs = i;
+            break;
+        }
+        rtt[i] = now_ns() - t;
+        if (idle_us > 0) nanosleep(&idle, NULL);
+    }
+    double secs = (double)(now_ns() - t0) / 1e9;
+    double self = self_cpu_secs() - self0;
+    cpu_jiffies(&busy1, &total1);
+    if (nmsgs == 0) return 1;
+
+    long hz = sysconf(_SC_CLK_TCK);
+    double machine = (double)(busy1 - busy0) / (double)hz;        // CPU-seconds, all cores
+    double server = machine > self ? machine - self : 0;
+
+    qsort(rtt, (size_t)nmsgs, sizeof(*rtt), cmp_u64);
+    printf("%s: %ld msgs, %ld us idle between them, %.2f s\n", chat ? "chat broadcast" : "echo", nmsgs, idle_us, secs);
+    printf("round trip us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           (double)rtt[nmsgs / 2] / 1e3, (double)rtt[nmsgs * 9 / 10] / 1e3, (double)rtt[nmsgs * 99 / 100] / 1e3,
+           (double)rtt[nmsgs * 999 / 1000] / 1e3, (double)rtt[nmsgs - 1] / 1e3);
+    printf("cpu: server ~%.2f cores, client %.2f cores (%.1f us server CPU per msg)\n",
+           server / secs, self / secs, server * 1e6 / (double)nmsgs);
+    return 0;
+}
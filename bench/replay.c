@@ -0,0 +1,257 @@
+// replay.c — replay a captured chat trace against a broker and time delivery
+//
+// Build: gcc -Wall -Wextra -O2 replay.c ../common/trace.c -o replay
+// Run:   ../Ex8/server -c prod.trace      (capture, later Ctrl+C)
+//        ./replay [-s speed] [-H host] [-p port] prod.trace
+//
+// Each connection in the trace becomes one synthetic client that connects at
+// its JOIN, sends its messages at the recorded offsets (divided by -s; -s 0
+// sends as fast as possible) and disconnects at its LEAVE.  Chat lines are
+// tagged "~<seq>~ " so every copy the broker fans out can be matched to its
+// send time; the report is per-delivery latency.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "../common/trace.h"
+
+#define MAX_CONN   4096
+#define RBUF       8192
+#define SEQ_RING   (1u << 20)       // send times kept for the last 1M messages
+
+typedef struct {
+    int    fd;
+    size_t have;
+    char   rbuf[RBUF];
+} client_t;
+
+static client_t *clients[MAX_CONN];
+static struct pollfd pfds[MAX_CONN];
+static int pfd_conn[MAX_CONN];
+static int npfds;
+
+static uint64_t sent_at[SEQ_RING];
+static uint64_t *lat;                // delivery latencies in ns
+static size_t nlat, lat_cap;
+static uint64_t seq, msgs_sent, bytes_sent, connects, disconnects;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void record_latency(uint64_t ns) {
+    if (nlat == lat_cap) {
+        lat_cap = lat_cap ? lat_cap * 2 : 1 << 16;
+        lat = realloc(lat, lat_cap * sizeof(*lat));
+        if (!lat) { perror("realloc"); exit(1); }
+    }
+    lat[nlat++] = ns;
+}
+
+static void rebuild_pollset(void) {
+    npfds = 0;
+    for (int c = 0; c < MAX_CONN; c++) {
+        if (!clients[c]) continue;
+        pfds[npfds].fd = clients[c]->fd;
+        pfds[npfds].events = POLLIN;
+        pfd_conn[npfds++] = c;
+    }
+}
+
+// Look for our "~seq~ " tag in each complete line a client received.  The
+// broker prefixes "nick: ", and a nick or the replayed text may hold a '~'
+// of its own, so take the first '~' that starts the whole pattern.
+static void scan_deliveries(client_t *cl, uint64_t t) {
+    char *p = cl->rbuf, *end = cl->rbuf + cl->have;
+    for (;;) {
+        char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) break;
+        for (char *tag = p; (tag = memchr(tag, '~', (size_t)(nl - tag))) != NULL; tag++) {
+            char *q = tag + 1;
+            unsigned long long s = 0;
+            while (q < nl && *q >= '0' && *q <= '9') s = s * 10 + (unsigned)(*q++ - '0');
+            if (q == tag + 1 || q + 1 >= nl || q[0] != '~' || q[1] != ' ') continue;
+            if (s < seq && seq - s <= SEQ_RING) record_latency(t - sent_at[s % SEQ_RING]);
+            break;
+        }
+        p = nl + 1;
+    }
+    cl->have = (size_t)(end - p);
+    memmove(cl->rbuf, p, cl->have);
+    if (cl->have == RBUF) cl->have = 0;          // line longer than buffer: drop
+}
+
+static void close_client(int c) {
+    close(clients[c]->fd);
+    free(clients[c]);
+    clients[c] = NULL;
+    disconnects++;
+    rebuild_pollset();
+}
+
+// Read whatever is ready on every client.  timeout_ms < 0 blocks.
+static void pump(int timeout_ms) {
+    int r = poll(pfds, (nfds_t)npfds, timeout_ms);
+    if (r <= 0) return;
+    uint64_t t = now_ns();
+    for (int i = 0; i < npfds; i++) {
+        if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        client_t *cl = clients[pfd_conn[i]];
+        ssize_t n = recv(cl->fd, cl->rbuf + cl->have, RBUF - cl->have, MSG_DONTWAIT);
+        if (n > 0) { cl->have += (size_t)n; scan_deliveries(cl, t); }
+        else if (n == 0 || (errno != EAGAIN && errno != EINTR)) { close_client(pfd_conn[i]); return; }
+    }
+}
+
+// Non-blocking send that keeps draining inbound traffic while it waits, so a
+// broker blocked on writing to us can never deadlock the replay.
+static int send_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w > 0) { p += w; n -= (size_t)w; continue; }
+        if (w < 0 && errno != EAGAIN && errno != EINTR) return -1;
+        pump(1);
+    }
+    return 0;
+}
+
+static int open_client(unsigned conn, const struct sockaddr_in *sa) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    if (connect(fd, (const struct sockaddr*)sa, sizeof(*sa)) < 0) { perror("connect"); close(fd); return -1; }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    client_t *cl = calloc(1, sizeof(*cl));
+    if (!cl) { close(fd); return -1; }
+    cl->fd = fd;
+    clients[conn] = cl;
+    connects++;
+    rebuild_pollset();
+    return 0;
+}
+
+static void play(const trace_record_t *rec, const struct sockaddr_in *sa) {
+    if (rec->conn >= MAX_CONN) return;
+    client_t *cl = clients[rec->conn];
+
+    switch (rec->type) {
+    case TR_JOIN:
+        if (cl) close_client((int)rec->conn);
+        open_client(rec->conn, sa);
+        break;
+    case TR_LEAVE:
+        if (cl) close_client((int)rec->conn);
+        break;
+    case TR_MSG: {
+        if (!cl) return;
+        char line[70000];
+        int n;
+        if (rec->data[0] == '/' || (rec->len == 4 && !memcmp(rec->data, "exit", 4))) {
+            n = snprintf(line, sizeof(line), "%.*s\n", (int)rec->len, rec->data);
+        } else {
+            uint64_t s = seq++;
+            n = snprintf(line, sizeof(line), "~%llu~ %.*s\n",
+                         (unsigned long long)s, (int)rec->len, rec->data);
+            sent_at[s % SEQ_RING] = now_ns();
+        }
+        if (send_all(cl->fd, line, (size_t)n) < 0) {
+            if (clients[rec->conn]) close_client((int)rec->conn);   // pump() may have already
+            return;
+        }
+        msgs_sent++;
+        bytes_sent += (uint64_t)n;
+        break;
+    }
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct(double p) {
+    if (!nlat) return 0;
+    size_t i = (size_t)(p / 100.0 * (double)(nlat - 1));
+    return lat[i] / 1e3;
+}
+
+int main(int argc, char **argv) {
+    double speed = 1.0;
+    const char *host = "127.0.0.1";
+    int port = 8080;
+
+    for (int ch; (ch = getopt(argc, argv, "s:H:p:")) != -1; ) {
+        switch (ch) {
+        case 's': speed = atof(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:  goto usage;
+        }
+    }
+    if (optind != argc - 1) {
+usage:
+        fprintf(stderr, "usage: %s [-s speed (0 = max)] [-H host] [-p port] trace\n", argv[0]);
+        return 2;
+    }
+
+    trace_reader_t tr;
+    if (trace_open_read(&tr, argv[optind]) < 0) { fprintf(stderr, "%s: not a chat trace\n", argv[optind]); return 1; }
+
+    struct sockaddr_in sa = {0};
+    sa.sin_family = AF_INET; sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 1; }
+
+    static trace_record_t rec;
+    uint64_t start = now_ns(), last_t_us = 0, records = 0;
+    int r;
+    while ((r = trace_read(&tr, &rec)) == 1) {
+        records++;
+        last_t_us = rec.t_us;
+        if (speed > 0) {
+            uint64_t due = start + (uint64_t)((double)rec.t_us * 1000.0 / speed);
+            for (uint64_t t; (t = now_ns()) < due; ) {
+                uint64_t wait_ms = (due - t) / 1000000;
+                pump(wait_ms > 0 ? (int)wait_ms : 0);
+            }
+        } else {
+            pump(0);
+        }
+        play(&rec, &sa);
+    }
+    if (r < 0) fprintf(stderr, "warning: trace truncated after %llu records\n", (unsigned long long)records);
+    trace_close_read(&tr);
+    uint64_t send_done = now_ns();
+
+    // Let the last broadcasts arrive before measuring.
+    for (uint64_t quiet_until = now_ns() + 500000000ull; now_ns() < quiet_until; ) pump(50);
+    for (int c = 0; c < MAX_CONN; c++) if (clients[c]) close_client(c);
+
+    double secs = (double)(send_done - start) / 1e9;
+    qsort(lat, nlat, sizeof(*lat), cmp_u64);
+    printf("trace: %llu records over %.3f s; replayed at %s in %.3f s\n",
+           (unsigned long long)records, (double)last_t_us / 1e6,
+           speed > 0 ? "fixed speed" : "max speed", secs);
+    printf("clients: %llu connects, %llu disconnects\n",
+           (unsigned long long)connects, (unsigned long long)disconnects);
+    printf("sent: %llu msgs (%.0f msg/s, %llu bytes), deliveries: %zu\n",
+           (unsigned long long)msgs_sent, secs > 0 ? (double)msgs_sent / secs : 0.0,
+           (unsigned long long)bytes_sent, nlat);
+    printf("delivery latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           pct(50), pct(90), pct(99), pct(99.9), nlat ? lat[nlat - 1] / 1e3 : 0.0);
+    free(lat);
+    return 0;
+}
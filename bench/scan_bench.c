@@ -0,0 +1,110 @@
+// scan_bench.c — line framing: byte-wise trim() vs scalar/SSE2/AVX2 scan_lines()
+//
+// Build: gcc -Wall -Wextra -O2 scan_bench.c ../common/scan.c -o scan_bench
+// Run:   ./scan_bench [iterations]
+//
+// Fills a 64 KiB receive buffer with pipelined lines of a given average length
+// (mixed "\n" / "\r\n" endings) and measures how fast each method splits it.
+// "trim" is the old per-message path: find the '\n' byte by byte, copy the
+// line into a NUL-terminated buffer (as recv() did), strlen() it and walk
+// back over '\r'/'\n'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/scan.h"
+
+#define BUF_SIZE  65536
+#define MAX_SPANS 8192
+
+static char src[BUF_SIZE];
+static span_t spans[MAX_SPANS];
+static volatile size_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void trim(char *s){
+    size_t n = strlen(s);
+    while (n && (s[n-1]=='\n' || s[n-1]=='\r')) s[--n] = '\0';
+}
+
+static size_t fill(size_t avg_len) {
+    size_t n = 0;
+    srand(42);
+    while (n + avg_len * 2 + 2 < BUF_SIZE) {
+        size_t len = avg_len / 2 + (size_t)rand() % (avg_len + 1);
+        for (size_t i = 0; i < len; i++) src[n++] = (char)('a' + rand() % 26);
+        if (rand() & 1) src[n++] = '\r';
+        src[n++] = '\n';
+    }
+    return n;
+}
+
+// Old approach: walk bytes to each '\n', then do what the servers did with
+// each recv()ed message — NUL-terminate a copy and trim() it.
+static size_t split_trim(const char *buf, size_t n) {
+    static char line[BUF_SIZE + 1];
+    size_t lines = 0, start = 0, total = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] != '\n') continue;
+        size_t len = i + 1 - start;
+        memcpy(line, buf + start, len);
+        line[len] = '\0';
+        trim(line);
+        total += strlen(line);
+        start = i + 1;
+        lines++;
+    }
+    sink = total;
+    return lines;
+}
+
+static size_t split_scan(scan_fn f, const char *buf, size_t n) {
+    size_t off = 0, lines = 0, k;
+    do {
+        size_t used;
+        k = f(buf + off, n - off, spans, MAX_SPANS, &used);
+        lines += k;
+        off += used;
+    } while (k == MAX_SPANS);
+    sink = spans[0].len;
+    return lines;
+}
+
+int main(int argc, char **argv) {
+    int iters = argc > 1 ? atoi(argv[1]) : 2000;
+    static const size_t lens[] = { 16, 60, 400 };
+    static const char *const impls[] = { "scalar", "sse2", "avx2" };
+
+    printf("default impl: %s, buffer %d KiB, %d iterations\n",
+           scan_impl_name(), BUF_SIZE / 1024, iters);
+    printf("%-8s %-8s %10s %10s %10s\n", "avg_len", "method", "lines", "MB/s", "ns/line");
+
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        size_t n = fill(lens[l]);
+
+        size_t lines = 0;
+        double t0 = now_ns();
+        for (int it = 0; it < iters; it++) lines = split_trim(src, n);
+        double ns = now_ns() - t0;
+        printf("%-8zu %-8s %10zu %10.0f %10.2f\n", lens[l], "trim", lines,
+               (double)n * iters / ns * 1e3, ns / ((double)lines * iters));
+
+        for (size_t m = 0; m < sizeof(impls) / sizeof(impls[0]); m++) {
+            scan_fn f = scan_get_impl(impls[m]);
+            if (!f) { printf("%-8zu %-8s %10s\n", lens[l], impls[m], "n/a"); continue; }
+            t0 = now_ns();
+            for (int it = 0; it < iters; it++) lines = split_scan(f, src, n);
+            ns = now_ns() - t0;
+            printf("%-8zu %-8s %10zu %10.0f %10.2f\n", lens[l], impls[m], lines,
+                   (double)n * iters / ns * 1e3, ns / ((double)lines * iters));
+        }
+    }
+    return 0;
+}
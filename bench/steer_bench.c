@@ -0,0 +1,178 @@
+// steer_bench.c — what the server's CPUs pay per echo, with and without steer=1
+//
+// Build: gcc -Wall -Wextra -O2 steer_bench.c ../common/latency.c -o steer_bench
+// Run:   ../Ex6/server -m 9100 -A shards=4[,steer=1] &      (note the shard pids)
+//        ./steer_bench -P pid [-P pid ...] [-M 9100] [-c conns] [-d secs] [-s size]
+//
+// -c connections each keep one line of -s bytes in flight against an echo
+// server ("Echo: ..." back) for -d seconds.  The server's processes given with
+// -P are counted with perf_event_open() from before the first connection to
+// after the last child has gone (inherit=1, so the per-connection children
+// are included): cache misses and references (hardware counters; "n/a" in
+// most VMs), CPU migrations and context switches.  With -M it also reads
+// server_cross_cpu_connections_total from the metrics endpoint: how many
+// connections were handled on another CPU than the one their packets were
+// processed on.  Run once per mode and compare misses per echo; steering
+// only changes anything when several CPUs take network interrupts (RSS/RPS)
+// and this load generator runs on other cores than the server.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "../common/latency.h"
+
+#define MAX_CONNS 1024
+#define MAX_PIDS  64
+#define MAX_SIZE  1000
+
+enum { EV_MISSES, EV_REFS, EV_MIGRATIONS, EV_SWITCHES, NUM_EVENTS };
+
+static const struct { uint32_t type; uint64_t config; const char *name; } EVENTS[NUM_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache-references" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu-migrations" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches" },
+};
+
+typedef struct {
+    int    fd;
+    size_t have;              // reply bytes so far
+    uint64_t sent;            // when the line in flight went out
+    char   in[MAX_SIZE + 16];
+} conn_t;
+
+static conn_t g_conn[MAX_CONNS];
+static int    g_perf[MAX_PIDS][NUM_EVENTS];
+
+static int perf_open(pid_t pid, int ev) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof(a));
+    a.size = sizeof(a);
+    a.type = EVENTS[ev].type;
+    a.config = EVENTS[ev].config;
+    a.inherit = 1;            // children forked from now on count too (added when they exit)
+    a.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &a, pid, -1, -1, 0);
+}
+
+// The value of one counter in the server's /metrics output, or -1.
+static long long scrape(int port, const char *name) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) { if (fd >= 0) close(fd); return -1; }
+    const char *req = "GET /metrics HTTP/1.0\r\n\r\n";
+    if (send(fd, req, strlen(req), 0) < 0) { close(fd); return -1; }
+    static char body[1 << 20];
+    size_t n = 0;
+    for (ssize_t r; n < sizeof(body) - 1 && (r = recv(fd, body + n, sizeof(body) - 1 - n, 0)) > 0; ) n += (size_t)r;
+    close(fd);
+    body[n] = '\0';
+    for (char *p = body; (p = strstr(p, name)) != NULL; p += strlen(name))
+        if ((p == body || p[-1] == '\n') && p[strlen(name)] == ' ') return atoll(p + strlen(name) + 1);
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    pid_t pids[MAX_PIDS];
+    int npids = 0, conns = 64, size = 64, port = 8080, mport = 0;
+    double secs = 10;
+    const char *host = "127.0.0.1";
+    for (int ch; (ch = getopt(argc, argv, "P:M:c:d:s:H:p:")) != -1; ) {
+        switch (ch) {
+        case 'P': if (npids < MAX_PIDS) pids[npids++] = (pid_t)atoi(optarg); break;
+        case 'M': mport = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'd': secs = atof(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'H': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s -P server_pid [-P pid ...] [-M metrics_port] [-c conns] [-d secs] "
+                            "[-s size] [-H host] [-p port]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (conns < 1 || conns > MAX_CONNS || size < 2 || size > MAX_SIZE) { fprintf(stderr, "bad -c/-s\n"); return 2; }
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) { fprintf(stderr, "bad host %s\n", host); return 2; }
+
+    for (int p = 0; p < npids; p++)
+        for (int ev = 0; ev < NUM_EVENTS; ev++) {
+            g_perf[p][ev] = perf_open(pids[p], ev);
+            if (g_perf[p][ev] < 0 && p == 0) fprintf(stderr, "%s: %s\n", EVENTS[ev].name, strerror(errno));
+        }
+    long long cross0 = mport ? scrape(mport, "server_cross_cpu_connections_total") : -1;
+
+    char line[MAX_SIZE];
+    memset(line, 'x', (size_t)size - 1);
+    line[size - 1] = '\n';
+    int ep = epoll_create1(0);
+    for (int k = 0; k < conns; k++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("connect"); return 1; }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        g_conn[k].fd = fd;
+        g_conn[k].sent = mono_ns();
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &g_conn[k] };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        if (send(fd, line, (size_t)size, 0) != size) { perror("send"); return 1; }
+    }
+
+    // One line in flight per connection; "Echo: " + the line comes back.
+    size_t reply = 6 + (size_t)size;
+    lat_hist_t lat = {0};
+    long echoes = 0;
+    uint64_t t0 = mono_ns(), end = t0 + (uint64_t)(secs * 1e9);
+    while (mono_ns() < end) {
+        struct epoll_event evs[64];
+        int n = epoll_wait(ep, evs, 64, 100);
+        for (int e = 0; e < n; e++) {
+            conn_t *c = (conn_t*)evs[e].data.ptr;
+            ssize_t r = recv(c->fd, c->in + c->have, reply - c->have, 0);
+            if (r <= 0) { fprintf(stderr, "server closed a connection\n"); return 1; }
+            c->have += (size_t)r;
+            if (c->have < reply) continue;
+            c->have = 0;
+            echoes++;
+            uint64_t now = mono_ns();
+            lat_hist_add(&lat, now - c->sent);
+            c->sent = now;
+            if (send(c->fd, line, (size_t)size, 0) != size) { perror("send"); return 1; }
+        }
+    }
+    double took = (mono_ns() - t0) / 1e9;
+    for (int k = 0; k < conns; k++) close(g_conn[k].fd);
+    usleep(500 * 1000);                             // children exit and hand in their counts
+    long long cross = mport ? scrape(mport, "server_cross_cpu_connections_total") : -1;
+
+    printf("%d conns x %d bytes, %.1f s: %ld echoes, %.0f echoes/s\n", conns, size, took, echoes, echoes / took);
+    for (int ev = 0; ev < NUM_EVENTS; ev++) {
+        long long total = 0;
+        int have = 0;
+        for (int p = 0; p < npids; p++) {
+            long long v;
+            if (g_perf[p][ev] >= 0 && read(g_perf[p][ev], &v, sizeof(v)) == (ssize_t)sizeof(v)) { total += v; have = 1; }
+        }
+        if (have) printf("  %-18s %14lld  %10.2f per echo\n", EVENTS[ev].name, total, echoes ? (double)total / echoes : 0.0);
+        else      printf("  %-18s %14s\n", EVENTS[ev].name, npids ? "n/a" : "(no -P)");
+    }
+    if (cross >= 0 && cross0 >= 0)
+        printf("  connections handled off their packets' CPU: %lld of %d\n", cross - cross0, conns);
+    lat_hist_print_header(stdout);
+    lat_hist_print(stdout, "round trip", &lat);
+    return 0;
+}
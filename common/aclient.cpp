@@ -0,0 +1,541 @@
+// aclient.cpp — asynchronous, pooled, pipelining client (see aclient.h)
+#include "aclient.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "latency.h"
+#include "listen.h"
+#include "opts.h"
+
+#define RECV_CHUNK 65536
+#define EVENTS     64
+
+int aclient_opts_parse(aclient_opts_t *o, const char *s) {
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long n = kv.num;
+        if (opt_key(&kv, "proto")) {
+            if      (opt_val(&kv, "lines"))     o->proto = ACLIENT_LINES;
+            else if (opt_val(&kv, "keepalive")) o->proto = ACLIENT_KEEPALIVE;
+            else return -1;
+        }
+        else if (n < 0) return -1;
+        else if (opt_key(&kv, "conns") && n > 0)  o->conns = (int)n;
+        else if (opt_key(&kv, "window") && n > 0) o->window = (int)n;
+        else if (opt_key(&kv, "timeout"))         o->timeout_ms = (int)n;
+        else if (opt_key(&kv, "backoff"))         o->backoff_ms = (int)n;
+        else if (opt_key(&kv, "backoff_max"))     o->backoff_max_ms = (int)n;
+        else if (opt_key(&kv, "pending"))         o->max_pending = (size_t)n;
+        else return -1;
+    }
+    return r;
+}
+
+namespace {
+
+struct req_t {
+    int          ep;
+    uint64_t     id;
+    std::string  payload;
+    aclient_cb_t cb;
+    uint64_t     t_submit, deadline;
+};
+
+enum conn_state { C_DOWN, C_CONNECTING, C_GREETING, C_UP, C_BACKOFF };
+
+struct endpoint_t;
+
+struct conn_t {
+    endpoint_t *ep;
+    int         fd = -1;
+    conn_state  state = C_DOWN;
+    bool        want_out = false;     // EPOLLOUT armed
+    uint64_t    retry_at = 0;
+    int         backoff_ms = 0;       // next delay; 0 after a success
+    std::deque<req_t> inflight;       // sent, in the order replies will come
+    std::string out, in;
+    size_t      out_off = 0;
+};
+
+struct endpoint_t {
+    std::string spec;
+    sockaddr_storage sa;
+    socklen_t   sa_len;
+    int         family, type;
+    std::vector<std::unique_ptr<conn_t>> conns;
+    std::deque<req_t> pending;        // not yet on a connection
+};
+
+}  // namespace
+
+struct aclient::impl {
+    aclient_opts_t o;
+    int epfd = -1, evfd = -1;
+    std::vector<std::unique_ptr<endpoint_t>> eps;
+
+    std::mutex         mu;            // guards inbox and eps.size() for submit()
+    std::vector<req_t> inbox;
+    std::atomic<uint64_t> next_id{1};
+    std::atomic<size_t>   outstanding{0};
+    std::atomic<bool>     running{false};
+    std::thread           thr;
+
+    std::atomic<uint64_t> n_sent{0}, n_replies{0}, n_failed{0}, n_connects{0}, n_reconnects{0}, n_byes{0};
+    int completed = 0;                // by the current poll()
+    std::unique_ptr<char[]> chunk{new char[RECV_CHUNK]};   // recv() target, never zero-filled
+    std::string             joined;   // a carried-over partial line + the new chunk
+
+    void complete(req_t &r, int err, const char *reply, size_t len);
+    void fail_all(std::deque<req_t> &q, int err);
+    void arm(conn_t *c, bool out);
+    void connect_conn(conn_t *c);
+    void drop(conn_t *c, int err);
+    void bye(conn_t *c);
+    void on_up(conn_t *c);
+    void on_line(conn_t *c, const char *p, size_t len);
+    void on_readable(conn_t *c);
+    void flush(conn_t *c);
+    void dispatch(endpoint_t *e);
+    void take_inbox();
+    int  timers(uint64_t now);
+};
+
+void aclient::impl::complete(req_t &r, int err, const char *reply, size_t len) {
+    aclient_result_t res;
+    res.err = err;
+    if (reply) res.reply.assign(reply, len);
+    res.latency_ns = mono_ns() - r.t_submit;
+    (err ? n_failed : n_replies)++;
+    outstanding--;
+    completed++;
+    aclient_cb_t cb = std::move(r.cb);
+    if (cb) cb(res);
+}
+
+void aclient::impl::fail_all(std::deque<req_t> &q, int err) {
+    std::deque<req_t> gone;
+    gone.swap(q);                     // callbacks may submit; keep q consistent
+    for (req_t &r : gone) complete(r, err, nullptr, 0);
+}
+
+void aclient::impl::arm(conn_t *c, bool out) {
+    if (c->want_out == out) return;
+    epoll_event ev{};
+    ev.events = EPOLLIN | (out ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_out = out;
+}
+
+void aclient::impl::connect_conn(conn_t *c) {
+    endpoint_t *e = c->ep;
+    int fd = socket(e->family, e->type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { drop(c, errno); return; }
+    if (e->family != AF_UNIX) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    c->fd = fd;
+    n_connects++;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    c->want_out = true;
+    if (connect(fd, (sockaddr*)&e->sa, e->sa_len) < 0 && errno != EINPROGRESS) { drop(c, errno); return; }
+    c->state = C_CONNECTING;          // writable once connected (or failed)
+}
+
+// Close c.  Requests in flight fail with err; a failed connect or a broken
+// connection waits out the backoff before the next attempt, and so does one
+// the server closed before it was up (full, busy, or refusing keep-alive).
+void aclient::impl::drop(conn_t *c, int err) {
+    if (c->fd >= 0) close(c->fd);     // also leaves the epoll set
+    c->fd = -1;
+    c->want_out = false;
+    c->out.clear();
+    c->out_off = 0;
+    c->in.clear();
+    bool idle_close = err == 0 && c->state == C_UP && c->inflight.empty();
+    fail_all(c->inflight, err ? err : ECONNRESET);
+    if (idle_close) {                 // the server closed an idle connection: no penalty
+        c->state = C_DOWN;
+        return;
+    }
+    int ms = c->backoff_ms ? c->backoff_ms : o.backoff_ms;
+    c->backoff_ms = ms * 2 < o.backoff_max_ms ? ms * 2 : o.backoff_max_ms;
+    ms = ms / 2 + rand() % (ms / 2 + 1);          // jitter, so a pool does not reconnect in step
+    c->retry_at = mono_ns() + (uint64_t)ms * 1000000;
+    c->state = C_BACKOFF;
+    n_reconnects++;
+}
+
+// "BYE idle|max": the server answered everything before it and nothing
+// after, so the rest goes out again, first, on another connection.
+void aclient::impl::bye(conn_t *c) {
+    n_byes++;
+    endpoint_t *e = c->ep;
+    while (!c->inflight.empty()) {
+        e->pending.push_front(std::move(c->inflight.back()));
+        c->inflight.pop_back();
+    }
+    drop(c, 0);
+}
+
+void aclient::impl::on_up(conn_t *c) {
+    c->state = C_UP;
+    c->backoff_ms = 0;
+    dispatch(c->ep);
+}
+
+void aclient::impl::on_line(conn_t *c, const char *p, size_t len) {
+    if (len && p[len - 1] == '\r') len--;
+    if (o.proto == ACLIENT_KEEPALIVE) {
+        if (c->state == C_GREETING) {
+            if (len < 9 || memcmp(p, "KEEPALIVE", 9)) { drop(c, EPROTO); return; }
+            on_up(c);
+            return;
+        }
+        if (len >= 3 && !memcmp(p, "BYE", 3)) { bye(c); return; }
+        const char *sp = (const char*)memchr(p, ' ', len);
+        char *end;
+        uint64_t id = strtoull(p, &end, 10);
+        if (!sp || end != sp || c->inflight.empty() || c->inflight.front().id != id) { drop(c, EPROTO); return; }
+        size_t idlen = (size_t)(sp - p) + 1;
+        p += idlen;
+        len -= idlen;
+    } else if (c->inflight.empty()) {
+        return;                       // unsolicited, e.g. Ex5's idle "Timeout: ... Goodbye."
+    }
+    req_t r = std::move(c->inflight.front());
+    c->inflight.pop_front();
+    complete(r, 0, p, len);
+}
+
+void aclient::impl::on_readable(conn_t *c) {
+    ssize_t n = recv(c->fd, chunk.get(), RECV_CHUNK, 0);
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        drop(c, n == 0 ? 0 : errno);
+        return;
+    }
+    if (c->ep->family != AF_UNIX) {
+        // Ack at once: a server with Nagle on holds its last reply of a burst
+        // until our ack, which delayed acks would put off by up to 40 ms.
+        int one = 1;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+    }
+
+    // Lines are handed out of memory c does not own: a callback may submit,
+    // and a BYE or protocol error drops c (and its buffer) half way through.
+    // Straight from the chunk, unless a partial line is waiting in c->in.
+    const char *p = chunk.get();
+    size_t len = (size_t)n;
+    if (!c->in.empty()) {
+        joined.assign(c->in).append(p, len);
+        c->in.clear();
+        p = joined.data();
+        len = joined.size();
+    }
+    int fd = c->fd;
+    size_t off = 0;
+    const char *nl;
+    while (c->fd == fd && (nl = (const char*)memchr(p + off, '\n', len - off)) != nullptr) {
+        size_t ll = (size_t)(nl - p) - off;
+        on_line(c, p + off, ll);
+        off += ll + 1;
+    }
+    if (c->fd == fd) c->in.assign(p + off, len - off);
+}
+
+void aclient::impl::flush(conn_t *c) {
+    while (c->out_off < c->out.size()) {
+        ssize_t w = send(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) { arm(c, true); return; }
+            drop(c, errno);
+            return;
+        }
+        c->out_off += (size_t)w;
+    }
+    c->out.clear();
+    c->out_off = 0;
+    arm(c, false);
+}
+
+// Put pending requests on the least loaded connections that are up, and
+// start the ones that are down.  Each connection then gets one send().
+void aclient::impl::dispatch(endpoint_t *e) {
+    if (e->pending.empty()) return;
+    for (auto &c : e->conns)
+        if (c->state == C_DOWN) connect_conn(c.get());
+
+    std::vector<conn_t*> up;
+    for (auto &c : e->conns)
+        if (c->state == C_UP && (int)c->inflight.size() < o.window) up.push_back(c.get());
+    if (up.empty()) return;
+
+    char id[24];
+    while (!e->pending.empty()) {
+        conn_t *best = nullptr;
+        for (conn_t *c : up)
+            if ((int)c->inflight.size() < o.window && (!best || c->inflight.size() < best->inflight.size())) best = c;
+        if (!best) break;
+        req_t &r = e->pending.front();
+        if (o.proto == ACLIENT_KEEPALIVE) {
+            int n = snprintf(id, sizeof(id), "%llu ", (unsigned long long)r.id);
+            best->out.append(id, (size_t)n);
+        }
+        best->out.append(r.payload);
+        best->out.push_back('\n');
+        r.payload.clear();
+        best->inflight.push_back(std::move(r));
+        e->pending.pop_front();
+        n_sent++;
+    }
+    for (conn_t *c : up)
+        if (c->fd >= 0 && c->out.size() > c->out_off && !c->want_out) flush(c);
+}
+
+void aclient::impl::take_inbox() {
+    std::vector<req_t> in;
+    {
+        std::lock_guard<std::mutex> g(mu);
+        in.swap(inbox);
+    }
+    for (req_t &r : in) {
+        endpoint_t *e = eps[(size_t)r.ep].get();
+        if (r.payload.find('\n') != std::string::npos) complete(r, EINVAL, nullptr, 0);
+        else if (e->pending.size() >= o.max_pending) complete(r, EAGAIN, nullptr, 0);
+        else e->pending.push_back(std::move(r));
+    }
+}
+
+// Expire requests and end backoffs; returns ms until the next deadline
+// (-1 if none).
+int aclient::impl::timers(uint64_t now) {
+    uint64_t next = UINT64_MAX;
+    for (auto &e : eps) {
+        // One timeout for all, so both queues are in deadline order.
+        while (!e->pending.empty() && e->pending.front().deadline <= now) {
+            req_t r = std::move(e->pending.front());
+            e->pending.pop_front();
+            complete(r, ETIMEDOUT, nullptr, 0);
+        }
+        if (!e->pending.empty() && e->pending.front().deadline < next) next = e->pending.front().deadline;
+        for (auto &cp : e->conns) {
+            conn_t *c = cp.get();
+            // A reply that is this late holds up every one behind it.
+            if (!c->inflight.empty() && c->inflight.front().deadline <= now) drop(c, ETIMEDOUT);
+            if (c->state == C_BACKOFF) {
+                if (c->retry_at <= now) c->state = C_DOWN;        // dispatch() reconnects if there is work
+                else if (c->retry_at < next) next = c->retry_at;
+            }
+            if (!c->inflight.empty() && c->inflight.front().deadline < next) next = c->inflight.front().deadline;
+        }
+    }
+    return next == UINT64_MAX ? -1 : (int)((next - now + 999999) / 1000000);
+}
+
+// --- aclient -----------------------------------------------------------------------
+
+aclient::aclient(const aclient_opts_t &o) : d(new impl) {
+    d->o = o;
+    if (d->o.conns < 1) d->o.conns = 1;
+    if (d->o.window < 1) d->o.window = 1;
+    if (d->o.backoff_ms < 1) d->o.backoff_ms = 1;
+    if (d->o.backoff_max_ms < d->o.backoff_ms) d->o.backoff_max_ms = d->o.backoff_ms;
+    d->epfd = epoll_create1(EPOLL_CLOEXEC);
+    d->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->epfd < 0 || d->evfd < 0) { perror("aclient"); abort(); }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(d->epfd, EPOLL_CTL_ADD, d->evfd, &ev);
+}
+
+aclient::~aclient() {
+    stop();
+    d->take_inbox();
+    for (auto &e : d->eps) {
+        for (auto &c : e->conns) {
+            if (c->fd >= 0) close(c->fd);
+            c->fd = -1;
+            d->fail_all(c->inflight, ECANCELED);
+        }
+        d->fail_all(e->pending, ECANCELED);
+    }
+    close(d->epfd);
+    close(d->evfd);
+}
+
+int aclient::endpoint(const char *spec) {
+    std::unique_ptr<endpoint_t> e(new endpoint_t);
+    e->spec = spec;
+    memset(&e->sa, 0, sizeof(e->sa));
+    if (!strncmp(spec, "unix:", 5) || !strncmp(spec, "seqpacket:", 10)) {
+        sockaddr_un un;
+        int type = local_addr(spec, &un);
+        if (type < 0) return -1;
+        memcpy(&e->sa, &un, sizeof(un));
+        e->sa_len = sizeof(un);
+        e->family = AF_UNIX;
+        e->type = type;
+    } else {
+        const char *colon = strrchr(spec, ':');
+        if (!colon || colon == spec) { errno = EINVAL; return -1; }
+        std::string host(spec, (size_t)(colon - spec));
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+        addrinfo hints{}, *res;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), colon + 1, &hints, &res) != 0) { errno = EHOSTUNREACH; return -1; }
+        memcpy(&e->sa, res->ai_addr, res->ai_addrlen);
+        e->sa_len = res->ai_addrlen;
+        e->family = res->ai_family;
+        e->type = SOCK_STREAM;
+        freeaddrinfo(res);
+    }
+    for (int k = 0; k < d->o.conns; k++) {
+        std::unique_ptr<conn_t> c(new conn_t);
+        c->ep = e.get();
+        e->conns.push_back(std::move(c));
+    }
+    std::lock_guard<std::mutex> g(d->mu);
+    d->eps.push_back(std::move(e));
+    return (int)d->eps.size() - 1;
+}
+
+void aclient::submit(int ep, const std::string &payload, aclient_cb_t cb) {
+    req_t r;
+    r.ep = ep;
+    r.id = d->next_id++;
+    r.payload = payload;
+    r.cb = std::move(cb);
+    r.t_submit = mono_ns();
+    r.deadline = r.t_submit + (uint64_t)d->o.timeout_ms * 1000000;
+    d->outstanding++;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> g(d->mu);
+        if (ep < 0 || (size_t)ep >= d->eps.size()) r.ep = -1;
+        else {
+            wake = d->inbox.empty();
+            d->inbox.push_back(std::move(r));
+        }
+    }
+    if (r.ep < 0) {                   // not one of ours: fail right here
+        aclient_result_t res;
+        res.err = EINVAL;
+        d->outstanding--;
+        d->n_failed++;
+        if (r.cb) r.cb(res);
+        return;
+    }
+    if (wake) {                       // one wake-up per batch of submissions
+        uint64_t one = 1;
+        ssize_t w = write(d->evfd, &one, sizeof(one));
+        (void)w;
+    }
+}
+
+std::future<aclient_result_t> aclient::call(int ep, const std::string &payload) {
+    std::shared_ptr<std::promise<aclient_result_t>> p(new std::promise<aclient_result_t>);
+    std::future<aclient_result_t> f = p->get_future();
+    submit(ep, payload, [p](aclient_result_t &r) { p->set_value(std::move(r)); });
+    return f;
+}
+
+int aclient::poll(int timeout_ms) {
+    impl *m = d.get();
+    m->completed = 0;
+    m->take_inbox();
+    for (auto &e : m->eps) m->dispatch(e.get());
+
+    int wait = m->timers(mono_ns());
+    if (wait < 0 || wait > timeout_ms) wait = timeout_ms;
+    if (m->completed) wait = 0;
+
+    epoll_event evs[EVENTS];
+    int n = epoll_wait(m->epfd, evs, EVENTS, wait);
+    for (int k = 0; k < n; k++) {
+        conn_t *c = (conn_t*)evs[k].data.ptr;
+        if (!c) {
+            uint64_t v;
+            ssize_t r = read(m->evfd, &v, sizeof(v));
+            (void)r;
+            m->take_inbox();
+            continue;
+        }
+        if (c->fd < 0) continue;      // dropped by an earlier event of this batch
+        if (c->state == C_CONNECTING) {
+            if (!(evs[k].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) { m->drop(c, err); continue; }
+            m->arm(c, false);
+            if (m->o.proto == ACLIENT_KEEPALIVE) {
+                c->state = C_GREETING;
+                c->out.assign("KEEPALIVE\n");
+                m->flush(c);
+            } else {
+                m->on_up(c);
+            }
+            continue;
+        }
+        if (evs[k].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) m->on_readable(c);
+        if (c->fd >= 0 && (evs[k].events & EPOLLOUT)) m->flush(c);
+    }
+
+    m->timers(mono_ns());
+    for (auto &e : m->eps) m->dispatch(e.get());
+    return m->completed;
+}
+
+void aclient::start() {
+    if (d->running.exchange(true)) return;
+    d->thr = std::thread([this] {
+        while (d->running.load(std::memory_order_relaxed)) poll(100);
+    });
+}
+
+void aclient::stop() {
+    if (!d->running.exchange(false)) return;
+    uint64_t one = 1;
+    ssize_t w = write(d->evfd, &one, sizeof(one));
+    (void)w;
+    d->thr.join();
+}
+
+size_t aclient::outstanding() const {
+    return d->outstanding.load();
+}
+
+aclient_stats_t aclient::stats() const {
+    aclient_stats_t s;
+    s.sent = d->n_sent;
+    s.replies = d->n_replies;
+    s.failed = d->n_failed;
+    s.connects = d->n_connects;
+    s.reconnects = d->n_reconnects;
+    s.byes = d->n_byes;
+    return s;
+}
@@ -0,0 +1,95 @@
+// aclient.h — asynchronous, pooled, pipelining client for the line servers
+//
+// What services embed instead of copying the connect/send/recv lines of the
+// exercise clients.  Per endpoint the client keeps a pool of non-blocking
+// connections and spreads requests over them, up to `window` in flight on
+// each, so a few connections carry tens of thousands of requests a second.
+// Two protocols:
+//
+//   lines      one line out, the next line back, in order (Ex5 -n: "Echo: ...")
+//   keepalive  Ex2/Ex4 keep-alive mode (keepalive.h): greeting, ID-tagged
+//              requests, replies checked against the ID; "BYE" from the
+//              server just sends the unanswered requests down a new connection
+//
+// Each request completes exactly once, through its callback or future: with
+// the reply, or with ETIMEDOUT (no reply within timeout_ms), ECONNRESET (the
+// connection died with it in flight; it may or may not have been served),
+// EAGAIN (max_pending already queued), EINVAL (payload holds a newline),
+// EPROTO (the server broke the protocol) or ECANCELED (client destroyed).
+// Requests that were never sent survive a lost connection: they wait for a
+// reconnect, which is retried with jittered exponential backoff.
+//
+// Threads: submit() and call() may be used from any thread.  All I/O and all
+// callbacks happen in whichever thread drives the client, either the
+// caller's loop through poll() or the client's own thread after start().
+// Callbacks must not call poll().
+//
+// C++ only (unlike the rest of common/); link with -pthread.
+#ifndef COMMON_ACLIENT_H
+#define COMMON_ACLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+
+enum aclient_proto_t { ACLIENT_LINES, ACLIENT_KEEPALIVE };
+
+// Parsed from "proto=lines|keepalive,conns=N,window=N,timeout=MS,backoff=MS,backoff_max=MS,pending=N".
+struct aclient_opts_t {
+    aclient_proto_t proto = ACLIENT_LINES;
+    int    conns          = 4;        // connections per endpoint
+    int    window         = 128;      // requests in flight per connection
+    int    timeout_ms     = 5000;     // from submit() to reply
+    int    backoff_ms     = 20;       // first reconnect delay, doubled per failure ...
+    int    backoff_max_ms = 5000;     // ... up to this
+    size_t max_pending    = 65536;    // per endpoint, waiting for a connection
+};
+
+int aclient_opts_parse(aclient_opts_t *o, const char *s);     // -1 on a bad key/value
+
+struct aclient_result_t {
+    int         err = 0;              // 0 or an errno value, see above
+    std::string reply;                // the reply line, no '\n' (keepalive: no ID either)
+    uint64_t    latency_ns = 0;       // submit() to completion
+};
+
+typedef std::function<void(aclient_result_t &)> aclient_cb_t;
+
+struct aclient_stats_t {
+    uint64_t sent, replies, failed, connects, reconnects, byes;
+};
+
+class aclient {
+public:
+    explicit aclient(const aclient_opts_t &o = aclient_opts_t());
+    ~aclient();                       // stops, then fails what is left with ECANCELED
+    aclient(const aclient &) = delete;
+    aclient &operator=(const aclient &) = delete;
+
+    // "host:port", "unix:PATH" or "seqpacket:PATH"; an endpoint id, or -1
+    // with errno set.  Resolves now; connects when the first request comes.
+    // Add endpoints before start(), or from the thread that calls poll().
+    int endpoint(const char *spec);
+
+    void submit(int ep, const std::string &payload, aclient_cb_t cb);
+    std::future<aclient_result_t> call(int ep, const std::string &payload);
+
+    // Run I/O, timers and callbacks for up to timeout_ms (0 = what is ready
+    // now).  Returns the number of requests completed.
+    int  poll(int timeout_ms);
+    void start();                     // or let a thread of ours do it
+    void stop();
+
+    size_t outstanding() const;       // submitted, not yet completed
+    aclient_stats_t stats() const;
+
+    struct impl;
+private:
+    std::unique_ptr<impl> d;
+};
+
+#endif
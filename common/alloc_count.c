@@ -0,0 +1,42 @@
+// alloc_count.c — counts malloc/free calls by wrapping glibc's allocator
+#include "alloc_count.h"
+
+#include <stddef.h>
+
+static uint64_t g_mallocs, g_frees, g_reallocs;
+
+#define BUMP(c) __atomic_fetch_add(&(c), 1, __ATOMIC_RELAXED)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void  __libc_free(void *);
+
+void *malloc(size_t n)           { BUMP(g_mallocs); return __libc_malloc(n); }
+void *calloc(size_t k, size_t n) { BUMP(g_mallocs); return __libc_calloc(k, n); }
+
+void free(void *p) {
+    if (p) BUMP(g_frees);
+    __libc_free(p);
+}
+
+void *realloc(void *p, size_t n) {
+    if (!p) BUMP(g_mallocs);
+    else if (n == 0) BUMP(g_frees);
+    else BUMP(g_reallocs);
+    return __libc_realloc(p, n);
+}
+
+void alloc_count_read(alloc_counts_t *out) {
+    out->mallocs  = __atomic_load_n(&g_mallocs, __ATOMIC_RELAXED);
+    out->frees    = __atomic_load_n(&g_frees, __ATOMIC_RELAXED);
+    out->reallocs = __atomic_load_n(&g_reallocs, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
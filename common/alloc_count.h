@@ -0,0 +1,28 @@
+// alloc_count.h — optional malloc/free call counter
+//
+// Link ../common/alloc_count.c into a binary to interpose malloc, calloc,
+// realloc and free (C++ new/delete go through them too).  The reader is a weak
+// symbol, so code can call alloc_count_read() unconditionally after checking
+// it is non-NULL; binaries built without the counter pay nothing.
+#ifndef COMMON_ALLOC_COUNT_H
+#define COMMON_ALLOC_COUNT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t mallocs;   // malloc + calloc + realloc(NULL, n)
+    uint64_t frees;     // free(non-NULL) + realloc(p, 0)
+    uint64_t reallocs;
+} alloc_counts_t;
+
+void alloc_count_read(alloc_counts_t *out) __attribute__((weak));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+// busypoll.c — spin-then-block event loop helpers (see busypoll.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // sched_setaffinity
+#endif
+#include "busypoll.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "opts.h"
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69        // Linux 5.11; older headers lack it
+#endif
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+void busypoll_init(busypoll_t *b) {
+    memset(b, 0, sizeof(*b));
+    b->cpu = -1;
+}
+
+int busypoll_parse(busypoll_t *b, const char *s) {
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long v = kv.num;
+        if (v < 0) return -1;
+        if      (opt_key(&kv, "spin"))   b->spin_us = (int)v;
+        else if (opt_key(&kv, "sock"))   b->sock_us = (int)v;
+        else if (opt_key(&kv, "prefer")) b->prefer = v != 0;
+        else if (opt_key(&kv, "cpu"))    b->cpu = (int)v;
+        else return -1;
+    }
+    return r;
+}
+
+int busypoll_enabled(const busypoll_t *b) {
+    return b->spin_us > 0 || b->sock_us > 0 || b->prefer || b->cpu >= 0;
+}
+
+void busypoll_socket(int fd, const busypoll_t *b) {
+    static int warned;
+    if (b->sock_us > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &b->sock_us, sizeof(b->sock_us)) < 0 && !warned++)
+        perror("SO_BUSY_POLL (needs CAP_NET_ADMIN above net.core.busy_read)");
+    int one = 1;
+    if (b->prefer && setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0 && !warned++)
+        perror("SO_PREFER_BUSY_POLL");
+}
+
+static cpu_set_t g_saved;
+static int g_pinned;
+
+int busypoll_pin(const busypoll_t *b) {
+    // The spin only pays when whoever sends us data runs on another core.
+    if (b->spin_us > 0 && sysconf(_SC_NPROCESSORS_ONLN) == 1)
+        fprintf(stderr, "busy poll: one CPU online; spinning will delay the peers it waits for\n");
+    if (b->cpu < 0) return 0;
+    if (sched_getaffinity(0, sizeof(g_saved), &g_saved) < 0) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(b->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) return -1;
+    g_pinned = 1;
+    return 0;
+}
+
+void busypoll_unpin(void) {
+    if (g_pinned) sched_setaffinity(0, sizeof(g_saved), &g_saved);
+    g_pinned = 0;
+}
+
+int busypoll_select(int nfds, fd_set *rfds, fd_set *wfds, struct timeval *tmo, const busypoll_t *b) {
+    if (b->spin_us > 0) {
+        fd_set want = *rfds, want_w;
+        if (wfds) want_w = *wfds;
+        uint64_t until = mono_ns() + (uint64_t)b->spin_us * 1000;
+        do {
+            struct timeval zero = { 0, 0 };
+            *rfds = want;
+            if (wfds) *wfds = want_w;
+            int r = select(nfds, rfds, wfds, NULL, &zero);
+            if (r > 0 && b->spin_wakeups) metric_inc(b->spin_wakeups);
+            if (r != 0) return r;
+            cpu_relax();
+        } while (mono_ns() < until);
+        *rfds = want;
+        if (wfds) *wfds = want_w;
+    }
+    int r = select(nfds, rfds, wfds, NULL, tmo);
+    if (r > 0 && b->sleep_wakeups) metric_inc(b->sleep_wakeups);
+    return r;
+}
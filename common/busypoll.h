@@ -0,0 +1,49 @@
+// busypoll.h — opt-in low-latency mode for blocking event loops
+//
+// A blocking select()/recv() that finds nothing puts the thread to sleep, and
+// the wake-up when data does arrive (interrupt, softirq, scheduler, cache
+// refill) costs more than the work it was waiting for.  With spin=US the loop
+// first polls with a zero timeout for up to US microseconds and only then
+// blocks; with sock=US the kernel also busy-polls the device queue for that
+// long on empty reads (SO_BUSY_POLL, + SO_PREFER_BUSY_POLL with prefer=1).
+// cpu=N pins the loop to one core, ideally one isolated from the scheduler
+// (isolcpus= / nohz_full=) so the spin does not steal time from anything.
+//
+// All of it trades CPU for tail latency: a spinning loop shows as 100% busy
+// for as long as traffic keeps arriving inside the budget.
+#ifndef COMMON_BUSYPOLL_H
+#define COMMON_BUSYPOLL_H
+
+#include <sys/select.h>
+
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Parsed from "spin=US,sock=US,prefer=0|1,cpu=N".
+typedef struct {
+    int spin_us;      // user-space spin before blocking (0 = off)
+    int sock_us;      // SO_BUSY_POLL on each connection (0 = off)
+    int prefer;       // SO_PREFER_BUSY_POLL
+    int cpu;          // pin the loop to this CPU (-1 = leave affinity alone)
+    metric_t *spin_wakeups, *sleep_wakeups;   // may be NULL
+} busypoll_t;
+
+void busypoll_init(busypoll_t *b);
+int  busypoll_parse(busypoll_t *b, const char *s);      // -1 on a bad key/value
+int  busypoll_enabled(const busypoll_t *b);
+// Best effort: reports (once) and carries on if the kernel refuses.
+void busypoll_socket(int fd, const busypoll_t *b);
+int  busypoll_pin(const busypoll_t *b);                  // 0, or -1 with errno; once at startup
+void busypoll_unpin(void);    // back to the affinity before busypoll_pin(), e.g. in a child
+// select() that spins for b->spin_us before blocking (wfds may be NULL).
+// The spin is not charged against *tmo; it is microseconds against seconds.
+int  busypoll_select(int nfds, fd_set *rfds, fd_set *wfds, struct timeval *tmo, const busypoll_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
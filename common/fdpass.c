@@ -0,0 +1,79 @@
+// fdpass.c — SCM_RIGHTS helpers (see fdpass.h)
+#include "fdpass.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int fdpass_send(int sock, const void *buf, size_t len, const int *fds, int nfds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * FDPASS_MAX)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+
+    if (nfds < 0 || nfds > FDPASS_MAX) { errno = EINVAL; return -1; }
+    iov.iov_base = (void*)buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+    }
+
+    for (;;) {
+        ssize_t w = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (w >= 0) return (size_t)w == len ? 0 : -1;
+        if (errno != EINTR) return -1;
+    }
+}
+
+ssize_t fdpass_recv(int sock, void *buf, size_t len, int *fds, int max_fds, int *nfds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * FDPASS_MAX)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    ssize_t r;
+    do r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    while (r < 0 && errno == EINTR);
+
+    *nfds = 0;
+    if (r < 0) return -1;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int n = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *in = (int*)CMSG_DATA(c);
+        for (int i = 0; i < n; i++) {
+            if (*nfds < max_fds) fds[(*nfds)++] = in[i];
+            else close(in[i]);             // more than the caller expected
+        }
+    }
+    if (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) {
+        while (*nfds > 0) close(fds[--*nfds]);
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return r;
+}
@@ -0,0 +1,26 @@
+// fdpass.h — pass file descriptors between processes over AF_UNIX (SCM_RIGHTS)
+//
+// Meant for SOCK_SEQPACKET sockets, so each call is one record: `len` bytes
+// of payload plus up to FDPASS_MAX descriptors travelling with it.
+#ifndef COMMON_FDPASS_H
+#define COMMON_FDPASS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FDPASS_MAX 16
+
+int     fdpass_send(int sock, const void *buf, size_t len, const int *fds, int nfds);
+// Returns payload bytes (0 on EOF, -1 on error); received fds land in fds[],
+// their count in *nfds.  Received fds are close-on-exec.
+ssize_t fdpass_recv(int sock, void *buf, size_t len, int *fds, int max_fds, int *nfds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+// flightrec.c — always-on flight recorder (see flightrec.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // memfd_create
+#endif
+#include "flightrec.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "opts.h"
+
+#define DUMP_CHUNK 256            // records validated and written per write()
+
+flight_t *g_flight;
+pid_t     g_flight_pid;
+static int g_flight_fd = -1;
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int flight_init(const char *opts) {
+    long slots = 16384, slow_ms = 200, gap_s = 10;
+    const char *dir = ".";
+    size_t dir_len = 1;
+    const char *s = opts ? opts : "";
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        if (opt_key(&kv, "dir") && kv.vlen > 0 && kv.vlen < sizeof(g_flight->dir)) {
+            dir = kv.val;
+            dir_len = kv.vlen;
+        }
+        else if (opt_key(&kv, "slots") && kv.num >= 0) slots = kv.num;
+        else if (opt_key(&kv, "slow") && kv.num >= 0)  slow_ms = kv.num;
+        else if (opt_key(&kv, "gap") && kv.num >= 0)   gap_s = kv.num;
+        else { errno = EINVAL; return -1; }
+    }
+    if (r < 0 || slots < 64 || slots > (1l << 24)) { errno = EINVAL; return -1; }
+
+    size_t n = 64;
+    while (n < (size_t)slots) n <<= 1;
+    size_t len = sizeof(flight_t) + n * sizeof(flight_rec_t);
+    int fd = memfd_create("flightrec", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    void *p = ftruncate(fd, (off_t)len) == 0
+            ? mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (p == MAP_FAILED) { int e = errno; close(fd); errno = e; return -1; }
+
+    flight_t *f = (flight_t*)p;        // zero-filled: every slot starts unwritten
+    f->mask = n - 1;
+    f->slow_ns = (uint64_t)slow_ms * 1000000ull;
+    f->gap_ns = (uint64_t)gap_s * 1000000000ull;
+    memcpy(f->dir, dir, dir_len);
+    f->tsc0 = flight_ticks();
+    f->mono0_ns = mono_ns();
+    f->wall0_ns = wall_ns();
+    g_flight_pid = getpid();
+    g_flight_fd = fd;
+    g_flight = f;
+    return 0;
+}
+
+int flight_attach(int fd) {
+    off_t len = lseek(fd, 0, SEEK_END);
+    if (len < (off_t)sizeof(flight_t)) { errno = EINVAL; return -1; }
+    void *p = mmap(NULL, (size_t)len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    flight_t *f = (flight_t*)p;
+    uint64_t slots = f->mask + 1;
+    if (slots < 64 || (slots & f->mask) || sizeof(flight_t) + slots * sizeof(flight_rec_t) != (uint64_t)len) {
+        munmap(p, (size_t)len);
+        errno = EINVAL;
+        return -1;
+    }
+    g_flight_pid = getpid();
+    g_flight_fd = fd;
+    g_flight = f;
+    return 0;
+}
+
+int flight_fd(void) { return g_flight_fd; }
+
+void flight_forked(void) { g_flight_pid = getpid(); }
+
+// --- Dumping (async-signal-safe: no stdio, no malloc) ---------------------------
+
+static char *put_str(char *p, const char *s, size_t n) {
+    memcpy(p, s, n);
+    return p + n;
+}
+
+static char *put_uint(char *p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static int write_all(int fd, const void *buf, size_t n) {
+    const char *p = (const char*)buf;
+    while (n) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) { if (errno == EINTR) continue; return -1; }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+int flight_dump(int trigger) {
+    flight_t *f = g_flight;
+    if (!f) { errno = EINVAL; return -1; }
+
+    flight_rec(FR_DUMP, (unsigned)trigger, FLIGHT_NO_CONN, 0, 0);
+    flight_file_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FLIGHT_MAGIC, 4);
+    h.version  = FLIGHT_VERSION;
+    h.rec_size = sizeof(flight_rec_t);
+    h.slots    = (uint32_t)(f->mask + 1);
+    h.pid      = (int32_t)getpid();
+    h.trigger  = (uint32_t)trigger;
+    h.head     = __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+    h.tsc0     = f->tsc0;
+    h.mono0_ns = f->mono0_ns;
+    h.wall0_ns = f->wall0_ns;
+    h.tsc1     = flight_ticks();
+    h.mono1_ns = mono_ns();
+    h.slow_ns  = f->slow_ns;
+
+    char path[sizeof(f->dir) + 64];
+    char *p = put_str(path, f->dir, strlen(f->dir));
+    p = put_str(p, "/flight-", 8);
+    p = put_uint(p, (uint64_t)h.pid);
+    *p++ = '-';
+    p = put_uint(p, __atomic_add_fetch(&f->dumps, 1, __ATOMIC_RELAXED));
+    p = put_str(p, ".bin", 5);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    int rc = write_all(fd, &h, sizeof(h));
+
+    // Copy each slot seqlock-style: a record being (re)written while we copy
+    // it goes out with seq 0, i.e. as never written.
+    flight_rec_t chunk[DUMP_CHUNK];
+    for (uint64_t base = 0; base <= f->mask && rc == 0; base += DUMP_CHUNK) {
+        size_t k = 0;
+        for (; k < DUMP_CHUNK && base + k <= f->mask; k++) {
+            flight_rec_t *r = &f->ring[base + k];
+            uint32_t s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+            chunk[k] = *r;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            chunk[k].seq = __atomic_load_n(&r->seq, __ATOMIC_RELAXED) == s1 ? s1 : 0;
+        }
+        rc = write_all(fd, chunk, k * sizeof(flight_rec_t));
+    }
+    if (close(fd) < 0) rc = -1;
+    if (rc == 0) {
+        char note[sizeof(path) + 32];
+        char *q = put_str(note, "flight recorder: wrote ", 23);
+        q = put_str(q, path, strlen(path));
+        *q++ = '\n';
+        (void)!write(STDERR_FILENO, note, (size_t)(q - note));
+    }
+    return rc;
+}
+
+void flight_on_signal(int signo) {
+    (void)signo;
+    int e = errno;
+    flight_dump(FR_TRIG_SIGNAL);
+    errno = e;
+}
+
+void flight_slow_hit(int op, uint32_t conn, uint64_t ns) {
+    flight_t *f = g_flight;
+    uint64_t us = ns / 1000;
+    flight_rec(FR_SLOW, (unsigned)op, conn, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us, 0);
+
+    // One dump per gap, whichever process gets there first.
+    uint64_t now = mono_ns();
+    uint64_t last = __atomic_load_n(&f->last_dump_ns, __ATOMIC_RELAXED);
+    if (last && now - last < f->gap_ns) return;
+    if (!__atomic_compare_exchange_n(&f->last_dump_ns, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    flight_dump(FR_TRIG_SLOW);
+}
+
+const char *flight_type_name(int type) {
+    static const char *const NAMES[FR_TYPES] = {
+        "?", "accept", "recv", "fanout", "send-partial", "send-eagain", "close", "slow", "dump",
+    };
+    return type > 0 && type < FR_TYPES ? NAMES[type] : "?";
+}
+
+const char *flight_why_name(int why) {
+    static const char *const NAMES[] = { "eof", "error", "quit", "send-failed", "server-full", "shutdown", "server-busy" };
+    return why >= 0 && why <= FR_WHY_BUSY ? NAMES[why] : "?";
+}
+
+const char *flight_op_name(int op) {
+    static const char *const NAMES[] = { "request", "loop-pass" };
+    return op >= 0 && op <= FR_OP_PASS ? NAMES[op] : "?";
+}
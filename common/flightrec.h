@@ -0,0 +1,150 @@
+// flightrec.h — always-on flight recorder of recent server events
+//
+// A fixed ring of 32-byte records (accept, recv size, broadcast fan-out,
+// partial/EAGAIN sends, disconnects with their reason, slow operations), each
+// stamped with the CPU's timestamp counter.  The ring is mapped MAP_SHARED
+// before any fork, so forked client handlers write into the same ring as the
+// parent and one dump holds everyone's recent past, interleaved.  It is a
+// memfd, so a successor process can flight_attach() it (passed over
+// SCM_RIGHTS) and keep recording into the ring its adopted workers still use.
+//
+// Recording is a relaxed fetch-add on the ring head, rdtsc and a few stores:
+// no lock, no syscall, no formatting.  Writers never wait for each other or
+// for a dump.  A record carries the low bits of its sequence number, zeroed
+// while it is being written, so a dump keeps only slots it copied whole.
+//
+// The ring goes to <dir>/flight-<pid>-<n>.bin on flight_dump(): from the
+// SIGUSR2 handler (flight_on_signal; async-signal-safe), or by itself when
+// flight_slow() sees an operation over the threshold (at most once per
+// `gap`).  ../bench/flightdump turns a dump into a timeline.
+#ifndef COMMON_FLIGHTREC_H
+#define COMMON_FLIGHTREC_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "latency.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLIGHT_MAGIC   "FLRC"
+#define FLIGHT_VERSION 1
+#define FLIGHT_NO_CONN UINT32_MAX   // event not tied to one connection
+
+enum {
+    FR_ACCEPT = 1,     // conn, a = fd
+    FR_RECV,           // conn, a = bytes
+    FR_FANOUT,         // conn = sender, a = recipients, b = bytes
+    FR_SEND_PARTIAL,   // conn, a = bytes sent, b = bytes asked
+    FR_SEND_EAGAIN,    // conn, a = bytes left queued
+    FR_CLOSE,          // conn, aux = FR_WHY_*, a = errno (shutdown: b = clients left)
+    FR_SLOW,           // conn, aux = FR_OP_*, a = microseconds
+    FR_DUMP,           // aux = FR_TRIG_*
+    FR_TYPES
+};
+
+enum { FR_WHY_EOF, FR_WHY_ERROR, FR_WHY_QUIT, FR_WHY_SEND, FR_WHY_FULL, FR_WHY_SHUTDOWN, FR_WHY_BUSY };
+enum { FR_OP_REQUEST, FR_OP_PASS };   // recv() to reply sent; one event-loop pass
+enum { FR_TRIG_SIGNAL, FR_TRIG_SLOW, FR_TRIG_CALL };
+
+typedef struct {
+    uint64_t tsc;
+    uint32_t seq;      // low bits of (index + 1); 0 while being written
+    int32_t  pid;
+    uint16_t type, aux;
+    uint32_t conn, a, b;
+} flight_rec_t;
+
+// Dump file: this header, then `slots` records in ring order.  Ticks convert
+// to nanoseconds with the two (tsc, monotonic) pairs: one from flight_init(),
+// one from the dump itself.
+typedef struct {
+    char     magic[4];
+    uint16_t version, rec_size;
+    uint32_t slots;
+    int32_t  pid;                // process that dumped
+    uint32_t trigger;            // FR_TRIG_*
+    uint32_t reserved;
+    uint64_t head;               // events recorded since flight_init()
+    uint64_t tsc0, mono0_ns, wall0_ns;
+    uint64_t tsc1, mono1_ns;
+    uint64_t slow_ns;
+} flight_file_hdr_t;
+
+typedef struct {                 // start of the shared mapping
+    uint64_t head;
+    char     pad0[56];           // writers hammer head; keep it on its own line
+    uint64_t mask;
+    uint64_t tsc0, mono0_ns, wall0_ns;
+    uint64_t slow_ns, gap_ns;
+    uint64_t last_dump_ns;
+    uint32_t dumps;
+    char     dir[260];           // (header is 384 bytes: records start on a cache line)
+    flight_rec_t ring[0];        // [0], not []: C and C++ objects see one type under LTO
+} flight_t;
+
+extern flight_t *g_flight;       // NULL until flight_init(): recording is a no-op
+extern pid_t     g_flight_pid;
+
+// opts: "slots=N,slow=MS,gap=S,dir=PATH" (any subset, NULL = defaults:
+// 16384 slots, dump on anything over 200 ms, at most every 10 s, into ".").
+// slow=0 turns the automatic dump off.  Call before fork().  0, or -1.
+int  flight_init(const char *opts);
+int  flight_attach(int fd);      // instead of flight_init(), keeping its settings; 0, or -1
+int  flight_fd(void);            // -1 before init
+void flight_forked(void);        // in a new child: stamp records with its pid
+
+static inline uint64_t flight_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return mono_ns();
+#endif
+}
+
+static inline void flight_rec(int type, unsigned aux, uint32_t conn, uint32_t a, uint32_t b) {
+    flight_t *f = g_flight;
+    if (!f) return;
+    uint64_t i = __atomic_fetch_add(&f->head, 1, __ATOMIC_RELAXED);
+    flight_rec_t *r = &f->ring[i & f->mask];
+    __atomic_store_n(&r->seq, 0u, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->tsc  = flight_ticks();
+    r->pid  = g_flight_pid;
+    r->type = (uint16_t)type;
+    r->aux  = (uint16_t)aux;
+    r->conn = conn;
+    r->a    = a;
+    r->b    = b;
+    __atomic_store_n(&r->seq, (uint32_t)(i + 1), __ATOMIC_RELEASE);
+}
+
+void flight_slow_hit(int op, uint32_t conn, uint64_t ns);
+
+// Record an operation that took ns if it is over the threshold, and dump.
+static inline void flight_slow(int op, uint32_t conn, uint64_t ns) {
+    if (g_flight && g_flight->slow_ns && ns >= g_flight->slow_ns) flight_slow_hit(op, conn, ns);
+}
+
+int  flight_dump(int trigger);   // async-signal-safe; 0, or -1 with errno
+void flight_on_signal(int signo);
+
+const char *flight_type_name(int type);
+const char *flight_why_name(int why);
+const char *flight_op_name(int op);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+// keepalive.c — persistent, pipelined request/response connections (see keepalive.h)
+#include "keepalive.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "opts.h"
+
+#define IN_CAP    8192        // longest request line is a bit less
+#define OUT_CAP   16384       // replies gathered per send()
+#define ID_MAX    32
+#define LINGER_MS 1000        // after BYE, how long the client gets to close first
+
+void keepalive_init(keepalive_t *k) {
+    memset(k, 0, sizeof(*k));
+    k->idle_ms = 5000;
+    k->max_requests = 10000;
+}
+
+int keepalive_parse(keepalive_t *k, const char *s) {
+    if (!strcmp(s, "off")) { k->off = 1; return 0; }
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long v = kv.num;
+        if (v < 0) return -1;
+        if      (opt_key(&kv, "idle")) k->idle_ms = (int)v;
+        else if (opt_key(&kv, "max"))  k->max_requests = (int)v;
+        else return -1;
+    }
+    return r;
+}
+
+static int wait_readable(int fd, int ms) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    for (;;) {
+        int r = poll(&p, 1, ms > 0 ? ms : -1);
+        if (r < 0 && errno == EINTR) continue;
+        return r;
+    }
+}
+
+int keepalive_detect(const keepalive_t *k, int fd, char *buf, size_t *n, size_t cap) {
+    const size_t len = sizeof(KEEPALIVE_HELLO) - 1;
+    if (k->off) return 0;
+    while (*n < len) {
+        if (memcmp(buf, KEEPALIVE_HELLO, *n)) return 0;
+        if (wait_readable(fd, LINGER_MS) <= 0) return 0;
+        ssize_t r = recv(fd, buf + *n, cap - *n, 0);
+        if (r <= 0) return 0;
+        if (k->bytes_in) metric_add(k->bytes_in, r);
+        *n += (size_t)r;
+    }
+    if (memcmp(buf, KEEPALIVE_HELLO, len)) return 0;
+    memmove(buf, buf + len, *n - len);
+    *n -= len;
+    return 1;
+}
+
+static int send_all(const keepalive_t *k, int fd, const char *p, size_t n) {
+    while (n) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) { if (errno == EINTR) continue; return -1; }
+        if (k->bytes_out) metric_add(k->bytes_out, w);
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// Tell the client why, then give it the chance to close first.
+static int bye(const keepalive_t *k, int fd, int why) {
+    char line[32];
+    int n = snprintf(line, sizeof(line), "BYE %s\n", keepalive_why(why));
+    if (send_all(k, fd, line, (size_t)n) == 0) {
+        char sink[512];
+        while (wait_readable(fd, LINGER_MS) > 0 && recv(fd, sink, sizeof(sink), 0) > 0) { }
+    }
+    return why;
+}
+
+int keepalive_serve(const keepalive_t *k, int fd, const char *reply, const char *rest, size_t n,
+                    long *served) {
+    static char in[IN_CAP], out[OUT_CAP];
+    size_t have = n < IN_CAP ? n : IN_CAP, rlen = strlen(reply);
+    memcpy(in, rest, have);
+    *served = 0;
+    if (k->conns) metric_inc(k->conns);
+
+    int olen = snprintf(out, sizeof(out), "KEEPALIVE idle=%d max=%d\n", k->idle_ms, k->max_requests);
+    if (send_all(k, fd, out, (size_t)olen) < 0) return KA_ERROR;
+
+    for (;;) {
+        // Answer every complete line; the replies leave together.
+        size_t off = 0, ol = 0;
+        char *nl;
+        while ((nl = (char*)memchr(in + off, '\n', have - off)) != NULL) {
+            const char *line = in + off;
+            size_t len = (size_t)(nl - line);
+            off += len + 1;
+            if (len && line[len - 1] == '\r') len--;
+            if (len == 0) continue;
+            size_t idlen = 0;
+            while (idlen < len && idlen < ID_MAX && line[idlen] != ' ') idlen++;
+
+            if (ol + idlen + rlen + 2 > OUT_CAP) {
+                if (send_all(k, fd, out, ol) < 0) return KA_ERROR;
+                ol = 0;
+            }
+            memcpy(out + ol, line, idlen);
+            out[ol + idlen] = ' ';
+            memcpy(out + ol + idlen + 1, reply, rlen);
+            out[ol + idlen + 1 + rlen] = '\n';
+            ol += idlen + rlen + 2;
+            if (k->requests) metric_inc(k->requests);
+            if (++*served == k->max_requests) {
+                if (send_all(k, fd, out, ol) < 0) return KA_ERROR;
+                return bye(k, fd, KA_MAX);
+            }
+        }
+        if (ol && send_all(k, fd, out, ol) < 0) return KA_ERROR;
+        memmove(in, in + off, have - off);
+        have -= off;
+        if (have == IN_CAP) return KA_ERROR;              // no line ending in sight
+
+        if (k->idle_ms > 0 && wait_readable(fd, k->idle_ms) == 0) return bye(k, fd, KA_IDLE);
+        ssize_t r = recv(fd, in + have, IN_CAP - have, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return r == 0 ? KA_EOF : KA_ERROR;
+        if (k->bytes_in) metric_add(k->bytes_in, r);
+        have += (size_t)r;
+    }
+}
+
+const char *keepalive_why(int why) {
+    static const char *const NAMES[] = { "eof", "idle", "max", "error" };
+    return why >= KA_EOF && why <= KA_ERROR ? NAMES[why] : "?";
+}
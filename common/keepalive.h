@@ -0,0 +1,64 @@
+// keepalive.h — persistent, pipelined request/response connections
+//
+// The one-shot servers (Ex2, Ex4) answer a single recv() and close, so a
+// health checker pays a handshake, a fork and a teardown per probe and leaves
+// a TIME_WAIT entry each time.  A client that opens with the greeting line
+// gets a connection that carries any number of requests instead:
+//
+//   C: KEEPALIVE                        S: KEEPALIVE idle=5000 max=10000
+//   C: 17 ping                          S: 17 Hello from C++ server
+//   C: 18 ping                          S: 18 Hello from C++ server
+//   ...                                 S: BYE idle | BYE max
+//
+// A request is one line whose first word is the client's request ID; the
+// reply line starts with the same ID.  Requests may be pipelined: every line
+// in a read is answered, in order, with one send().  The server ends a
+// connection that has been quiet for `idle` ms or has had `max` requests by
+// sending "BYE <why>" and waiting (briefly) for the client to close first,
+// so the TIME_WAIT entry lands on the client, not on us.
+//
+// Anything that does not start with the greeting is served one-shot as
+// before.
+#ifndef COMMON_KEEPALIVE_H
+#define COMMON_KEEPALIVE_H
+
+#include <stddef.h>
+
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KEEPALIVE_HELLO "KEEPALIVE\n"
+
+enum { KA_EOF, KA_IDLE, KA_MAX, KA_ERROR };     // why a connection ended
+
+typedef struct {
+    int idle_ms;          // close after this long without a request (0 = never)
+    int max_requests;     // ... or after this many (0 = no limit)
+    int off;              // -k off: the greeting is just another one-shot payload
+    metric_t *requests, *bytes_in, *bytes_out, *conns;   // may be NULL
+} keepalive_t;
+
+void keepalive_init(keepalive_t *k);                       // idle=5000,max=10000
+int  keepalive_parse(keepalive_t *k, const char *s);       // "idle=MS,max=N" or "off"; -1 if bad
+
+// buf[0..*n) is the first recv() of a connection (cap bytes of room).  If it
+// starts with the greeting, returns 1 with the greeting removed from buf; a
+// greeting split over two segments is read to the end first.
+int  keepalive_detect(const keepalive_t *k, int fd, char *buf, size_t *n, size_t cap);
+
+// Serve requests until the client closes, idles or reaches the maximum.
+// rest[0..n) is what arrived after the greeting.  Returns KA_*; *served is
+// the number of requests answered.
+int  keepalive_serve(const keepalive_t *k, int fd, const char *reply, const char *rest, size_t n,
+                     long *served);
+
+const char *keepalive_why(int why);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+// latency.c — log2 latency histograms (see latency.h)
+#include "latency.h"
+
+uint64_t lat_hist_pct(const lat_hist_t *h, double pct) {
+    if (!h->count) return 0;
+    uint64_t want = (uint64_t)((double)h->count * pct / 100.0);
+    if (want >= h->count) want = h->count - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen > want) {
+            uint64_t hi = (2ull << b) - 1;
+            return hi < h->max_ns ? hi : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+void lat_hist_print_header(FILE *f) {
+    fprintf(f, "%-16s %10s %10s %10s %10s %10s %10s\n",
+            "stage", "count", "mean_us", "p50_us", "p99_us", "p99.9_us", "max_us");
+}
+
+void lat_hist_print(FILE *f, const char *name, const lat_hist_t *h) {
+    fprintf(f, "%-16s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f\n", name,
+            (unsigned long long)h->count,
+            h->count ? (double)h->sum_ns / (double)h->count / 1e3 : 0.0,
+            lat_hist_pct(h, 50) / 1e3, lat_hist_pct(h, 99) / 1e3,
+            lat_hist_pct(h, 99.9) / 1e3, h->max_ns / 1e3);
+}
@@ -0,0 +1,62 @@
+// latency.h — log2-bucketed latency histograms
+//
+// Adding a sample is a bit-scan and three increments, cheap enough for the
+// per-message path.  Bucket b holds samples in [2^b, 2^(b+1)) ns; percentiles
+// are reported as the upper bound of the bucket they fall in.
+#ifndef COMMON_LATENCY_H
+#define COMMON_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAT_BUCKETS 40              // up to 2^40 ns ≈ 18 minutes
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bucket[LAT_BUCKETS];
+} lat_hist_t;
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ns as a select() timeout, rounded up to whole microseconds before it is
+// split, so a deadline is never woken early and tv_usec stays below 10^6.
+static inline struct timeval *ns_timeval(uint64_t ns, struct timeval *tv) {
+    uint64_t us = (ns + 999) / 1000;
+    tv->tv_sec  = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return tv;
+}
+
+static inline int lat_bucket(uint64_t ns) {
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+static inline void lat_hist_add(lat_hist_t *h, uint64_t ns) {
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->bucket[lat_bucket(ns)]++;
+}
+
+uint64_t lat_hist_pct(const lat_hist_t *h, double pct);   // ns, bucket upper bound
+void     lat_hist_print(FILE *f, const char *name, const lat_hist_t *h);
+void     lat_hist_print_header(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,292 @@
+// listen.c — listener sets, TCP tuning and AF_UNIX endpoints (see listen.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // accept4
+#endif
+#include "listen.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "opts.h"
+
+// "unix:/p" -> SOCK_STREAM, "seqpacket:/p" -> SOCK_SEQPACKET; fills sa.
+int local_addr(const char *spec, struct sockaddr_un *sa) {
+    int type;
+    const char *path;
+    if (!strncmp(spec, "unix:", 5))           { type = SOCK_STREAM;    path = spec + 5; }
+    else if (!strncmp(spec, "seqpacket:", 10)) { type = SOCK_SEQPACKET; path = spec + 10; }
+    else { errno = EINVAL; return -1; }
+
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    if (!*path || strlen(path) >= sizeof(sa->sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(sa->sun_path, path);
+    return type;
+}
+
+static void set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl >= 0) fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+// --- TCP listeners ----------------------------------------------------------
+
+void listen_opts_init(listen_opts_t *o) {
+    o->backlog = SOMAXCONN;
+    o->defer_secs = 0;
+    o->fastopen = 0;
+    o->shards = 1;
+    o->steer = 0;
+}
+
+int listen_opts_parse(listen_opts_t *o, const char *s) {
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long v = kv.num;
+        if (v < 0) return -1;
+        if      (opt_key(&kv, "backlog"))  o->backlog = v > 0 ? (int)v : 1;
+        else if (opt_key(&kv, "defer"))    o->defer_secs = (int)v;
+        else if (opt_key(&kv, "fastopen")) o->fastopen = (int)v;
+        else if (opt_key(&kv, "shards"))   o->shards = v > 0 ? (int)v : 1;
+        else if (opt_key(&kv, "steer"))    o->steer = v != 0;
+        else return -1;
+    }
+    return r;
+}
+
+int listen_tcp(int port, const listen_opts_t *o) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (o->shards > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) goto fail;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) goto fail;
+
+    // Both are hints: an old kernel or a sysctl saying no is not fatal.
+    if (o->defer_secs > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &o->defer_secs, sizeof(o->defer_secs)) < 0)
+        perror("TCP_DEFER_ACCEPT");
+    if (o->fastopen > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &o->fastopen, sizeof(o->fastopen)) < 0)
+        perror("TCP_FASTOPEN");
+
+    if (listen(fd, o->backlog) < 0) goto fail;
+    return fd;
+fail:;
+    int e = errno;
+    close(fd);
+    errno = e;
+    return -1;
+}
+
+int listen_shard(const listen_opts_t *o) {
+    pid_t parent = getpid();
+    for (int k = 1; k < o->shards; k++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork shard"); break; }
+        if (pid > 0) continue;
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent) _exit(0);
+        return k;
+    }
+    return 0;
+}
+
+// --- CPU steering -------------------------------------------------------------
+
+int listen_cpu(int k) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) return -1;
+    int n = CPU_COUNT(&set);
+    if (n == 0) { errno = EINVAL; return -1; }
+    k %= n;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set) && k-- == 0) return cpu;
+    errno = EINVAL;
+    return -1;
+}
+
+int listen_pin(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) { errno = EINVAL; return -1; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+int listen_steer(int lfd, int cpu) {
+    return setsockopt(lfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+}
+
+int listen_incoming_cpu(int fd) {
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) return -1;
+    return cpu;
+}
+
+int listen_cross_cpu(int fd) {
+    int cpu = listen_incoming_cpu(fd);
+    return cpu >= 0 && cpu != sched_getcpu();
+}
+
+int listen_follow(int fd) {
+    int cpu = listen_incoming_cpu(fd);
+    if (cpu < 0) { errno = EAGAIN; return -1; }
+    return listen_pin(cpu) < 0 ? -1 : cpu;
+}
+
+// --- Listener sets ------------------------------------------------------------
+
+void listen_set_init(listen_set_t *ls) {
+    memset(ls, 0, sizeof(*ls));
+}
+
+// A descriptor held back (on /dev/null) for when the process runs out of
+// them: listen_drain() trades it for the connection at the head of the queue
+// and closes that at once.  Without it a full fd table leaves the listener
+// readable forever and the event loop spinning on EMFILE.  Shared by all
+// threads; whoever takes it puts a new one back.
+static int g_reserve_fd = -1;
+
+static void reserve_open(void) {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC), none = -1;
+    if (fd >= 0 && !__atomic_compare_exchange_n(&g_reserve_fd, &none, fd, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        close(fd);
+}
+
+// Out of descriptors: turn away one pending connection.  Returns 1 if it did.
+static int shed_one(int lfd) {
+    int r = __atomic_exchange_n(&g_reserve_fd, -1, __ATOMIC_ACQ_REL);
+    if (r < 0) return 0;              // another thread has it, or ENFILE kept it from reopening
+    close(r);
+    int fd = accept(lfd, NULL, NULL);
+    if (fd >= 0) close(fd);
+    reserve_open();
+    return fd >= 0;
+}
+
+int listen_set_add(listen_set_t *ls, int fd) {
+    if (ls->n == LISTEN_MAX) { errno = EMFILE; return -1; }
+    reserve_open();
+    set_nonblock(fd);
+    ls->fd[ls->n] = fd;
+    ls->path[ls->n][0] = '\0';
+    ls->n++;
+    return 0;
+}
+
+int listen_set_add_spec(listen_set_t *ls, const char *spec, int backlog) {
+    struct sockaddr_un sa;
+    int type = local_addr(spec, &sa);
+    if (type < 0) return -1;
+    if (ls->n == LISTEN_MAX) { errno = EMFILE; return -1; }
+
+    // A socket file left by a previous run would make bind() fail; anything
+    // that is not a socket is left alone.
+    struct stat st;
+    if (lstat(sa.sun_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) { errno = EEXIST; return -1; }
+        unlink(sa.sun_path);
+    }
+
+    int fd = socket(AF_UNIX, type, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, backlog) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    set_nonblock(fd);
+    ls->fd[ls->n] = fd;
+    snprintf(ls->path[ls->n], sizeof(ls->path[0]), "%s", sa.sun_path);
+    ls->n++;
+    return 0;
+}
+
+int listen_drain(int lfd, int *fds, int max, int flags) {
+    int n = 0, shed = 0;
+    while (n < max) {
+        int fd = accept4(lfd, NULL, NULL, flags);
+        if (fd >= 0) { fds[n++] = fd; continue; }
+        if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) continue;
+        if ((errno == EMFILE || errno == ENFILE) && shed < max && shed_one(lfd)) { shed++; continue; }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && n == 0 && !shed) return -1;
+        break;
+    }
+    return n;
+}
+
+int listen_set_accept_batch(listen_set_t *ls, int *fds, int max, int flags) {
+    struct pollfd pfd[LISTEN_MAX];
+    for (int k = 0; k < ls->n; k++) { pfd[k].fd = ls->fd[k]; pfd[k].events = POLLIN; pfd[k].revents = 0; }
+    if (poll(pfd, (nfds_t)ls->n, -1) < 0) return -1;
+
+    // Start after the listener served first last time so a busy one cannot
+    // starve the rest.
+    int n = 0, err = 0;
+    for (int j = 0; j < ls->n && n < max; j++) {
+        int k = (ls->next + j) % ls->n;
+        if (!(pfd[k].revents & POLLIN)) continue;
+        int got = listen_drain(ls->fd[k], fds + n, max - n, flags);
+        if (got < 0) { err = errno; continue; }
+        n += got;
+    }
+    ls->next = (ls->next + 1) % ls->n;
+    if (n == 0 && err) { errno = err; return -1; }
+    return n;
+}
+
+int listen_set_accept(listen_set_t *ls, struct sockaddr *sa, socklen_t *len) {
+    int fd;
+    for (;;) {
+        int n = listen_set_accept_batch(ls, &fd, 1, SOCK_CLOEXEC);
+        if (n < 0) return -1;
+        if (n == 1) break;
+    }
+    if (sa && len && getpeername(fd, sa, len) < 0) *len = 0;
+    return fd;
+}
+
+void listen_set_close(listen_set_t *ls) {
+    for (int k = 0; k < ls->n; k++) close(ls->fd[k]);
+}
+
+void listen_set_unlink(listen_set_t *ls) {
+    for (int k = 0; k < ls->n; k++) if (ls->path[k][0]) unlink(ls->path[k]);
+}
+
+int local_connect(const char *spec) {
+    struct sockaddr_un sa;
+    int type = local_addr(spec, &sa);
+    if (type < 0) return -1;
+    int fd = socket(AF_UNIX, type, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,104 @@
+// listen.h — the set of sockets a server accepts on
+//
+// Every server keeps its TCP listener and may add AF_UNIX ones for clients
+// on the same host, given as
+//   unix:PATH        SOCK_STREAM, byte stream exactly like TCP
+//   seqpacket:PATH   SOCK_SEQPACKET, every send() arrives as one recv()
+// Connections from any listener are handed to the same per-client code.
+//
+// Listeners are non-blocking: when one is readable the whole accept queue is
+// drained with accept4() in one go, so a reconnect storm costs one wake-up
+// per batch rather than per connection.  listen_tcp() applies the tuning
+// given with -A (see listen_opts_parse()).
+//
+// steer=1 keeps each connection on the core where the kernel processes its
+// packets, so the handler finds the socket, skb and wake-up state in its own
+// cache instead of pulling them across cores (or sockets) on every message.
+// A server with one worker per core pins worker k to listen_cpu(k) and marks
+// its SO_REUSEPORT listener with that CPU (listen_steer()): from Linux 6.1 the
+// kernel hands a new connection to the listener whose SO_INCOMING_CPU is the
+// CPU its SYN arrived on (older kernels spread by hash and take this as a
+// hint only).  A server that forks per connection instead moves the child to
+// its connection's CPU (listen_follow()).  Which CPU processes a flow is up
+// to RSS/RPS: the NIC's queue-to-IRQ affinity has to spread over the same
+// cores for this to pay.
+#ifndef COMMON_LISTEN_H
+#define COMMON_LISTEN_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LISTEN_MAX   8
+#define ACCEPT_BATCH 64
+
+typedef struct {
+    int  n;
+    int  fd[LISTEN_MAX];
+    char path[LISTEN_MAX][108];   // AF_UNIX path to unlink at exit ("" for TCP)
+    int  next;                    // where the next accept pass starts looking
+} listen_set_t;
+
+// TCP listener tuning; parsed from "backlog=N,defer=S,fastopen=Q,shards=N,steer=0|1".
+typedef struct {
+    int backlog;      // listen() queue; default SOMAXCONN
+    int defer_secs;   // TCP_DEFER_ACCEPT: only wake us once the client has sent data
+    int fastopen;     // TCP_FASTOPEN queue length (0 = off)
+    int shards;       // acceptor processes, each with its own SO_REUSEPORT listener
+    int steer;        // keep connections on the CPU their packets arrive on (see above)
+} listen_opts_t;
+
+void listen_opts_init(listen_opts_t *o);
+int  listen_opts_parse(listen_opts_t *o, const char *s);     // -1 on a bad key/value
+int  listen_tcp(int port, const listen_opts_t *o);          // bound + listening, or -1
+// Forks o->shards - 1 acceptor processes (they die with us); returns this
+// process's shard index.  Call before listen_tcp() so each gets its own socket.
+int  listen_shard(const listen_opts_t *o);
+
+// CPU steering.  listen_cpu(k): the k-th CPU this process may run on
+// (wrapping), for worker k.  listen_pin(): the calling thread (or a
+// single-threaded process) to that CPU only.  listen_steer(): ask for the
+// connections processed on `cpu`.  listen_follow(): pin the caller to the CPU
+// that processes fd's packets; returns that CPU.  All -1 with errno on failure.
+int  listen_cpu(int k);
+int  listen_pin(int cpu);
+int  listen_steer(int lfd, int cpu);
+int  listen_follow(int fd);
+int  listen_incoming_cpu(int fd);     // SO_INCOMING_CPU, -1 if not known yet
+int  listen_cross_cpu(int fd);        // 1 if fd's packets are processed on another CPU than ours
+
+void listen_set_init(listen_set_t *ls);
+int  listen_set_add(listen_set_t *ls, int fd);                        // an already listening fd
+int  listen_set_add_spec(listen_set_t *ls, const char *spec, int backlog);
+// Waits until any listener has a connection, then drains ready listeners
+// into fds[] (accept4 with `flags`, e.g. SOCK_CLOEXEC | SOCK_NONBLOCK).
+// Returns the number accepted (may be 0 after a lost race) or -1.
+int  listen_set_accept_batch(listen_set_t *ls, int *fds, int max, int flags);
+// Single-connection form for servers that handle one client per call.
+int  listen_set_accept(listen_set_t *ls, struct sockaddr *sa, socklen_t *len);
+// Drain one readable listener; for servers with their own select() loop.
+// Out of descriptors (EMFILE/ENFILE), it closes pending connections (up to
+// max) through a reserved fd rather than leave the listener readable, and
+// returns what it did accept.
+int  listen_drain(int lfd, int *fds, int max, int flags);
+void listen_set_close(listen_set_t *ls);     // in forked children
+void listen_set_unlink(listen_set_t *ls);    // remove the AF_UNIX paths
+
+// Client side: connect to "unix:PATH" / "seqpacket:PATH"; -1 with errno set.
+int  local_connect(const char *spec);
+// The address and socket type (SOCK_STREAM / SOCK_SEQPACKET) of such a spec,
+// for callers that connect on their own terms (non-blocking); -1 if bad.
+int  local_addr(const char *spec, struct sockaddr_un *sa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
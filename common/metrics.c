@@ -0,0 +1,228 @@
+// metrics.c — shared-memory metrics + loopback Prometheus endpoint (see metrics.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // memfd_create
+#endif
+#include "metrics.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+typedef struct {
+    int      nmetrics;
+    metric_t m[METRICS_MAX];
+} registry_t;
+
+static registry_t *g_reg;
+static int g_reg_fd = -1;
+static metric_t g_dummy;          // handed out when disabled/full so callers never check NULL
+
+static int map_registry(int fd) {
+    void *p = mmap(NULL, sizeof(registry_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    g_reg = (registry_t*)p;
+    g_reg_fd = fd;
+    return 0;
+}
+
+int metrics_init(void) {
+    if (g_reg) return 0;
+    int fd = memfd_create("metrics", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)sizeof(registry_t)) < 0 || map_registry(fd) < 0) {
+        int e = errno; close(fd); errno = e; return -1;
+    }
+    return 0;
+}
+
+int metrics_attach(int fd) {
+    if (g_reg) { errno = EBUSY; return -1; }
+    if (lseek(fd, 0, SEEK_END) != (off_t)sizeof(registry_t)) { errno = EINVAL; return -1; }
+    return map_registry(fd);
+}
+
+int metrics_fd(void) { return g_reg_fd; }
+
+// A metric already in the registry (same type, name and labels) is reused, so
+// a server that attached its predecessor's registry keeps counting on.  The
+// slot is filled before nmetrics covers it: a scrape never sees half a name.
+static metric_t *metric_register(int type, const char *name, const char *labels, const char *help) {
+    if (!g_reg) return &g_dummy;
+    if (!labels) labels = "";
+    int n = g_reg->nmetrics;
+    for (int i = 0; i < n; i++) {
+        metric_t *m = &g_reg->m[i];
+        if (m->type == type && !strcmp(m->name, name) && !strcmp(m->labels, labels)) return m;
+    }
+    if (n == METRICS_MAX) return &g_dummy;
+    metric_t *m = &g_reg->m[n];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    snprintf(m->labels, sizeof(m->labels), "%s", labels);
+    snprintf(m->help, sizeof(m->help), "%s", help);
+    m->type = type;
+    __atomic_store_n(&g_reg->nmetrics, n + 1, __ATOMIC_RELEASE);
+    return m;
+}
+
+metric_t *metric_counter(const char *name, const char *labels, const char *help) {
+    return metric_register(METRIC_COUNTER, name, labels, help);
+}
+metric_t *metric_gauge(const char *name, const char *labels, const char *help) {
+    return metric_register(METRIC_GAUGE, name, labels, help);
+}
+metric_t *metric_histogram(const char *name, const char *labels, const char *help) {
+    return metric_register(METRIC_HISTOGRAM, name, labels, help);
+}
+
+// --- Scrape-time formatting --------------------------------------------------
+
+typedef struct { char *p; size_t left; } out_t;
+
+static void out(out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out(out_t *o, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = o->left ? vsnprintf(o->p, o->left, fmt, ap) : -1;
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= o->left) {                 // truncated: keep what fit, then stop
+        o->p += o->left - 1;
+        o->left = 0;
+        return;
+    }
+    o->p += n;
+    o->left -= (size_t)n;
+}
+
+static void format_histogram(out_t *o, const metric_t *m) {
+    const char *sep = m->labels[0] ? "," : "";
+    uint64_t b[LAT_BUCKETS];
+    uint64_t sum = __atomic_load_n(&m->sum_ns, __ATOMIC_RELAXED);
+    int top = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        b[i] = __atomic_load_n(&m->bucket[i], __ATOMIC_RELAXED);
+        if (b[i]) top = i;
+    }
+    // Buckets up to the highest one in use; bucket i ends at 2^(i+1) ns.  +Inf
+    // and _count are the cumulative total of the same snapshot, so they never
+    // disagree with the buckets under concurrent observations.
+    uint64_t cum = 0;
+    for (int i = 0; i <= top; i++) {
+        cum += b[i];
+        out(o, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", m->name, m->labels, sep,
+            (double)(2ull << i) / 1e9, (unsigned long long)cum);
+    }
+    out(o, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", m->name, m->labels, sep, (unsigned long long)cum);
+    out(o, "%s_sum%s%s%s %.9f\n", m->name, m->labels[0] ? "{" : "", m->labels,
+        m->labels[0] ? "}" : "", (double)sum / 1e9);
+    out(o, "%s_count%s%s%s %llu\n", m->name, m->labels[0] ? "{" : "", m->labels,
+        m->labels[0] ? "}" : "", (unsigned long long)cum);
+}
+
+static size_t format_metrics(char *buf, size_t cap) {
+    static const char *const TYPES[] = { "counter", "gauge", "histogram" };
+    out_t o = { buf, cap };
+    int n = __atomic_load_n(&g_reg->nmetrics, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        const metric_t *m = &g_reg->m[i];
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) seen = !strcmp(g_reg->m[j].name, m->name);
+        if (!seen) out(&o, "# HELP %s %s\n# TYPE %s %s\n", m->name, m->help, m->name, TYPES[m->type]);
+
+        if (m->type == METRIC_HISTOGRAM) { format_histogram(&o, m); continue; }
+        long long v = (long long)__atomic_load_n(&m->value, __ATOMIC_RELAXED);
+        if (m->labels[0]) out(&o, "%s{%s} %lld\n", m->name, m->labels, v);
+        else              out(&o, "%s %lld\n", m->name, v);
+    }
+    return (size_t)(o.p - buf);
+}
+
+// --- Admin process -----------------------------------------------------------
+
+static void reply(int fd, const char *status, const char *body, size_t len) {
+    char hdr[160];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, len);
+    (void)send(fd, hdr, (size_t)n, MSG_NOSIGNAL);
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = send(fd, body + off, len - off, MSG_NOSIGNAL);
+        if (w <= 0) { if (w < 0 && errno == EINTR) continue; break; }
+        off += (size_t)w;
+    }
+}
+
+static void admin_loop(int ls) {
+    static char body[256 * 1024];
+    for (;;) {
+        int fd = accept(ls, NULL, NULL);
+        if (fd < 0) { if (errno == EINTR) continue; perror("metrics accept"); continue; }
+
+        struct timeval tv = { 2, 0 };   // a stuck scraper must not wedge the endpoint
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char req[2048];
+        size_t have = 0;
+        while (have < sizeof(req) - 1) {
+            ssize_t r = recv(fd, req + have, sizeof(req) - 1 - have, 0);
+            if (r <= 0) break;
+            have += (size_t)r;
+            req[have] = '\0';
+            if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+        }
+        req[have] = '\0';
+
+        if (!strncmp(req, "GET /metrics", 12)) {
+            size_t len = format_metrics(body, sizeof(body));
+            reply(fd, "200 OK", body, len);
+        } else if (!strncmp(req, "GET /healthz", 12)) {
+            reply(fd, "200 OK", "ok\n", 3);
+        } else {
+            reply(fd, "404 Not Found", "try /metrics\n", 13);
+        }
+        close(fd);
+    }
+}
+
+int metrics_serve(int port) {
+    if (!g_reg) return -1;
+
+    int ls = socket(AF_INET, SOCK_STREAM, 0);
+    if (ls < 0) return -1;
+    int opt = 1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);    // never exposed off-box
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(ls, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(ls, 8) < 0) {
+        close(ls);
+        return -1;
+    }
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid < 0) { close(ls); return -1; }
+    if (pid > 0) { close(ls); return pid; }
+
+    // Admin child: default signal dispositions, die with the server.
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGUSR1, SIG_IGN);         // the server's dump signals are meant for it,
+    signal(SIGUSR2, SIG_IGN);         // not its admin process
+    signal(SIGPIPE, SIG_IGN);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent) _exit(0);
+    admin_loop(ls);
+    _exit(0);
+}
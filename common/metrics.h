@@ -0,0 +1,65 @@
+// metrics.h — shared-memory metrics registry + loopback Prometheus endpoint
+//
+// Counters, gauges and histograms live in one MAP_SHARED region, so forked
+// client handlers update the same numbers the parent sees.  The region is a
+// memfd: metrics_fd() can be passed to a successor process (SCM_RIGHTS),
+// which metrics_attach()es it before registering and so keeps counting into
+// the same numbers as the workers it adopts.  Updating is a
+// single relaxed atomic add; nothing is formatted until someone scrapes.
+// metrics_serve() forks a small admin process that answers
+//   GET /metrics   Prometheus text format
+//   GET /healthz   "ok"
+// on 127.0.0.1:<port> and exits when its parent does.
+//
+// Call metrics_init() first, register everything, then fork workers/admin.
+#ifndef COMMON_METRICS_H
+#define COMMON_METRICS_H
+
+#include <stdint.h>
+
+#include "latency.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAX 64
+
+enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+
+typedef struct {
+    char     name[48];
+    char     labels[48];     // e.g. stage="pipe" (without braces), may be empty
+    char     help[96];
+    int      type;
+    int64_t  value;          // counter / gauge
+    uint64_t sum_ns;         // histogram; the count is the bucket total
+    uint64_t bucket[LAT_BUCKETS];
+} metric_t;
+
+int       metrics_init(void);
+int       metrics_attach(int fd);    // instead of metrics_init(): 0, or -1 with errno
+int       metrics_fd(void);          // -1 before init
+metric_t *metric_counter(const char *name, const char *labels, const char *help);
+metric_t *metric_gauge(const char *name, const char *labels, const char *help);
+metric_t *metric_histogram(const char *name, const char *labels, const char *help);
+int       metrics_serve(int port);   // pid of the admin process, or -1
+
+static inline void metric_add(metric_t *m, int64_t n) {
+    __atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+static inline void metric_inc(metric_t *m) { metric_add(m, 1); }
+static inline void metric_dec(metric_t *m) { metric_add(m, -1); }
+static inline void metric_set(metric_t *m, int64_t v) {
+    __atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+}
+static inline void metric_observe(metric_t *m, uint64_t ns) {
+    __atomic_fetch_add(&m->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->bucket[lat_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+// mpsc.h — intrusive lock-free multi-producer / single-consumer queue
+//
+// Vyukov's node-based queue: a producer links its node with one atomic
+// exchange on the head and one store, so pushes never wait for each other or
+// for the consumer, and never allocate (the node lives inside the item).
+// Only one thread may pop.  A pop can come back empty while a producer is
+// between its exchange and its store; that producer finishes its push before
+// it signals the consumer, so a consumer that sleeps until signalled loses
+// nothing.
+#ifndef COMMON_MPSC_H
+#define COMMON_MPSC_H
+
+#include <stddef.h>
+
+typedef struct mpsc_node {
+    struct mpsc_node *next;
+} mpsc_node_t;
+
+typedef struct {
+    mpsc_node_t *head;                            // producers swap themselves in here
+    char         pad[64 - sizeof(mpsc_node_t*)];  // keep the consumer's end on its own line
+    mpsc_node_t *tail;                            // consumer only
+    mpsc_node_t  stub;
+} mpsc_queue_t;
+
+static inline void mpsc_init(mpsc_queue_t *q) {
+    q->stub.next = NULL;
+    q->head = q->tail = &q->stub;
+}
+
+static inline void mpsc_push(mpsc_queue_t *q, mpsc_node_t *n) {
+    __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+    mpsc_node_t *prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+// Oldest node, or NULL if empty (or a push is half done; see above).
+static inline mpsc_node_t *mpsc_pop(mpsc_queue_t *q) {
+    mpsc_node_t *tail = q->tail;
+    mpsc_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &q->stub) {
+        if (!next) return NULL;
+        q->tail = tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) { q->tail = next; return tail; }
+
+    // tail is the last node.  Hand it out only once the stub is queued behind
+    // it, so the queue is never left without a node to link onto.
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) return NULL;
+    mpsc_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) { q->tail = next; return tail; }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,98 @@
+// netio.c — I/O helpers (see netio.h)
+#include "netio.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+ssize_t read_full(int fd, void *buf, size_t n) {
+    size_t off = 0;
+    while (off < n) {
+        ssize_t r = read(fd, (char*)buf + off, n - off);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) break;                // EOF
+        off += (size_t)r;
+    }
+    return (ssize_t)off;
+}
+
+ssize_t write_full(int fd, const void *buf, size_t n) {
+    size_t off = 0;
+    while (off < n) {
+        ssize_t w = write(fd, (const char*)buf + off, n - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    return (ssize_t)off;
+}
+
+void trim_eol(char *s) {
+    size_t n = strlen(s);
+    while (n && (s[n-1] == '\n' || s[n-1] == '\r')) s[--n] = '\0';
+}
+
+ssize_t send_nb(int fd, const void *buf, size_t n) {
+    for (;;) {
+        ssize_t w = send(fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w >= 0) return w;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+ssize_t recv_nb(int fd, void *buf, size_t n) {
+    for (;;) {
+        ssize_t r = recv(fd, buf, n, MSG_DONTWAIT);
+        if (r >= 0 || errno != EINTR) {
+            if (r < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+            return r;
+        }
+    }
+}
+
+// --- Buffered line reader ------------------------------------------------------
+
+void linebuf_init(linebuf_t *lb, char *buf, size_t cap) {
+    lb->buf = buf;
+    lb->cap = cap;
+    lb->off = lb->have = 0;
+    lb->line_mode = 0;
+}
+
+ssize_t linebuf_fill(linebuf_t *lb, int fd, int flags) {
+    if (lb->off) {
+        memmove(lb->buf, lb->buf + lb->off, lb->have - lb->off);
+        lb->have -= lb->off;
+        lb->off = 0;
+    }
+    ssize_t n = recv(fd, lb->buf + lb->have, lb->cap - lb->have, flags);
+    if (n > 0) lb->have += (size_t)n;
+    return n;
+}
+
+size_t linebuf_lines(linebuf_t *lb, span_t *spans, size_t max) {
+    size_t used, k = scan_lines(lb->buf + lb->off, lb->have - lb->off, spans, max, &used);
+    if (k) lb->line_mode = 1;
+    lb->off += used;
+    return k;
+}
+
+int linebuf_tail(linebuf_t *lb, span_t *tail) {
+    size_t len = lb->have - lb->off;
+    if (!len || (lb->line_mode && len < lb->cap)) return 0;
+    tail->p = lb->buf + lb->off;
+    tail->len = tail->p[len - 1] == '\r' ? len - 1 : len;
+    lb->off = lb->have;
+    return 1;
+}
+
+int linebuf_pending(const linebuf_t *lb) {
+    return memchr(lb->buf + lb->off, '\n', lb->have - lb->off) != NULL;
+}
@@ -0,0 +1,76 @@
+// netio.h — I/O helpers shared by the exercises
+//
+// read_full() / write_full() move exactly n bytes over a blocking fd (the
+// parent/child pipes, hand-off sockets), retrying short transfers and EINTR.
+// trim_eol() strips the "\n" / "\r\n" a line was read with.
+//
+// send_nb() / recv_nb() are one non-blocking attempt on a socket, whatever
+// its O_NONBLOCK flag (MSG_DONTWAIT, so a forked child sharing the open file
+// keeps blocking), with EINTR retried and "would block" told apart from
+// errors.
+//
+// linebuf_t is the buffered line reader every line-protocol server had its
+// own copy of: recv() into the free end of a caller-owned buffer, hand out
+// every complete line (scan_lines(), no copies), keep the partial one.
+// Clients that never send '\n' (the interactive clients strip it) get one
+// message per recv() instead, and so does a line that fills the whole buffer:
+//
+//     linebuf_t lb;  linebuf_init(&lb, buf, sizeof(buf));
+//     while (linebuf_fill(&lb, fd, 0) > 0) {
+//         while ((k = linebuf_lines(&lb, lines, MAX_LINES)) > 0) ... lines[0..k)
+//         if (linebuf_tail(&lb, &tail)) ... tail
+//     }
+//
+// The rest of the shared networking core lives next to this: listeners,
+// accept batches and acceptor shards in listen.h, line framing in scan.h.
+#ifndef COMMON_NETIO_H
+#define COMMON_NETIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "scan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// n on success; fewer (possibly 0) if read() hit EOF first; -1 with errno.
+ssize_t read_full(int fd, void *buf, size_t n);
+// n on success, -1 with errno.
+ssize_t write_full(int fd, const void *buf, size_t n);
+// Strips trailing '\n' and '\r' characters in place.
+void    trim_eol(char *s);
+
+// Bytes the socket took, 0 if it is full; -1 with errno on a real error.
+// Never raises SIGPIPE.
+ssize_t send_nb(int fd, const void *buf, size_t n);
+// Bytes read, 0 at EOF; -1 with errno, EAGAIN if nothing has arrived yet.
+ssize_t recv_nb(int fd, void *buf, size_t n);
+
+typedef struct {
+    char  *buf;
+    size_t cap;
+    size_t off, have;         // buf[off..have) not handed out yet
+    int    line_mode;         // set once the peer has sent a '\n'
+} linebuf_t;
+
+void    linebuf_init(linebuf_t *lb, char *buf, size_t cap);
+// Moves what is left to the front, then one recv(fd, ..., flags) into the
+// free space.  Returns what recv() did (0 at EOF, -1 with errno).
+ssize_t linebuf_fill(linebuf_t *lb, int fd, int flags);
+// Up to max complete lines, consumed from the buffer; 0 when none are left.
+// The spans point into the buffer and stay valid until the next fill.
+size_t  linebuf_lines(linebuf_t *lb, span_t *spans, size_t max);
+// After the lines: 1 if the unterminated rest is to be taken as a message
+// now (peer never sends '\n', or it fills the buffer), in *tail, consumed
+// ("\r" dropped); 0 if it waits for the rest of its line.
+int     linebuf_tail(linebuf_t *lb, span_t *tail);
+// Whole lines not handed out yet?  (A caller that stopped early.)
+int     linebuf_pending(const linebuf_t *lb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+// opts.h — "key=value,key=value" option strings
+//
+// Every tunable module takes its command-line option as such a string (-A
+// listen_opts_parse(), -B busypoll_parse(), -P presence_parse(), -O
+// overload_parse(), -F flight_init(), keepalive_parse(),
+// aclient_opts_parse()); this walks one pair at a time so each of them only
+// says what its keys mean:
+//
+//   opt_t o;
+//   int r;
+//   while ((r = opt_next(&s, &o)) > 0) {
+//       if      (opt_key(&o, "max") && o.num >= 0) p->max = (int)o.num;
+//       else if (opt_key(&o, "dir"))               use(o.val, o.vlen);
+//       else return -1;
+//   }
+//   return r;                     // 0 at the end, -1 on a pair without '='
+//
+// Header-only, so no Build: line has to name another file.
+#ifndef COMMON_OPTS_H
+#define COMMON_OPTS_H
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *key, *val;      // not NUL-terminated: klen / vlen bytes
+    size_t      klen, vlen;
+    long        num;            // val as a non-negative integer, or -1 if it is not one
+} opt_t;
+
+// The next pair of *s into *o, advancing *s past it and its ','.
+// 1 = got one, 0 = no more, -1 = a key without '='.
+static inline int opt_next(const char **s, opt_t *o) {
+    const char *p = *s;
+    if (!*p) return 0;
+    o->key = p;
+    o->klen = strcspn(p, "=,");
+    if (p[o->klen] != '=') return -1;
+    o->val = p + o->klen + 1;
+    o->vlen = strcspn(o->val, ",");
+    char *end;
+    o->num = strtol(o->val, &end, 10);
+    if (o->vlen == 0 || end != o->val + o->vlen || o->num < 0) o->num = -1;
+    *s = o->val[o->vlen] ? o->val + o->vlen + 1 : o->val + o->vlen;
+    return 1;
+}
+
+static inline int opt_key(const opt_t *o, const char *key) {
+    return strlen(key) == o->klen && !strncmp(o->key, key, o->klen);
+}
+
+static inline int opt_val(const opt_t *o, const char *val) {
+    return strlen(val) == o->vlen && !strncmp(o->val, val, o->vlen);
+}
+
+#endif
@@ -0,0 +1,97 @@
+// overload.c — lag-driven load shedding (see overload.h)
+#include "overload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opts.h"
+
+#define RATE_FREE 32      // read limit lifted once it has doubled back past rate * this
+
+void overload_init(overload_t *o) {
+    memset(o, 0, sizeof(*o));
+    o->target_ms = 50;
+    o->window_ms = 200;
+    o->resume_pct = 50;
+    o->hold_ms = 1000;
+    o->rate = 50;
+}
+
+int overload_parse(overload_t *o, const char *s) {
+    if (!strcmp(s, "off")) { o->off = 1; return 0; }
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long v = kv.num;
+        if (v < 0) return -1;
+        if      (opt_key(&kv, "target") && v > 0)    o->target_ms = (int)v;
+        else if (opt_key(&kv, "window") && v > 0)    o->window_ms = (int)v;
+        else if (opt_key(&kv, "resume") && v <= 100) o->resume_pct = (int)v;
+        else if (opt_key(&kv, "hold"))               o->hold_ms = (int)v;
+        else if (opt_key(&kv, "rate") && v > 0)      o->rate = (int)v;
+        else return -1;
+    }
+    return r;
+}
+
+void overload_sample(overload_t *o, overload_win_t *w, metric_t *hist, uint64_t ns) {
+    uint64_t target = (uint64_t)o->target_ms * 1000000ull;
+    w->n++;
+    if (ns > target) w->over++;
+    if (ns * 100 > target * (uint64_t)o->resume_pct) w->warm++;
+    if (ns > w->max_ns) w->max_ns = ns;
+    if (hist) metric_observe(hist, ns);
+}
+
+// p99 over the threshold: more than 1% of the samples are.
+static int p99_above(uint32_t above, uint32_t n) {
+    return (uint64_t)above * 100 > n;
+}
+
+int overload_update(overload_t *o, uint64_t now) {
+    if (o->off) return 0;
+    if (o->window_end == 0) o->window_end = now + (uint64_t)o->window_ms * 1000000ull;
+    if (now < o->window_end) return o->shedding;
+
+    int hot  = p99_above(o->lag.over, o->lag.n) || p99_above(o->delay.over, o->delay.n);
+    int calm = !p99_above(o->lag.warm, o->lag.n) && !p99_above(o->delay.warm, o->delay.n);
+    double lag_ms = o->lag.max_ns / 1e6, delay_ms = o->delay.max_ns / 1e6;
+
+    if (hot) {
+        if (!o->shedding) {
+            o->shedding = 1;
+            o->shed_since = now;
+            if (o->episodes) metric_inc(o->episodes);
+            fprintf(stderr, "overload: shedding load; p99 over %d ms (loop lag max %.1f ms, queue delay max %.1f ms)\n",
+                    o->target_ms, lag_ms, delay_ms);
+        }
+        o->calm_since = 0;
+        o->cur_rate = !o->cur_rate ? o->rate : o->cur_rate > 1 ? o->cur_rate / 2 : 1;
+    } else {
+        // Readers come back gradually; new clients once it has been calm for a while.
+        if (o->cur_rate) o->cur_rate *= 2;
+        if (o->cur_rate > o->rate * RATE_FREE) o->cur_rate = 0;
+        if (o->shedding && !calm) {
+            o->calm_since = 0;
+        } else if (o->shedding && !o->calm_since) {
+            o->calm_since = now;
+        } else if (o->shedding && now - o->calm_since >= (uint64_t)o->hold_ms * 1000000ull) {
+            o->shedding = 0;
+            fprintf(stderr, "overload: recovered after %.1f s\n", (now - o->shed_since) / 1e9);
+        }
+    }
+    if (o->state) metric_set(o->state, o->shedding);
+
+    memset(&o->lag, 0, sizeof(o->lag));
+    memset(&o->delay, 0, sizeof(o->delay));
+    o->window_end = now + (uint64_t)o->window_ms * 1000000ull;
+    return o->shedding;
+}
+
+struct timeval *overload_timeout(struct timeval *cur, uint64_t wake_ns, uint64_t now, struct timeval *tv) {
+    if (!wake_ns) return cur;
+    uint64_t left = wake_ns > now ? wake_ns - now : 0;
+    if (cur && (uint64_t)cur->tv_sec * 1000000000ull + (uint64_t)cur->tv_usec * 1000ull <= left) return cur;
+    return ns_timeval(left, tv);
+}
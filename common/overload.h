@@ -0,0 +1,80 @@
+// overload.h — load shedding for the chat brokers, driven by their own lag
+//
+// Past capacity a broker that keeps admitting clients and reading messages
+// only grows its backlog until every user's latency has collapsed.  The
+// broker reports two delays here instead:
+//   loop lag      how long each pass of its loop took (a ready fd can wait
+//                 that long before it is even looked at)
+//   queue delay   per message, from the child's recv() to the broker taking
+//                 it up (time spent in the pipe and behind earlier work)
+// Every `window` ms the controller checks whether either one's p99 is over
+// `target` (more than 1% of the window's samples above it).  If so it sheds:
+// new connections get "Server busy" and are closed, and each client's pipe is
+// read at most `rate` messages/s, halved for every further window over
+// target, so the backlog stays in the children and the clients' sockets
+// (TCP pushes back on the senders) rather than in front of the admitted
+// users.  Hysteresis: the read limit doubles back in each window under target
+// and is lifted past 32 x rate, and new clients are admitted again once both
+// p99s have stayed under resume% of the target for `hold` ms.
+//
+// Off with "off"; the brokers then skip the per-message clock reads.
+#ifndef COMMON_OVERLOAD_H
+#define COMMON_OVERLOAD_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t n, over, warm;           // samples, above target, above resume% of target
+    uint64_t max_ns;
+} overload_win_t;
+
+// Parsed from "target=MS,window=MS,resume=PCT,hold=MS,rate=N" or "off".
+typedef struct {
+    int      target_ms;               // p99 objective for both delays (default 50)
+    int      window_ms;               // evaluated this often (default 200)
+    int      resume_pct;              // shedding ends under this % of target ... (default 50)
+    int      hold_ms;                 // ... held this long (default 1000)
+    int      rate;                    // messages/s per client when shedding starts (default 50)
+    int      off;
+    int      shedding;                // turning new clients away
+    int      cur_rate;                // read limit per client; 0 = none
+    uint64_t window_end, calm_since, shed_since;
+    overload_win_t lag, delay;        // current window
+    metric_t *lag_hist, *delay_hist, *state, *episodes;   // may be NULL
+} overload_t;
+
+void overload_init(overload_t *o);
+int  overload_parse(overload_t *o, const char *s);      // -1 on a bad key/value
+
+void overload_sample(overload_t *o, overload_win_t *w, metric_t *hist, uint64_t ns);
+static inline void overload_lag(overload_t *o, uint64_t ns) {
+    if (!o->off) overload_sample(o, &o->lag, o->lag_hist, ns);
+}
+static inline void overload_delay(overload_t *o, uint64_t ns) {
+    if (!o->off) overload_sample(o, &o->delay, o->delay_hist, ns);
+}
+
+// Once per loop pass, before admitting anyone: closes the window if it is
+// over.  Returns 1 while new clients are to be turned away.
+int overload_update(overload_t *o, uint64_t now);
+
+// A client just read from may be read again at this time (0: any time).
+static inline uint64_t overload_next_read(const overload_t *o, uint64_t now) {
+    return o->cur_rate ? now + 1000000000ull / (uint64_t)o->cur_rate : 0;
+}
+
+// select() timeout: the earlier of cur (NULL = none) and wake_ns (0 = none).
+struct timeval *overload_timeout(struct timeval *cur, uint64_t wake_ns, uint64_t now, struct timeval *tv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+// pool.c — slab allocator + size-classed buffer pool (see pool.h)
+#include "pool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define CHUNK_HDR   64                    // keeps objects cache-line aligned
+#define HUGE_PAGE   (2u * 1024 * 1024)
+#define MPOL_LOCAL  4                     // <numaif.h> without linking libnuma
+
+static size_t round_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+// One backing allocation.  With POOL_HUGEPAGES we first ask for explicit huge
+// pages (needs vm.nr_hugepages > 0), then fall back to THP via madvise().
+static void *map_chunk(size_t bytes, int flags, int *huge) {
+    void *p = MAP_FAILED;
+    *huge = 0;
+#ifdef MAP_HUGETLB
+    if (flags & POOL_HUGEPAGES) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) *huge = 1;
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        if (flags & POOL_HUGEPAGES) (void)madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+#ifdef SYS_mbind
+    // Best effort: without NUMA (ENOSYS) every page is local anyway.
+    if (flags & POOL_LOCAL) (void)syscall(SYS_mbind, p, bytes, MPOL_LOCAL, NULL, 0UL, 0U);
+#endif
+    return p;
+}
+
+int slab_init(slab_t *s, size_t obj_size, size_t objs_per_chunk, int flags) {
+    memset(s, 0, sizeof(*s));
+    if (obj_size < sizeof(void*)) obj_size = sizeof(void*);
+    s->obj_size = round_up(obj_size, 16);
+    s->flags = flags;
+
+    size_t page = (flags & POOL_HUGEPAGES) ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    if (objs_per_chunk == 0) {
+        // Aim for ~64 KiB chunks (one huge page when those are requested).
+        size_t target = (flags & POOL_HUGEPAGES) ? HUGE_PAGE : 65536;
+        objs_per_chunk = (target - CHUNK_HDR) / s->obj_size;
+        if (objs_per_chunk == 0) objs_per_chunk = 1;
+    }
+    s->chunk_bytes = round_up(CHUNK_HDR + objs_per_chunk * s->obj_size, page);
+    s->objs_per_chunk = (s->chunk_bytes - CHUNK_HDR) / s->obj_size;
+    return 0;
+}
+
+static int slab_grow(slab_t *s) {
+    int huge;
+    char *chunk = (char*)map_chunk(s->chunk_bytes, s->flags, &huge);
+    if (!chunk) return -1;
+
+    *(void**)chunk = s->chunks;
+    s->chunks = chunk;
+    s->stats.chunk_maps++;
+    if (huge) s->stats.huge_chunks++;
+
+    // Thread the new objects onto the free list, lowest address first.
+    char *obj = chunk + CHUNK_HDR;
+    for (size_t i = s->objs_per_chunk; i-- > 0; ) {
+        void *o = obj + i * s->obj_size;
+        *(void**)o = s->free_list;
+        s->free_list = o;
+    }
+    return 0;
+}
+
+void *slab_alloc(slab_t *s) {
+    if (!s->free_list && slab_grow(s) < 0) return NULL;
+    void *p = s->free_list;
+    s->free_list = *(void**)p;
+    s->stats.allocs++;
+    s->stats.in_use++;
+    return p;
+}
+
+void slab_free(slab_t *s, void *p) {
+    if (!p) return;
+    *(void**)p = s->free_list;
+    s->free_list = p;
+    s->stats.frees++;
+    s->stats.in_use--;
+}
+
+int slab_reserve(slab_t *s, size_t n) {
+    size_t have = 0;
+    for (void *p = s->free_list; p && have < n; p = *(void**)p) have++;
+    while (have < n) {
+        if (slab_grow(s) < 0) return -1;
+        have += s->objs_per_chunk;
+    }
+    return 0;
+}
+
+void slab_destroy(slab_t *s) {
+    void *c = s->chunks;
+    while (c) {
+        void *next = *(void**)c;
+        munmap(c, s->chunk_bytes);
+        c = next;
+    }
+    s->chunks = NULL;
+    s->free_list = NULL;
+}
+
+// --- Buffer pool -------------------------------------------------------------
+
+static int size_class(size_t n) {
+    size_t sz = 64;
+    for (int c = 0; c < BUFPOOL_CLASSES; c++, sz <<= 2)
+        if (n <= sz) return c;
+    return -1;
+}
+
+int bufpool_init(bufpool_t *bp, int flags) {
+    size_t sz = 64;
+    for (int c = 0; c < BUFPOOL_CLASSES; c++, sz <<= 2) {
+        // Small classes share a chunk; big ones map a few buffers at a time.
+        if (slab_init(&bp->cls[c], sz, sz >= 16384 ? 4 : 0, flags) < 0) return -1;
+    }
+    return 0;
+}
+
+void *bufpool_get(bufpool_t *bp, size_t n, size_t *cap) {
+    int c = size_class(n);
+    if (c < 0) { errno = EMSGSIZE; return NULL; }
+    if (cap) *cap = bp->cls[c].obj_size;
+    return slab_alloc(&bp->cls[c]);
+}
+
+void bufpool_put(bufpool_t *bp, void *p, size_t n) {
+    int c = size_class(n);
+    if (c < 0 || !p) return;
+    slab_free(&bp->cls[c], p);
+}
+
+void bufpool_stats(const bufpool_t *bp, pool_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (int c = 0; c < BUFPOOL_CLASSES; c++) {
+        const pool_stats_t *st = &bp->cls[c].stats;
+        out->allocs      += st->allocs;
+        out->frees       += st->frees;
+        out->in_use      += st->in_use;
+        out->chunk_maps  += st->chunk_maps;
+        out->huge_chunks += st->huge_chunks;
+    }
+}
+
+void bufpool_destroy(bufpool_t *bp) {
+    for (int c = 0; c < BUFPOOL_CLASSES; c++) slab_destroy(&bp->cls[c]);
+}
@@ -0,0 +1,69 @@
+// pool.h — slab allocator for fixed-size objects + size-classed buffer pool
+//
+// Both allocators carve objects out of large mmap()ed chunks and recycle them
+// through intrusive free lists, so once the pool is warm the request path does
+// no malloc()/free() at all.  Chunks can optionally be backed by huge pages.
+//
+// Valid C and C++ (g++ compiles the .c as C++), so every exercise can link it:
+//   gcc -O2 server.c ../common/pool.c      g++ -O2 server.cpp ../common/pool.c
+#ifndef COMMON_POOL_H
+#define COMMON_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_HUGEPAGES  0x1   // try MAP_HUGETLB, fall back to MADV_HUGEPAGE
+#define POOL_LOCAL      0x2   // chunks on the NUMA node of the CPU that first touches them,
+                              // whatever the process policy (numactl --interleave & co.)
+
+typedef struct {
+    uint64_t allocs;        // objects handed out
+    uint64_t frees;         // objects returned
+    uint64_t in_use;        // allocs - frees
+    uint64_t chunk_maps;    // backing mmap() calls (the only "real" allocations)
+    uint64_t huge_chunks;   // chunks that got explicit MAP_HUGETLB pages
+} pool_stats_t;
+
+typedef struct {
+    size_t obj_size;        // rounded up to 16 bytes
+    size_t chunk_bytes;     // size of each mmap()ed chunk
+    size_t objs_per_chunk;
+    int    flags;
+    void  *free_list;       // singly linked through the first word of each free object
+    void  *chunks;          // singly linked through the chunk header
+    pool_stats_t stats;
+} slab_t;
+
+// Objects are 16-byte aligned.  objs_per_chunk == 0 picks a sensible default.
+int   slab_init(slab_t *s, size_t obj_size, size_t objs_per_chunk, int flags);
+void *slab_alloc(slab_t *s);                 // NULL only if mmap() fails
+void  slab_free(slab_t *s, void *p);
+int   slab_reserve(slab_t *s, size_t n);     // pre-map so at least n objects are free
+void  slab_destroy(slab_t *s);               // unmaps every chunk
+
+// Buffer pool: power-of-four size classes from 64 B to 64 KiB.
+#define BUFPOOL_CLASSES   6
+#define BUFPOOL_MAX_SIZE  65536
+
+typedef struct {
+    slab_t cls[BUFPOOL_CLASSES];
+} bufpool_t;
+
+int   bufpool_init(bufpool_t *bp, int flags);
+// Returns a buffer of at least n bytes and stores its real capacity in *cap
+// (may be NULL).  Requests above BUFPOOL_MAX_SIZE fail with errno=EMSGSIZE.
+void *bufpool_get(bufpool_t *bp, size_t n, size_t *cap);
+// n is any size that maps to the same class (the requested size or the cap).
+void  bufpool_put(bufpool_t *bp, void *p, size_t n);
+void  bufpool_stats(const bufpool_t *bp, pool_stats_t *out);   // summed over classes
+void  bufpool_destroy(bufpool_t *bp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+// presence.c — join/leave coalescing (see presence.h)
+#include "presence.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+#include "opts.h"
+
+void presence_init(presence_t *p) {
+    memset(p, 0, sizeof(*p));
+    p->window_ms = 50;
+    p->max = 8;
+}
+
+int presence_parse(presence_t *p, const char *s) {
+    opt_t kv;
+    int r;
+    while ((r = opt_next(&s, &kv)) > 0) {
+        long v = kv.num;
+        if (v < 0) return -1;
+        if      (opt_key(&kv, "window")) p->window_ms = (int)v;
+        else if (opt_key(&kv, "max"))    p->max = (int)v;
+        else return -1;
+    }
+    return r;
+}
+
+int presence_note(presence_t *p, int joined, const char *line, size_t len) {
+    if (p->events) metric_inc(p->events);
+    if (p->window_ms == 0) return 1;
+
+    if (p->due_ns == 0) p->due_ns = mono_ns() + (uint64_t)p->window_ms * 1000000ull;
+    if (joined) p->joined++; else p->left++;
+    if (!p->overflow && p->len + len <= sizeof(p->buf)) {
+        memcpy(p->buf + p->len, line, len);
+        p->len += len;
+    } else {
+        p->overflow = 1;
+    }
+    return 0;
+}
+
+struct timeval *presence_timeout(const presence_t *p, struct timeval *tv) {
+    if (p->due_ns == 0) return NULL;
+    uint64_t now = mono_ns();
+    return ns_timeval(p->due_ns > now ? p->due_ns - now : 0, tv);
+}
+
+size_t presence_flush(presence_t *p, int active, int force, char *out, size_t cap) {
+    if (p->due_ns == 0 || (!force && mono_ns() < p->due_ns)) return 0;
+
+    size_t n;
+    if (!p->overflow && p->joined + p->left <= p->max && p->len <= cap) {
+        memcpy(out, p->buf, p->len);
+        n = p->len;
+    } else {
+        int w = snprintf(out, cap, "+%d joined, -%d left. Active: %d\n", p->joined, p->left, active);
+        n = w < 0 ? 0 : (size_t)w < cap ? (size_t)w : cap - 1;
+        if (p->digests) metric_inc(p->digests);
+    }
+    p->joined = p->left = 0;
+    p->len = 0;
+    p->overflow = 0;
+    p->due_ns = 0;
+    return n;
+}
@@ -0,0 +1,60 @@
+// presence.h — coalesced join/leave announcements for the chat brokers
+//
+// Announcing every join and leave to every client costs N sends per event,
+// so a reconnect storm of N clients costs N² sends.  Instead the broker
+// notes events here and flushes them once per window: a quiet window with
+// at most `max` events goes out as the usual one-line announcements, joined
+// into one buffer; a busier one collapses into a single digest
+// ("+37 joined, -12 left. Active: 1025").  Either way each client gets at
+// most one presence send per window, so churn costs O(N) per window.
+//
+// window=0 announces every event on its own immediately (the old behaviour).
+#ifndef COMMON_PRESENCE_H
+#define COMMON_PRESENCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PRESENCE_BUF 4096             // individual lines held per window
+
+// Parsed from "window=MS,max=N".
+typedef struct {
+    int      window_ms;               // collect for this long (0 = no coalescing)
+    int      max;                     // more events than this -> one digest
+    int      joined, left;            // this window so far
+    size_t   len;                     // bytes of pending lines in buf
+    int      overflow;                // buf was full: digest regardless of max
+    uint64_t due_ns;                  // flush deadline; 0 = nothing pending
+    char     buf[PRESENCE_BUF];
+    metric_t *digests, *events;       // may be NULL
+} presence_t;
+
+void presence_init(presence_t *p);    // window=50, max=8
+int  presence_parse(presence_t *p, const char *s);       // -1 on a bad key/value
+
+// Note one event with its one-line announcement (the caller's usual text,
+// '\n' included).  Returns 1 when the caller should broadcast it right away
+// (window=0), else 0: it is held until presence_flush().
+int  presence_note(presence_t *p, int joined, const char *line, size_t len);
+
+// Time left until the pending events are due, for select(); NULL (block
+// indefinitely, as far as presence goes) if none are pending.
+struct timeval *presence_timeout(const presence_t *p, struct timeval *tv);
+
+// If events are due (or force is set and any are pending), writes what to
+// broadcast into out and returns its length; 0 otherwise.  `active` is the
+// client count to quote in a digest.
+size_t presence_flush(presence_t *p, int active, int force, char *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+// probes.h — USDT static tracepoints (provider "chat")
+//
+// With systemtap-sdt-dev installed each PROBEn() compiles to a single nop plus
+// an ELF note, so it costs nothing until bpftrace/perf attaches:
+//   bpftrace -e 'usdt:./server:chat:broadcast_done { @[arg1] = count(); }'
+//   perf probe -x ./server sdt_chat:msg_read
+// Without <sys/sdt.h> (or with -DNO_USDT) the probes compile away entirely.
+#ifndef COMMON_PROBES_H
+#define COMMON_PROBES_H
+
+#if !defined(NO_USDT) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define HAVE_USDT 1
+#  endif
+#endif
+
+#ifdef HAVE_USDT
+#  define PROBE1(name, a)        DTRACE_PROBE1(chat, name, a)
+#  define PROBE2(name, a, b)     DTRACE_PROBE2(chat, name, a, b)
+#  define PROBE3(name, a, b, c)  DTRACE_PROBE3(chat, name, a, b, c)
+#else
+#  define PROBE1(name, a)        do { (void)(a); } while (0)
+#  define PROBE2(name, a, b)     do { (void)(a); (void)(b); } while (0)
+#  define PROBE3(name, a, b, c)  do { (void)(a); (void)(b); (void)(c); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+// scan.c — vectorized line framing (see scan.h)
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Record the line ending at the '\n' at `nl`; stops the scan when spans is full.
+#define EMIT(nl)                                                        \
+    do {                                                                \
+        size_t len_ = (nl) - start;                                     \
+        if (len_ && buf[(nl) - 1] == '\r') len_--;                      \
+        spans[k].p = buf + start; spans[k].len = len_;                  \
+        start = (nl) + 1;                                               \
+        if (++k == max) goto done;                                      \
+    } while (0)
+
+static size_t scan_scalar(const char *buf, size_t n, span_t *spans, size_t max,
+                          size_t *consumed) {
+    size_t k = 0, start = 0;
+    if (max == 0) goto done;
+    for (;;) {
+        const char *nl = (const char*)memchr(buf + start, '\n', n - start);
+        if (!nl) break;
+        EMIT((size_t)(nl - buf));
+    }
+done:
+    *consumed = start;
+    return k;
+}
+
+#ifdef SCAN_X86
+// Finish the last < width bytes one at a time.
+#define SCAN_TAIL()                                                     \
+    for (; i < n; i++)                                                  \
+        if (buf[i] == '\n') EMIT(i);
+
+__attribute__((target("sse2")))
+static size_t scan_sse2(const char *buf, size_t n, span_t *spans, size_t max,
+                        size_t *consumed) {
+    size_t k = 0, start = 0, i = 0;
+    if (max == 0) goto done;
+    {
+        const __m128i nlv = _mm_set1_epi8('\n');
+        for (; i + 64 <= n; i += 64) {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i)), nlv);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 16)), nlv);
+            __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 32)), nlv);
+            __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 48)), nlv);
+            __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+            if (!_mm_movemask_epi8(any)) continue;
+            unsigned long long m = (unsigned long long)(unsigned)_mm_movemask_epi8(a)
+                                 | (unsigned long long)(unsigned)_mm_movemask_epi8(b) << 16
+                                 | (unsigned long long)(unsigned)_mm_movemask_epi8(c) << 32
+                                 | (unsigned long long)(unsigned)_mm_movemask_epi8(d) << 48;
+            while (m) {
+                size_t pos = i + (size_t)__builtin_ctzll(m);
+                m &= m - 1;
+                EMIT(pos);
+            }
+        }
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+            unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nlv));
+            while (m) {
+                size_t pos = i + (size_t)__builtin_ctz(m);
+                m &= m - 1;
+                EMIT(pos);
+            }
+        }
+        SCAN_TAIL();
+    }
+done:
+    *consumed = start;
+    return k;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *buf, size_t n, span_t *spans, size_t max,
+                        size_t *consumed) {
+    size_t k = 0, start = 0, i = 0;
+    if (max == 0) goto done;
+    {
+        const __m256i nlv = _mm256_set1_epi8('\n');
+        // Two vectors per iteration: newlines are sparse, so most blocks are a
+        // single OR + test.
+        for (; i + 64 <= n; i += 64) {
+            __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i)), nlv);
+            __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 32)), nlv);
+            if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) continue;
+            unsigned long long m = (unsigned)_mm256_movemask_epi8(a)
+                                 | ((unsigned long long)(unsigned)_mm256_movemask_epi8(b) << 32);
+            while (m) {
+                size_t pos = i + (size_t)__builtin_ctzll(m);
+                m &= m - 1;
+                EMIT(pos);
+            }
+        }
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+            unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nlv));
+            while (m) {
+                size_t pos = i + (size_t)__builtin_ctz(m);
+                m &= m - 1;
+                EMIT(pos);
+            }
+        }
+        SCAN_TAIL();
+    }
+done:
+    *consumed = start;
+    return k;
+}
+#endif
+
+scan_fn scan_get_impl(const char *name) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2")) return __builtin_cpu_supports("avx2") ? scan_avx2 : NULL;
+    if (!strcmp(name, "sse2")) return __builtin_cpu_supports("sse2") ? scan_sse2 : NULL;
+#endif
+    if (!strcmp(name, "scalar")) return scan_scalar;
+    return NULL;
+}
+
+static scan_fn g_impl;
+static const char *g_impl_name;
+
+// Resolved once at load time, before main() and any shard thread, so the
+// hot path reads two pointers that never change afterwards.
+__attribute__((constructor)) static void scan_resolve(void) {
+    static const char *const order[] = { "avx2", "sse2", "scalar" };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        scan_fn f = scan_get_impl(order[i]);
+        if (f) { g_impl_name = order[i]; g_impl = f; return; }
+    }
+}
+
+size_t scan_lines(const char *buf, size_t n, span_t *spans, size_t max, size_t *consumed) {
+    return g_impl(buf, n, spans, max, consumed);
+}
+
+const char *scan_impl_name(void) {
+    return g_impl_name;
+}
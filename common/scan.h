@@ -0,0 +1,38 @@
+// scan.h — vectorized line framing for pipelined receive buffers
+//
+// scan_lines() walks a receive buffer once, finds every '\n' (dropping a '\r'
+// right before it) and returns the lines as spans pointing into the buffer —
+// nothing is copied or NUL-terminated.  The implementation (AVX2, SSE2 or
+// scalar memchr) is chosen on first use from what the CPU supports.
+#ifndef COMMON_SCAN_H
+#define COMMON_SCAN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *p;
+    size_t len;           // excludes the "\n" / "\r\n" terminator
+} span_t;
+
+// Fills up to max spans with the complete lines in buf[0..n).  *consumed is
+// set to the offset just past the last terminator that was reported, so
+// buf[*consumed..n) is an unterminated tail the caller keeps for next time.
+// Returns the number of spans written.
+typedef size_t (*scan_fn)(const char *buf, size_t n, span_t *spans, size_t max,
+                          size_t *consumed);
+
+size_t scan_lines(const char *buf, size_t n, span_t *spans, size_t max, size_t *consumed);
+
+// "avx2", "sse2" or "scalar" (for benchmarks); NULL if unsupported here.
+scan_fn     scan_get_impl(const char *name);
+const char *scan_impl_name(void);   // what scan_lines() dispatches to
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
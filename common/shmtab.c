@@ -0,0 +1,216 @@
+// shmtab.c — seqlocked open-addressing table in shared memory (see shmtab.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // memfd_create
+#endif
+#include "shmtab.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SHMTAB_MAGIC 0x53485442u      // "SHTB"
+
+enum { B_EMPTY = 0, B_FULL = 1, B_DELETED = 2 };
+
+typedef struct {
+    uint32_t seq;             // odd while a writer is inside
+    uint32_t state;
+    uint64_t key;
+    unsigned char val[];
+} bucket_t;
+
+typedef struct {              // start of the shared mapping
+    uint32_t magic;
+    uint32_t val_size;
+    uint64_t capacity;        // power of two
+    uint64_t stride;          // bytes per bucket, a multiple of 64
+    uint64_t count;           // live keys
+    char     pad[32];
+} shm_hdr_t;
+
+struct shmtab {               // per-process handle
+    shm_hdr_t *hdr;
+    char      *buckets;
+    size_t     map_len;
+    int        fd;
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint64_t mix64(uint64_t x) {     // splitmix64 finalizer
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27; x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static inline bucket_t *bucket_at(const shmtab_t *t, size_t i) {
+    return (bucket_t*)(t->buckets + i * t->hdr->stride);
+}
+
+static void bucket_lock(bucket_t *b) {
+    for (;;) {
+        uint32_t s = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+        if (!(s & 1) && __atomic_compare_exchange_n(&b->seq, &s, s + 1, 0,
+                                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        cpu_relax();
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);    // odd counter is visible before the new data
+}
+
+static void bucket_unlock(bucket_t *b) {
+    __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Consistent copy of one bucket: state, key and (if val) the value.
+static uint32_t bucket_read(const shmtab_t *t, bucket_t *b, uint64_t *key, void *val) {
+    for (;;) {
+        uint32_t s1 = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) { cpu_relax(); continue; }
+        uint32_t st = __atomic_load_n(&b->state, __ATOMIC_RELAXED);
+        *key = __atomic_load_n(&b->key, __ATOMIC_RELAXED);
+        if (val && st == B_FULL) memcpy(val, b->val, t->hdr->val_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&b->seq, __ATOMIC_RELAXED) == s1) return st;
+    }
+}
+
+static shmtab_t *map_table(int fd, size_t len) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return NULL;
+    shmtab_t *t = (shmtab_t*)malloc(sizeof(*t));
+    if (!t) { munmap(p, len); errno = ENOMEM; return NULL; }
+    t->hdr = (shm_hdr_t*)p;
+    t->buckets = (char*)p + sizeof(shm_hdr_t);
+    t->map_len = len;
+    t->fd = fd;
+    return t;
+}
+
+shmtab_t *shmtab_create(size_t capacity, size_t val_size) {
+    if (val_size == 0 || val_size > SHMTAB_VAL_MAX) { errno = EINVAL; return NULL; }
+    size_t cap = 16;
+    while (cap < capacity) cap <<= 1;
+    size_t stride = (sizeof(bucket_t) + val_size + 63) & ~(size_t)63;
+    size_t len = sizeof(shm_hdr_t) + cap * stride;
+
+    int fd = memfd_create("shmtab", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, (off_t)len) < 0) { int e = errno; close(fd); errno = e; return NULL; }
+    shmtab_t *t = map_table(fd, len);
+    if (!t) { int e = errno; close(fd); errno = e; return NULL; }
+    // ftruncate() zero-filled it: every bucket starts EMPTY with an even counter.
+    t->hdr->val_size = (uint32_t)val_size;
+    t->hdr->capacity = cap;
+    t->hdr->stride = stride;
+    __atomic_store_n(&t->hdr->magic, SHMTAB_MAGIC, __ATOMIC_RELEASE);
+    return t;
+}
+
+shmtab_t *shmtab_attach(int fd) {
+    off_t len = lseek(fd, 0, SEEK_END);
+    if (len < (off_t)sizeof(shm_hdr_t)) { errno = EINVAL; return NULL; }
+    shmtab_t *t = map_table(fd, (size_t)len);
+    if (!t) return NULL;
+    if (__atomic_load_n(&t->hdr->magic, __ATOMIC_ACQUIRE) != SHMTAB_MAGIC ||
+        sizeof(shm_hdr_t) + t->hdr->capacity * t->hdr->stride != (uint64_t)len) {
+        munmap(t->hdr, t->map_len);
+        free(t);
+        errno = EINVAL;
+        return NULL;
+    }
+    return t;
+}
+
+int shmtab_fd(const shmtab_t *t) { return t->fd; }
+
+size_t shmtab_count(const shmtab_t *t) {
+    return (size_t)__atomic_load_n(&t->hdr->count, __ATOMIC_RELAXED);
+}
+
+int shmtab_put(shmtab_t *t, uint64_t key, const void *val) {
+    size_t mask = t->hdr->capacity - 1;
+again:;
+    bucket_t *spare = NULL;                 // first EMPTY/DELETED on the probe path
+    size_t i = mix64(key) & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        bucket_t *b = bucket_at(t, i);
+        uint64_t k;
+        uint32_t st = bucket_read(t, b, &k, NULL);
+        if (st == B_FULL && k == key) {
+            bucket_lock(b);
+            int still = b->state == B_FULL && b->key == key;
+            if (still) memcpy(b->val, val, t->hdr->val_size);
+            bucket_unlock(b);
+            if (still) return 0;
+            goto again;                     // only its owner deletes a key, but be safe
+        }
+        if (st != B_FULL && !spare) spare = b;
+        if (st == B_EMPTY) break;           // the key cannot be further along
+    }
+    if (!spare) { errno = ENOSPC; return -1; }
+
+    bucket_lock(spare);
+    if (spare->state == B_FULL) {           // another key got here first
+        bucket_unlock(spare);
+        goto again;
+    }
+    spare->key = key;
+    memcpy(spare->val, val, t->hdr->val_size);
+    __atomic_store_n(&spare->state, (uint32_t)B_FULL, __ATOMIC_RELAXED);
+    bucket_unlock(spare);
+    __atomic_add_fetch(&t->hdr->count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int shmtab_get(const shmtab_t *t, uint64_t key, void *val) {
+    unsigned char tmp[SHMTAB_VAL_MAX];
+    size_t mask = t->hdr->capacity - 1;
+    size_t i = mix64(key) & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        uint64_t k;
+        uint32_t st = bucket_read(t, bucket_at(t, i), &k, tmp);
+        if (st == B_EMPTY) return 0;
+        if (st == B_FULL && k == key) { memcpy(val, tmp, t->hdr->val_size); return 1; }
+    }
+    return 0;
+}
+
+int shmtab_del(shmtab_t *t, uint64_t key) {
+    size_t mask = t->hdr->capacity - 1;
+    size_t i = mix64(key) & mask;
+    for (size_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        bucket_t *b = bucket_at(t, i);
+        uint64_t k;
+        uint32_t st = bucket_read(t, b, &k, NULL);
+        if (st == B_EMPTY) return 0;
+        if (st != B_FULL || k != key) continue;
+        bucket_lock(b);
+        int hit = b->state == B_FULL && b->key == key;
+        if (hit) __atomic_store_n(&b->state, (uint32_t)B_DELETED, __ATOMIC_RELAXED);
+        bucket_unlock(b);
+        if (hit) __atomic_sub_fetch(&t->hdr->count, 1, __ATOMIC_RELAXED);
+        return hit;
+    }
+    return 0;
+}
+
+size_t shmtab_foreach(const shmtab_t *t, void (*fn)(uint64_t key, const void *val, void *arg), void *arg) {
+    unsigned char val[SHMTAB_VAL_MAX];
+    size_t seen = 0;
+    for (size_t i = 0; i < t->hdr->capacity; i++) {
+        uint64_t k;
+        if (bucket_read(t, bucket_at(t, i), &k, val) != B_FULL) continue;
+        fn(k, val, arg);
+        seen++;
+    }
+    return seen;
+}
@@ -0,0 +1,50 @@
+// shmtab.h — fixed-capacity hash table in shared memory for forked workers
+//
+// Created before fork(), the table is mapped MAP_SHARED in every child, so
+// workers look up and update session state (nicks, presence, settings)
+// directly instead of asking the parent over a pipe.  It is backed by a
+// memfd, which can be passed to another process (SCM_RIGHTS) and attached
+// there, e.g. across a hot restart.
+//
+// Open addressing with linear probing over cache-line buckets.  Each bucket
+// has a sequence counter: writers take it odd with a CAS (so it doubles as a
+// per-bucket lock), write, and make it even again; readers never write at
+// all — they copy the bucket and retry if the counter moved.  Deleted keys
+// leave a tombstone that a later insert reuses.
+//
+// Concurrent writers of different keys are fine.  A given key must have one
+// writer at a time (its owner, e.g. the worker for that session).
+// ../tests/shmtab_test.c holds it to that under fork-based stress.
+#ifndef COMMON_SHMTAB_H
+#define COMMON_SHMTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHMTAB_VAL_MAX 232          // bucket header + value fit in four cache lines
+
+typedef struct shmtab shmtab_t;
+
+// capacity is rounded up to a power of two; keep it ~2x the live keys.
+shmtab_t *shmtab_create(size_t capacity, size_t val_size);     // NULL + errno on failure
+shmtab_t *shmtab_attach(int fd);                               // takes ownership of fd
+int       shmtab_fd(const shmtab_t *t);
+
+int    shmtab_put(shmtab_t *t, uint64_t key, const void *val); // 0, or -1 (ENOSPC) if full
+int    shmtab_get(const shmtab_t *t, uint64_t key, void *val); // 1 found (val filled), 0 absent
+int    shmtab_del(shmtab_t *t, uint64_t key);                  // 1 removed, 0 absent
+size_t shmtab_count(const shmtab_t *t);
+
+// Calls fn for every live entry, each copied out consistently (the table as
+// a whole is not a snapshot).  Returns the number visited.
+size_t shmtab_foreach(const shmtab_t *t, void (*fn)(uint64_t key, const void *val, void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+// trace.c — chat traffic capture format (see trace.h)
+#include "trace.h"
+
+#include <string.h>
+#include <time.h>
+
+static uint64_t clock_ns(clockid_t c) {
+    struct timespec ts;
+    clock_gettime(c, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void put_varint(FILE *f, uint64_t v) {
+    while (v >= 0x80) { putc((int)(v & 0x7f) | 0x80, f); v >>= 7; }
+    putc((int)v, f);
+}
+
+static int get_varint(FILE *f, uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(f);
+        if (c == EOF) return -1;
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) { *v = x; return 0; }
+    }
+    return -1;
+}
+
+int trace_open_write(trace_writer_t *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (!w->f) return -1;
+    setvbuf(w->f, NULL, _IOFBF, 1 << 16);
+
+    uint16_t ver = TRACE_VERSION, reserved = 0;
+    uint64_t wall = clock_ns(CLOCK_REALTIME);
+    fwrite(TRACE_MAGIC, 1, 4, w->f);
+    fwrite(&ver, sizeof(ver), 1, w->f);
+    fwrite(&reserved, sizeof(reserved), 1, w->f);
+    fwrite(&wall, sizeof(wall), 1, w->f);
+    w->last_ns = clock_ns(CLOCK_MONOTONIC);
+    return 0;
+}
+
+void trace_write(trace_writer_t *w, int type, unsigned conn, const void *data, uint32_t len) {
+    if (!w->f) return;
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    uint64_t dt_us = (now - w->last_ns) / 1000;
+    w->last_ns += dt_us * 1000;        // keep the sub-microsecond remainder
+
+    putc(type, w->f);
+    put_varint(w->f, conn);
+    put_varint(w->f, dt_us);
+    put_varint(w->f, len);
+    if (len) fwrite(data, 1, len, w->f);
+    w->records++;
+}
+
+void trace_close_write(trace_writer_t *w) {
+    if (w->f) fclose(w->f);
+    w->f = NULL;
+}
+
+int trace_open_read(trace_reader_t *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->f = fopen(path, "rb");
+    if (!r->f) return -1;
+
+    char magic[4];
+    uint16_t ver, reserved;
+    if (fread(magic, 1, 4, r->f) != 4 || memcmp(magic, TRACE_MAGIC, 4) ||
+        fread(&ver, sizeof(ver), 1, r->f) != 1 || ver != TRACE_VERSION ||
+        fread(&reserved, sizeof(reserved), 1, r->f) != 1 ||
+        fread(&r->start_wall_ns, sizeof(r->start_wall_ns), 1, r->f) != 1) {
+        fclose(r->f);
+        r->f = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int trace_read(trace_reader_t *r, trace_record_t *rec) {
+    int type = getc(r->f);
+    if (type == EOF) return 0;
+
+    uint64_t conn, dt, len;
+    if (get_varint(r->f, &conn) < 0 || get_varint(r->f, &dt) < 0 ||
+        get_varint(r->f, &len) < 0 || len > sizeof(rec->data))
+        return -1;
+    if (len && fread(rec->data, 1, (size_t)len, r->f) != len) return -1;
+
+    r->t_us += dt;
+    rec->type = type;
+    rec->conn = (unsigned)conn;
+    rec->t_us = r->t_us;
+    rec->len  = (uint32_t)len;
+    return 1;
+}
+
+void trace_close_read(trace_reader_t *r) {
+    if (r->f) fclose(r->f);
+    r->f = NULL;
+}
@@ -0,0 +1,55 @@
+// trace.h — compact binary capture of inbound chat traffic
+//
+// File layout:
+//   header  "CHTR" | u16 version | u16 reserved | u64 wall-clock start (ns)
+//   records [u8 type][varint conn][varint dt_us][varint len][len bytes]
+// dt_us is the gap to the previous record in microseconds, so a busy trace
+// costs ~4 bytes of framing per message.  JOIN/LEAVE records have len == 0.
+#ifndef COMMON_TRACE_H
+#define COMMON_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAGIC   "CHTR"
+#define TRACE_VERSION 1
+
+enum { TR_JOIN = 1, TR_MSG = 2, TR_LEAVE = 3 };
+
+typedef struct {
+    FILE    *f;
+    uint64_t last_ns;      // monotonic time of the previous record
+    uint64_t records;
+} trace_writer_t;
+
+typedef struct {
+    int      type;
+    unsigned conn;
+    uint64_t t_us;         // offset from the start of the trace
+    uint32_t len;
+    char     data[65536];
+} trace_record_t;
+
+typedef struct {
+    FILE    *f;
+    uint64_t t_us;
+    uint64_t start_wall_ns;
+} trace_reader_t;
+
+int  trace_open_write(trace_writer_t *w, const char *path);
+void trace_write(trace_writer_t *w, int type, unsigned conn, const void *data, uint32_t len);
+void trace_close_write(trace_writer_t *w);
+
+int  trace_open_read(trace_reader_t *r, const char *path);
+int  trace_read(trace_reader_t *r, trace_record_t *rec);   // 1 = record, 0 = EOF, -1 = corrupt
+void trace_close_read(trace_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,237 @@
+// udpecho.c — batched UDP echo service (see udpecho.h)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE          // recvmmsg/sendmmsg
+#endif
+#include "udpecho.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+#define UDP_SLOT      2048          // one plain datagram per receive slot
+#define UDP_GRO_SLOT  65536         // one coalesced GRO train per receive slot
+#define UDP_MAX_SEGS  64            // kernel limit on segments per GSO send
+#define UDP_MAX_PAYLOAD 65507
+#define OUT_MSGS      256
+#define OUT_IOV       4096
+
+static const char PREFIX[] = "Echo: ";
+#define PLEN (sizeof(PREFIX) - 1)
+
+typedef union {
+    char b[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} ctl_t;
+
+// Replies queued for the next sendmmsg(); they point into the receive slots.
+typedef struct {
+    int fd, gso_send;
+    const udp_echo_cfg_t *cfg;
+    int nout, niov;
+    struct mmsghdr out[OUT_MSGS];
+    struct iovec   iov[OUT_IOV];
+    ctl_t          ctl[OUT_MSGS];
+    struct mmsghdr one[OUT_MSGS];   // GSO refused: the queued trains, a datagram each
+} udp_worker_t;
+
+static void count(metric_t *m, int64_t n) { if (m) metric_add(m, n); }
+
+// Send msgs[0..n).  Returns n, or the index of a GSO train the kernel
+// refused; any other reply that fails is dropped (the sender sees a lost
+// datagram).
+static int send_batch(udp_worker_t *w, struct mmsghdr *msgs, int n) {
+    int off = 0;
+    while (off < n) {
+        int r = sendmmsg(w->fd, msgs + off, (unsigned)(n - off), 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (msgs[off].msg_hdr.msg_controllen && (errno == EIO || errno == EINVAL)) return off;
+            off++;
+            continue;
+        }
+        for (int i = off; i < off + r; i++) count(w->cfg->bytes_out, msgs[i].msg_len);
+        off += r;
+    }
+    return n;
+}
+
+static void flush(udp_worker_t *w) {
+    int off = send_batch(w, w->out, w->nout);
+    if (off < w->nout) {
+        // No GSO on this path after all: resend what is still queued, each
+        // (prefix, segment) iovec pair of a train as a datagram of its own.
+        fprintf(stderr, "udp echo: GSO send refused (%s); replying per datagram\n", strerror(errno));
+        w->gso_send = 0;
+        int n = 0;
+        for (int i = off; i < w->nout; i++) {
+            const struct msghdr *h = &w->out[i].msg_hdr;
+            for (size_t j = 0; j < h->msg_iovlen; j += 2) {
+                if (n == OUT_MSGS) { send_batch(w, w->one, n); n = 0; }
+                struct mmsghdr *m = &w->one[n++];
+                memset(m, 0, sizeof(*m));
+                m->msg_hdr.msg_name = h->msg_name;
+                m->msg_hdr.msg_namelen = h->msg_namelen;
+                m->msg_hdr.msg_iov = h->msg_iov + j;
+                m->msg_hdr.msg_iovlen = 2;
+            }
+        }
+        send_batch(w, w->one, n);
+    }
+    w->nout = w->niov = 0;
+}
+
+// Queue "Echo: <segment>" for every seg-sized piece of p[0..len) (seg == len
+// for an ordinary datagram).  With GSO the pieces of one train go out as a
+// single message whose segment size is seg + the prefix.
+static void add_replies(udp_worker_t *w, struct sockaddr_in *to, const char *p, size_t len, size_t seg) {
+    size_t nseg = seg && len ? (len + seg - 1) / seg : 1;
+    size_t per = 1;
+    if (w->gso_send && nseg > 1) {
+        per = UDP_MAX_PAYLOAD / (seg + PLEN);
+        if (per > UDP_MAX_SEGS) per = UDP_MAX_SEGS;
+    }
+    count(w->cfg->msgs, (int64_t)nseg);
+
+    while (nseg > 0) {
+        size_t k = nseg < per ? nseg : per;
+        if (w->nout == OUT_MSGS || w->niov + 2 * (int)k > OUT_IOV) flush(w);
+
+        struct mmsghdr *m = &w->out[w->nout];
+        memset(m, 0, sizeof(*m));
+        m->msg_hdr.msg_name = to;
+        m->msg_hdr.msg_namelen = sizeof(*to);
+        m->msg_hdr.msg_iov = &w->iov[w->niov];
+        m->msg_hdr.msg_iovlen = 2 * k;
+        for (size_t j = 0; j < k; j++) {
+            size_t take = len < seg ? len : seg;
+            struct iovec *v = &w->iov[w->niov];
+            v[0].iov_base = (void*)PREFIX; v[0].iov_len = PLEN;
+            v[1].iov_base = (void*)p;      v[1].iov_len = take;
+            w->niov += 2;
+            p += take; len -= take;
+        }
+        if (k > 1) {
+            m->msg_hdr.msg_control = w->ctl[w->nout].b;
+            m->msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *c = CMSG_FIRSTHDR(&m->msg_hdr);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso = (uint16_t)(seg + PLEN);
+            memcpy(CMSG_DATA(c), &gso, sizeof(gso));
+        }
+        w->nout++;
+        nseg -= k;
+    }
+}
+
+static void worker_loop(int fd, int gro, const udp_echo_cfg_t *cfg) {
+    static udp_worker_t w;
+    static struct mmsghdr in[UDP_BATCH];
+    static struct iovec iov[UDP_BATCH];
+    static struct sockaddr_in from[UDP_BATCH];
+    static ctl_t ctl[UDP_BATCH];
+
+    size_t slot = gro ? UDP_GRO_SLOT : UDP_SLOT;
+    char *bufs = (char*)malloc(UDP_BATCH * slot);
+    if (!bufs) { perror("udp echo buffers"); _exit(1); }
+    w.fd = fd;
+    w.gso_send = cfg->offload;
+    w.cfg = cfg;
+    for (int i = 0; i < UDP_BATCH; i++) {
+        iov[i].iov_base = bufs + (size_t)i * slot;
+        iov[i].iov_len = slot;
+    }
+
+    for (;;) {
+        for (int i = 0; i < UDP_BATCH; i++) {     // recvmmsg() rewrites these
+            memset(&in[i].msg_hdr, 0, sizeof(in[i].msg_hdr));
+            in[i].msg_hdr.msg_name = &from[i];
+            in[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            in[i].msg_hdr.msg_iov = &iov[i];
+            in[i].msg_hdr.msg_iovlen = 1;
+            if (gro) {
+                in[i].msg_hdr.msg_control = ctl[i].b;
+                in[i].msg_hdr.msg_controllen = sizeof(ctl[i].b);
+            }
+        }
+        // Block for the first datagram, then take whatever else is queued.
+        int n = recvmmsg(fd, in, UDP_BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno != EINTR) perror("recvmmsg");
+            continue;
+        }
+
+        for (int i = 0; i < n; i++) {
+            size_t len = in[i].msg_len, seg = len;
+            if (gro) {
+                for (struct cmsghdr *c = CMSG_FIRSTHDR(&in[i].msg_hdr); c; c = CMSG_NXTHDR(&in[i].msg_hdr, c)) {
+                    if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                        int gso;
+                        memcpy(&gso, CMSG_DATA(c), sizeof(gso));
+                        if (gso > 0) seg = (size_t)gso;
+                    }
+                }
+            }
+            count(cfg->bytes_in, (int64_t)len);
+            add_replies(&w, &from[i], (const char*)iov[i].iov_base, len, seg);
+        }
+        flush(&w);
+    }
+}
+
+// Returns the socket and whether GRO ended up enabled on it.
+static int udp_socket(const udp_echo_cfg_t *cfg, int *gro) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int one = 1, rcvbuf = 4 << 20;
+    if (cfg->workers > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));   // best effort
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((uint16_t)cfg->port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+
+    *gro = 0;
+    if (cfg->offload) {
+        if (setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0) *gro = 1;
+        else perror("UDP_GRO (receiving datagrams one by one)");
+    }
+    return fd;
+}
+
+int udp_echo_run(const udp_echo_cfg_t *cfg) {
+    int gro;
+    int fd = udp_socket(cfg, &gro);
+    if (fd < 0) return -1;
+
+    pid_t parent = getpid();
+    for (int k = 1; k < cfg->workers; k++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); break; }
+        if (pid > 0) continue;
+
+        // Worker: its own socket in the SO_REUSEPORT group; dies with us.
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent) _exit(0);
+        close(fd);
+        int wfd = udp_socket(cfg, &gro);
+        if (wfd < 0) { perror("udp worker socket"); _exit(1); }
+        worker_loop(wfd, gro, cfg);
+    }
+    worker_loop(fd, gro, cfg);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// udpecho.h — batched UDP echo service (recvmmsg/sendmmsg)
+//
+// Every datagram is answered with "Echo: " + its payload, the same reply the
+// TCP servers give one-shot clients.  Up to UDP_BATCH datagrams are taken per
+// recvmmsg() and answered with one sendmmsg(); replies are gathered from the
+// constant prefix and the received bytes, so nothing is copied.
+//
+// offload: UDP_GRO on receive (one slot may hold many same-sized datagrams)
+//          and UDP_SEGMENT on send (their replies leave as one GSO write).
+// workers: > 1 forks that many processes, each with its own SO_REUSEPORT
+//          socket, so the kernel spreads senders over cores.
+#ifndef COMMON_UDPECHO_H
+#define COMMON_UDPECHO_H
+
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UDP_BATCH 64
+
+typedef struct {
+    int       port;
+    int       workers;
+    int       offload;
+    metric_t *msgs, *bytes_in, *bytes_out;   // may be NULL
+} udp_echo_cfg_t;
+
+// Serves forever; returns -1 only if the socket cannot be set up.
+int udp_echo_run(const udp_echo_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,203 @@
+// zdict.c — per-message DEFLATE with a shared preset dictionary (see zdict.h)
+#include "zdict.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A 4 KB window holds the whole dictionary and any chat line; the small hash
+// keeps deflateReset() (a memset of it, once per message) cheap.
+#define WINDOW_BITS 12
+#define MEM_LEVEL   4
+#define LEVEL       6
+
+// What the brokers send most, most frequent last (DEFLATE reaches the end of
+// the dictionary with the shortest distances).  Changing a byte changes the
+// id, and clients with the old one simply stay uncompressed.
+static const char DEFAULT_DICT[] =
+    "Welcome! Commands: /nick <name>, /who, /help, /quit (or 'exit').\n"
+    "/nick <name>  change your name\n/who          list who is here\n"
+    "/help         show this list\n/quit         leave the chat\n"
+    "Unknown command: / (try /help)\nUsage: /nick <name>\nGoodbye.\n"
+    "\n*** Server shutting down ***\n"
+    "Users (10):\n - user1\n - user2\n - user3\n"
+    "Sounds good, thank you! Does anyone know what time the meeting is today? "
+    "I think the build is broken again, can you take a look at the error "
+    "when you get a chance. Yes, I just pushed a fix, the tests should pass "
+    "now. No problem. Let me check and get back to you about it tomorrow "
+    "morning. What do you mean? That's right, it works for me. Hello "
+    "everyone, how are you doing? I'm not sure, maybe we should ask "
+    "someone who knows more about this. Thanks, see you later! haha lol :) "
+    "ok okay yeah yes no please sorry great nice cool\n"
+    "+1 joined, -1 left. Active: 12\n"
+    "user12 is now known as \n"
+    " left. Active: 1\n"
+    " joined. Active: 1\n"
+    "user10: user11: user7: user8: user9: user4: user5: user6: "
+    "user1: user2: user3: user0: ";
+
+static void set_dict(zdict_t *d, const unsigned char *data, size_t len) {
+    d->data = data;
+    d->len = len;
+    d->id = (uint32_t)adler32(adler32(0, Z_NULL, 0), data, (uInt)len);
+}
+
+void zdict_default(zdict_t *d) {
+    set_dict(d, (const unsigned char*)DEFAULT_DICT, sizeof(DEFAULT_DICT) - 1);
+}
+
+int zdict_load(zdict_t *d, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    // Only the last window's worth is usable (deflateSetDictionary() keeps the
+    // tail too), and a trained dictionary puts its best content last: keep the
+    // file's last `cap` bytes, reading it through so pipes work as well.
+    size_t cap = (size_t)1 << WINDOW_BITS, len = 0, n;
+    unsigned char *buf = (unsigned char*)malloc(2 * cap);
+    while (buf && (n = fread(buf + len, 1, 2 * cap - len, f)) > 0) {
+        len += n;
+        if (len == 2 * cap) {
+            memmove(buf, buf + cap, cap);
+            len = cap;
+        }
+    }
+    int bad = !buf || ferror(f) || len == 0;
+    fclose(f);
+    if (bad) { free(buf); errno = buf ? EINVAL : ENOMEM; return -1; }
+    if (len > cap) {
+        memmove(buf, buf + len - cap, cap);
+        len = cap;
+    }
+    set_dict(d, buf, len);
+    return 0;
+}
+
+// --- Encoder -----------------------------------------------------------------------
+
+int zdict_enc_init(zdict_enc_t *e, const zdict_t *d) {
+    memset(e, 0, sizeof(*e));
+    e->dict = d;
+    if (deflateInit2(&e->zs, LEVEL, Z_DEFLATED, -WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void zdict_enc_free(zdict_enc_t *e) {
+    deflateEnd(&e->zs);
+    free(e->last);
+    free(e->frame);
+    memset(e, 0, sizeof(*e));
+}
+
+static int grow(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return 0;
+    size_t n = *cap ? *cap : 256;
+    while (n < need) n *= 2;
+    char *p = (char*)realloc(*buf, n);
+    if (!p) return -1;
+    *buf = p;
+    *cap = n;
+    return 0;
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) { p[n++] = (unsigned char)(v | 0x80); v >>= 7; }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+const char *zdict_frame(zdict_enc_t *e, const char *src, size_t n, size_t *frame_len) {
+    if (n == e->last_len && e->frame_len && !memcmp(src, e->last, n)) {
+        e->hits++;
+        *frame_len = e->frame_len;
+        return e->frame;
+    }
+    if (n > ZDICT_FRAME_MAX) return NULL;
+    size_t bound = deflateBound(&e->zs, (uLong)n);
+    if (grow(&e->last, &e->last_cap, n) < 0 || grow(&e->frame, &e->frame_cap, 10 + (bound > n ? bound : n)) < 0)
+        return NULL;
+
+    // Deflate behind room for the longest header, then slide it into place.
+    unsigned char *body = (unsigned char*)e->frame + 10;
+    deflateReset(&e->zs);
+    deflateSetDictionary(&e->zs, e->dict->data, (uInt)e->dict->len);
+    e->zs.next_in = (Bytef*)src;
+    e->zs.avail_in = (uInt)n;
+    e->zs.next_out = body;
+    e->zs.avail_out = (uInt)bound;
+    int packed = deflate(&e->zs, Z_FINISH) == Z_STREAM_END && e->zs.total_out < n;
+    size_t len = packed ? (size_t)e->zs.total_out : n;
+    if (!packed) memcpy(body, src, n);
+    e->runs++;
+
+    unsigned char hdr[10];
+    size_t h = put_varint(hdr, ((uint64_t)len << 1) | (uint64_t)packed);
+    memmove(e->frame + h, body, len);
+    memcpy(e->frame, hdr, h);
+    e->frame_len = h + len;
+    memcpy(e->last, src, n);
+    e->last_len = n;
+    *frame_len = e->frame_len;
+    return e->frame;
+}
+
+// --- Decoder -----------------------------------------------------------------------
+
+int zdict_dec_init(zdict_dec_t *z, const zdict_t *d) {
+    memset(z, 0, sizeof(*z));
+    z->dict = d;
+    if (inflateInit2(&z->zs, -15) != Z_OK) { errno = ENOMEM; return -1; }
+    return 0;
+}
+
+void zdict_dec_free(zdict_dec_t *z) {
+    inflateEnd(&z->zs);
+}
+
+// Frame header: header bytes, or 0 if incomplete, -1 if corrupt.
+static int get_header(const unsigned char *p, size_t n, uint64_t *v) {
+    *v = 0;
+    for (int h = 0; h < 5; h++) {
+        if ((size_t)h == n) return 0;
+        *v |= (uint64_t)(p[h] & 0x7f) << (7 * h);
+        if (!(p[h] & 0x80)) {
+            size_t len = (size_t)(*v >> 1);
+            return len == 0 || len > ZDICT_FRAME_MAX ? -1 : h + 1;
+        }
+    }
+    return -1;
+}
+
+size_t zdict_frame_size(const char *in, size_t n) {
+    uint64_t v;
+    int h = get_header((const unsigned char*)in, n, &v);
+    return h > 0 ? (size_t)h + (size_t)(v >> 1) : 0;
+}
+
+ssize_t zdict_unframe(zdict_dec_t *z, const char *in, size_t n, size_t *used, char *out, size_t cap) {
+    const unsigned char *p = (const unsigned char*)in;
+    uint64_t v;
+    int rc = get_header(p, n, &v);
+    if (rc <= 0) return rc;
+    size_t h = (size_t)rc, len = (size_t)(v >> 1);
+    if (n - h < len) return 0;
+    *used = h + len;
+
+    if (!(v & 1)) {
+        if (len > cap) return -1;
+        memcpy(out, p + h, len);
+        return (ssize_t)len;
+    }
+    inflateReset(&z->zs);
+    inflateSetDictionary(&z->zs, z->dict->data, (uInt)z->dict->len);
+    z->zs.next_in = (Bytef*)(p + h);
+    z->zs.avail_in = (uInt)len;
+    z->zs.next_out = (Bytef*)out;
+    z->zs.avail_out = (uInt)cap;
+    if (inflate(&z->zs, Z_FINISH) != Z_STREAM_END) return -1;
+    return (ssize_t)z->zs.total_out;
+}
@@ -0,0 +1,80 @@
+// zdict.h — per-message DEFLATE with a shared preset dictionary
+//
+// Chat lines are short and repetitive; compressed on their own, 50 bytes
+// come out at ~50.  Primed with a dictionary both ends already have (the
+// server's own notices, "userN: ", everyday chat words), a raw DEFLATE
+// stream can back-reference it from the first byte, so even short lines
+// shrink.  Each message is compressed independently (reset + dictionary),
+// which is what lets a broadcast be compressed once and the same bytes go to
+// every recipient; the encoder remembers its last frame, so the per-recipient
+// calls of one fan-out cost a memcmp after the first.
+//
+// Frame: varint((len << 1) | compressed), then len bytes: raw DEFLATE, or
+// the message as is when compressing would not make it smaller.
+//
+// Negotiation (Ex8): the client sends "/compress deflate <id>" with the id of
+// its dictionary; if it matches, the server answers with the line
+// "+ZDICT deflate <id>" and every byte after that line is frames.
+//
+// Needs zlib (-lz).
+#ifndef COMMON_ZDICT_H
+#define COMMON_ZDICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZDICT_FRAME_MAX  (1 << 20)     // longest message either side accepts
+#define ZDICT_ACK        "+ZDICT deflate "
+
+typedef struct {
+    const unsigned char *data;
+    size_t   len;
+    uint32_t id;                       // adler32 of data; the two ends must agree
+} zdict_t;
+
+void zdict_default(zdict_t *d);                  // built-in chat dictionary
+int  zdict_load(zdict_t *d, const char *path);   // 0, or -1 with errno
+
+typedef struct {
+    z_stream zs;
+    const zdict_t *dict;
+    char    *last;                     // input of the last frame, for the memo
+    size_t   last_len, last_cap;
+    char    *frame;
+    size_t   frame_len, frame_cap;
+    uint64_t runs, hits;               // messages deflated, frames served from the memo
+} zdict_enc_t;
+
+int  zdict_enc_init(zdict_enc_t *e, const zdict_t *d);     // 0, or -1
+void zdict_enc_free(zdict_enc_t *e);
+// Frame for src[0..n); valid until the next call.  NULL only if n is over
+// ZDICT_FRAME_MAX or out of memory.
+const char *zdict_frame(zdict_enc_t *e, const char *src, size_t n, size_t *frame_len);
+
+typedef struct {
+    z_stream zs;
+    const zdict_t *dict;
+} zdict_dec_t;
+
+int  zdict_dec_init(zdict_dec_t *z, const zdict_t *d);     // 0, or -1
+void zdict_dec_free(zdict_dec_t *z);
+// Take one frame off the front of in[0..n) (*used bytes) and put its message
+// in out.  Returns the message length, 0 if the frame is not all there yet,
+// or -1 if it is corrupt or does not fit in cap.
+ssize_t zdict_unframe(zdict_dec_t *z, const char *in, size_t n, size_t *used, char *out, size_t cap);
+
+// Bytes in the frame at the front of in[0..n) (possibly more than n), or 0
+// if its header is incomplete or corrupt.  For writers that stop mid-frame.
+size_t zdict_frame_size(const char *in, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
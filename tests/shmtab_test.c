@@ -0,0 +1,139 @@
+// shmtab_test.c — fork-based stress test for ../common/shmtab.c
+//
+// Build: gcc -Wall -Wextra -O2 shmtab_test.c ../common/shmtab.c -o shmtab_test
+// Run:   ./shmtab_test [-w writers] [-r readers] [-k keys_per_writer] [-n rounds]
+//        (or `make check` from the top)
+//
+// Writer processes put and delete keys of their own (one writer per key, as
+// shmtab.h asks) while reader processes hammer shmtab_get() and
+// shmtab_foreach() on all of them.  Every value is filled from its key and
+// the round that wrote it, so a reader that copies half of one write and
+// half of the next, or a value under the wrong key, sees words that disagree.
+// At the end every key must hold its writer's last round.  Exits 0 when the
+// table held up, 1 with a count of torn reads otherwise.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../common/shmtab.h"
+
+#define FILL 14                 // 128-byte values: two cache lines to tear
+
+typedef struct {
+    uint64_t key, round;
+    uint64_t fill[FILL];
+} val_t;
+
+typedef struct {                // shared with every child
+    volatile int stop;
+    uint64_t torn, gets, visits;
+} shared_t;
+
+static shared_t *g_sh;
+
+static uint64_t key_of(int w, int i) { return (uint64_t)w << 32 | (uint64_t)i; }
+
+static void make_val(val_t *v, uint64_t key, uint64_t round) {
+    v->key = key;
+    v->round = round;
+    for (int j = 0; j < FILL; j++) v->fill[j] = (key * 0x9e3779b97f4a7c15ull) ^ (round + (uint64_t)j);
+}
+
+static int val_ok(uint64_t key, const val_t *v) {
+    val_t want;
+    make_val(&want, key, v->round);
+    return v->key == key && !memcmp(v, &want, sizeof(want));
+}
+
+static void writer(shmtab_t *t, int w, int keys, int rounds) {
+    val_t v;
+    for (int r = 1; r <= rounds; r++) {
+        for (int i = 0; i < keys; i++) {
+            make_val(&v, key_of(w, i), (uint64_t)r);
+            if (shmtab_put(t, key_of(w, i), &v) < 0) { perror("shmtab_put"); _exit(1); }
+        }
+        // Every other round drops a third of the keys again, so inserts keep
+        // landing on tombstones while readers are looking.
+        if (r % 2 && r < rounds)
+            for (int i = r % 3; i < keys; i += 3) shmtab_del(t, key_of(w, i));
+    }
+    _exit(0);
+}
+
+static void check_visit(uint64_t key, const void *val, void *arg) {
+    (void)arg;
+    if (!val_ok(key, (const val_t*)val)) __atomic_add_fetch(&g_sh->torn, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_sh->visits, 1, __ATOMIC_RELAXED);
+}
+
+static void reader(shmtab_t *t, int writers, int keys, unsigned seed) {
+    val_t v;
+    uint64_t gets = 0, torn = 0;
+    for (unsigned n = 0; !g_sh->stop; n++) {
+        seed = seed * 1103515245u + 12345u;
+        uint64_t key = key_of((int)(seed >> 8) % writers, (int)(seed >> 16) % keys);
+        if (shmtab_get(t, key, &v) && !val_ok(key, &v)) torn++;
+        gets++;
+        if (n % 4096 == 0) shmtab_foreach(t, check_visit, NULL);
+    }
+    __atomic_add_fetch(&g_sh->torn, torn, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_sh->gets, gets, __ATOMIC_RELAXED);
+    _exit(0);
+}
+
+int main(int argc, char **argv) {
+    int writers = 4, readers = 2, keys = 200, rounds = 20000;
+    for (int ch; (ch = getopt(argc, argv, "w:r:k:n:")) != -1; ) {
+        if (ch == 'w') writers = atoi(optarg);
+        else if (ch == 'r') readers = atoi(optarg);
+        else if (ch == 'k') keys = atoi(optarg);
+        else if (ch == 'n') rounds = atoi(optarg);
+        else {
+            fprintf(stderr, "usage: %s [-w writers] [-r readers] [-k keys_per_writer] [-n rounds]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (writers < 1 || readers < 1 || keys < 1 || rounds < 1) { fprintf(stderr, "counts must be >= 1\n"); return 2; }
+
+    g_sh = (shared_t*)mmap(NULL, sizeof(*g_sh), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g_sh == MAP_FAILED) { perror("mmap"); return 1; }
+    shmtab_t *t = shmtab_create(2 * (size_t)writers * (size_t)keys, sizeof(val_t));
+    if (!t) { perror("shmtab_create"); return 1; }
+
+    pid_t rpid[64];
+    if (readers > 64) readers = 64;
+    for (int k = 0; k < readers; k++) {
+        if ((rpid[k] = fork()) < 0) { perror("fork"); return 1; }
+        if (rpid[k] == 0) reader(t, writers, keys, 7u * (unsigned)k + 1u);
+    }
+    int failed = 0, status;
+    for (int w = 0; w < writers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); return 1; }
+        if (pid == 0) writer(t, w, keys, rounds);
+    }
+    for (int w = 0; w < writers; w++)           // writers first: readers run until they are done
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) failed = 1;
+    g_sh->stop = 1;
+    for (int k = 0; k < readers; k++)
+        if (waitpid(rpid[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) failed = 1;
+
+    // Quiet now: every key holds its writer's last round, nothing else is left.
+    uint64_t wrong = 0;
+    val_t v;
+    for (int w = 0; w < writers; w++)
+        for (int i = 0; i < keys; i++)
+            if (!shmtab_get(t, key_of(w, i), &v) || !val_ok(key_of(w, i), &v) || v.round != (uint64_t)rounds) wrong++;
+    if (shmtab_count(t) != (size_t)writers * (size_t)keys) wrong++;
+
+    printf("shmtab: %d writers x %d keys x %d rounds, %d readers: %llu gets, %llu visits, "
+           "%llu torn, %llu wrong at the end\n", writers, keys, rounds, readers,
+           (unsigned long long)g_sh->gets, (unsigned long long)g_sh->visits,
+           (unsigned long long)g_sh->torn, (unsigned long long)wrong);
+    return failed || g_sh->torn || wrong ? 1 : 0;
+}